@@ -12,6 +12,10 @@ clang_ver="5.0"
 edo apt-get update
 edo apt-get install -y clang-${clang_ver} clang-tools-${clang_ver} cmake doxygen graphviz gettext libasound2-dev libgtk-3-dev libgtk2.0-dev libnotify-dev ninja-build
 
+if [[ ${WITH_PULSEAUDIO} == "ON" ]] ; then
+	edo apt-get install -y libpulse-dev pulseaudio pulseaudio-utils
+fi
+
 edo cd /pnmixer
 edo mkdir build
 edo cd build
@@ -28,7 +32,10 @@ edo cmake \
 	-DWITH_GTK3=${WITH_GTK3} \
 	-DWITH_LIBNOTIFY=${WITH_LIBNOTIFY} \
 	-DENABLE_NLS=${ENABLE_NLS} \
+	-DWITH_PULSEAUDIO=${WITH_PULSEAUDIO:-OFF} \
 	-DBUILD_DOCUMENTATION=ON \
+	-DWITH_MOCK_BACKEND=ON \
+	-DBUILD_TESTS=ON \
 	-G "${CMAKE_GENERATOR}" \
 	-DCMAKE_C_COMPILER="${CC}" \
 	-DCMAKE_C_FLAGS="-Wall -Wextra -Wno-deprecated-declarations -Werror" \
@@ -45,5 +52,14 @@ else
 fi
 
 edo ${build_wrapper} ${build_command}
+
+# the pulse smoke test needs a server, with a null sink to play with
+if [[ ${WITH_PULSEAUDIO} == "ON" ]] ; then
+	edo pulseaudio --daemonize --exit-idle-time=-1 --disallow-exit
+	edo pactl load-module module-null-sink sink_name=pnmixer_null \
+		sink_properties=device.description=PNMixer-Null
+fi
+
+edo ${build_command} check
 edo ${install_command}
 
@@ -10,13 +10,15 @@
 
 /**
  * @file alsa.c
- * Alsa audio subsystem.
+ * Alsa audio backend.
  * All the alsa-related code is enclosed in here, and this is the only
  * file that uses the alsa library.
- * This is the lowest-level part of PNMixer, that's why it doesn't include
- * any other local headers. If you do so, it probably means that you're
- * starting messing up the code, so think twice.
- * @brief Alsa audio subsystem.
+ * It's one of the backends behind the table of functions of backend.h,
+ * it knows nothing about the frontend (audio.c) or the ui. That's why it
+ * only includes alsa.h, that pulls backend.h in, and the logging helpers.
+ * Anything else probably means that you're starting messing up the
+ * layering, so think twice.
+ * @brief Alsa audio backend.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -25,14 +27,20 @@
 
 #define _GNU_SOURCE /* exp10() */
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/inotify.h>
 #include <glib.h>
 #include <alsa/asoundlib.h>
 
 #include "support-log.h"
 #include "alsa.h"
 
-#define ALSA_DEFAULT_CARD "(default)"
+#define ALSA_DEFAULT_CARD BACKEND_DEFAULT_CARD
 #define ALSA_DEFAULT_HCTL "default"
+#define ALSA_DEVICE_DIR   "/dev/snd"
 
 /*
  * Alsa log and debug macros.
@@ -109,176 +117,528 @@ elem_get_name(snd_mixer_elem_t *elem)
 	return snd_mixer_selem_get_name(elem);
 }
 
-/* Get volume, return a value between 0 and 1 */
+/* Map a dB value to a normalized volume, between 0 and 1 */
 static double
-elem_get_volume(const char *hctl, snd_mixer_elem_t *elem, double *volume)
+dB_to_normalized(long value, long min, long max, gboolean linear)
 {
-	snd_mixer_selem_channel_id_t channel = SND_MIXER_SCHN_FRONT_RIGHT;
-	int err;
-	long min, max, value;
-
-	*volume = 0;
+	double normalized, min_norm;
 
-	err = snd_mixer_selem_get_playback_volume_range(elem, &min, &max);
-	if (err < 0) {
-		ALSA_CARD_ERR(hctl, err, "Can't get playback volume range");
-		return FALSE;
+	if (linear) {
+		normalized = (value - min) / (double) (max - min);
+	} else {
+		normalized = exp10((value - max) / 6000.0);
+		if (min != SND_CTL_TLV_DB_GAIN_MUTE) {
+			min_norm = exp10((min - max) / 6000.0);
+			normalized = (normalized - min_norm) / (1 - min_norm);
+		}
 	}
 
-	if (min >= max) {
-		ALSA_CARD_WARN(hctl, "Invalid playback volume range [%ld - %ld]", min, max);
-		return FALSE;
-	}
+	return normalized;
+}
 
-	err = snd_mixer_selem_get_playback_volume(elem, channel, &value);
-	if (err < 0) {
-		ALSA_CARD_ERR(hctl, err, "Can't get playback volume");
-		return FALSE;
+/* Map a normalized volume to a dB value, rounded according to the direction */
+static long
+normalized_to_dB(double volume, long min, long max, gboolean linear, int dir)
+{
+	long value;
+
+	if (linear) {
+		value = lrint_dir(volume * (max - min), dir) + min;
+	} else {
+		if (min != SND_CTL_TLV_DB_GAIN_MUTE) {
+			double min_norm = exp10((min - max) / 6000.0);
+			volume = volume * (1 - min_norm) + min_norm;
+		}
+		value = lrint_dir(6000.0 * log10(volume), dir) + max;
 	}
 
-	*volume = (value - min) / (double) (max - min);
+	return value;
+}
 
-	return TRUE;
+/*
+ * Playback and capture.
+ * Alsa has two sets of functions for mixer elements, one for each
+ * direction. They have the same prototypes, so we just pick the right
+ * set once and for all, and use it everywhere.
+ */
+
+struct elem_ops {
+	const char *name;
+	int (*has_volume)(snd_mixer_elem_t *);
+	int (*has_volume_joined)(snd_mixer_elem_t *);
+	int (*has_switch)(snd_mixer_elem_t *);
+	int (*is_mono)(snd_mixer_elem_t *);
+	int (*has_channel)(snd_mixer_elem_t *, snd_mixer_selem_channel_id_t);
+	int (*get_volume_range)(snd_mixer_elem_t *, long *, long *);
+	int (*get_dB_range)(snd_mixer_elem_t *, long *, long *);
+	int (*ask_vol_dB)(snd_mixer_elem_t *, long, long *);
+	int (*ask_dB_vol)(snd_mixer_elem_t *, long, int, long *);
+	int (*get_volume)(snd_mixer_elem_t *, snd_mixer_selem_channel_id_t, long *);
+	int (*set_volume)(snd_mixer_elem_t *, snd_mixer_selem_channel_id_t, long);
+	int (*set_volume_all)(snd_mixer_elem_t *, long);
+	int (*get_switch)(snd_mixer_elem_t *, snd_mixer_selem_channel_id_t, int *);
+	int (*set_switch_all)(snd_mixer_elem_t *, int);
+};
+
+typedef struct elem_ops ElemOps;
+
+static const ElemOps playback_ops = {
+	.name = "playback",
+	.has_volume = snd_mixer_selem_has_playback_volume,
+	.has_volume_joined = snd_mixer_selem_has_playback_volume_joined,
+	.has_switch = snd_mixer_selem_has_playback_switch,
+	.is_mono = snd_mixer_selem_is_playback_mono,
+	.has_channel = snd_mixer_selem_has_playback_channel,
+	.get_volume_range = snd_mixer_selem_get_playback_volume_range,
+	.get_dB_range = snd_mixer_selem_get_playback_dB_range,
+	.ask_vol_dB = snd_mixer_selem_ask_playback_vol_dB,
+	.ask_dB_vol = snd_mixer_selem_ask_playback_dB_vol,
+	.get_volume = snd_mixer_selem_get_playback_volume,
+	.set_volume = snd_mixer_selem_set_playback_volume,
+	.set_volume_all = snd_mixer_selem_set_playback_volume_all,
+	.get_switch = snd_mixer_selem_get_playback_switch,
+	.set_switch_all = snd_mixer_selem_set_playback_switch_all,
+};
+
+static const ElemOps capture_ops = {
+	.name = "capture",
+	.has_volume = snd_mixer_selem_has_capture_volume,
+	.has_volume_joined = snd_mixer_selem_has_capture_volume_joined,
+	.has_switch = snd_mixer_selem_has_capture_switch,
+	.is_mono = snd_mixer_selem_is_capture_mono,
+	.has_channel = snd_mixer_selem_has_capture_channel,
+	.get_volume_range = snd_mixer_selem_get_capture_volume_range,
+	.get_dB_range = snd_mixer_selem_get_capture_dB_range,
+	.ask_vol_dB = snd_mixer_selem_ask_capture_vol_dB,
+	.ask_dB_vol = snd_mixer_selem_ask_capture_dB_vol,
+	.get_volume = snd_mixer_selem_get_capture_volume,
+	.set_volume = snd_mixer_selem_set_capture_volume,
+	.set_volume_all = snd_mixer_selem_set_capture_volume_all,
+	.get_switch = snd_mixer_selem_get_capture_switch,
+	.set_switch_all = snd_mixer_selem_set_capture_switch_all,
+};
+
+/* Get the functions to use for a stream direction */
+static const ElemOps *
+elem_ops_get(BackendStream stream)
+{
+	return stream == BACKEND_STREAM_CAPTURE ? &capture_ops : &playback_ops;
 }
 
-/* Set volume, input value between 0 and 1 */
-static gboolean
-elem_set_volume(const char *hctl, snd_mixer_elem_t *elem, double volume, int dir)
+/*
+ * Volume ranges of a mixer element.
+ * Querying them from Alsa each time we get or set the volume is a waste,
+ * since they almost never change. So we query them once, and keep them
+ * around until Alsa tells us that the element info changed.
+ *
+ * Most cards have a few dozens of raw volume steps, so along with the
+ * ranges we precompute the normalized volume of each raw step. Getting
+ * the normalized volume is then a direct lookup, and setting it is a
+ * binary search, instead of going through exp10() and log10() each time.
+ */
+
+#define ELEM_LUT_MAX_STEPS 256
+
+struct elem_range {
+	gboolean valid;     /* Whether the ranges below were queried */
+	/* Raw volume range */
+	gboolean vol_ok;    /* Whether the raw volume range is usable */
+	long min;
+	long max;
+	/* dB range, in hundredths of dB */
+	gboolean dB_ok;     /* Whether the dB range is usable */
+	long dB_min;
+	long dB_max;
+	gboolean dB_linear; /* Whether the dB range is mapped linearly */
+	/* Normalized volume for each raw step, from min to max */
+	double *lut;
+	guint lut_size;
+};
+
+typedef struct elem_range ElemRange;
+
+/* Free the data allocated within a range struct */
+static void
+elem_range_clear(ElemRange *range)
 {
-	int err;
-	long min, max, value;
+	g_free(range->lut);
+	memset(range, 0, sizeof *range);
+}
 
-	err = snd_mixer_selem_get_playback_volume_range(elem, &min, &max);
-	if (err < 0) {
-		ALSA_CARD_ERR(hctl, err, "Can't get playback volume range");
-		return FALSE;
+/* Build the lookup table that maps raw volume steps to normalized volume.
+ * The table is left empty if the element has too many steps, or if Alsa
+ * can't convert raw steps to dB.
+ */
+static void
+elem_range_build_lut(const char *hctl, const ElemOps *ops, snd_mixer_elem_t *elem,
+                     ElemRange *range)
+{
+	guint i, n_steps;
+
+	if (!range->vol_ok || !range->dB_ok)
+		return;
+
+	n_steps = range->max - range->min + 1;
+	if (n_steps > ELEM_LUT_MAX_STEPS) {
+		ALSA_CARD_DEBUG(hctl, "Too many volume steps (%u) for a lookup table",
+		                n_steps);
+		return;
 	}
 
-	if (min >= max) {
-		ALSA_CARD_WARN(hctl, "Invalid playback volume range [%ld - %ld]", min, max);
-		return FALSE;
+	range->lut = g_new(double, n_steps);
+
+	for (i = 0; i < n_steps; i++) {
+		long dB;
+		int err;
+
+		err = ops->ask_vol_dB(elem, range->min + i, &dB);
+		if (err < 0) {
+			ALSA_CARD_ERR(hctl, err, "Can't convert volume %ld to dB",
+			              range->min + i);
+			g_free(range->lut);
+			range->lut = NULL;
+			return;
+		}
+
+		range->lut[i] = dB_to_normalized(dB, range->dB_min, range->dB_max,
+		                                  range->dB_linear);
 	}
 
-	value = lrint_dir(volume * (max - min), dir) + min;
+	range->lut_size = n_steps;
+}
 
-	err = snd_mixer_selem_set_playback_volume_all(elem, value);
-	if (err < 0) {
-		ALSA_CARD_ERR(hctl, err, "Can't set playback volume to %ld", value);
-		return FALSE;
+/* Look for the raw volume step matching a normalized volume in the lookup
+ * table. The table is sorted, so it's a binary search. The direction gives
+ * the rounding: -1 for the step below, +1 for the step above, and 0 for
+ * the nearest step.
+ */
+static long
+elem_range_lut_lookup(const ElemRange *range, double volume, int dir)
+{
+	const double *lut = range->lut;
+	guint lo, hi, idx;
+
+	/* Find the first step whose normalized volume is >= volume */
+	lo = 0;
+	hi = range->lut_size;
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+
+		if (lut[mid] < volume)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 
-	return TRUE;
+	if (lo == range->lut_size)
+		idx = lo - 1;
+	else if (lut[lo] == volume || lo == 0 || dir > 0)
+		idx = lo;
+	else if (dir < 0)
+		idx = lo - 1;
+	else
+		idx = volume - lut[lo - 1] < lut[lo] - volume ? lo - 1 : lo;
+
+	return range->min + idx;
+}
+
+/* Query the volume ranges of a mixer element and fill the range struct */
+static void
+elem_range_fill(const char *hctl, const ElemOps *ops, snd_mixer_elem_t *elem,
+                ElemRange *range)
+{
+	int err;
+
+	elem_range_clear(range);
+	range->valid = TRUE;
+
+	err = ops->get_volume_range(elem, &range->min, &range->max);
+	if (err < 0)
+		ALSA_CARD_ERR(hctl, err, "Can't get %s volume range", ops->name);
+	else if (range->min >= range->max)
+		ALSA_CARD_WARN(hctl, "Invalid %s volume range [%ld - %ld]",
+		               ops->name, range->min, range->max);
+	else
+		range->vol_ok = TRUE;
+
+	err = ops->get_dB_range(elem, &range->dB_min, &range->dB_max);
+	if (err < 0)
+		ALSA_CARD_ERR(hctl, err, "Can't get %s dB range", ops->name);
+	else if (range->dB_min >= range->dB_max)
+		ALSA_CARD_WARN(hctl, "Invalid %s dB range [%ld - %ld]",
+		               ops->name, range->dB_min, range->dB_max);
+	else
+		range->dB_ok = TRUE;
+
+	if (range->dB_ok)
+		range->dB_linear = use_linear_dB_scale(range->dB_min, range->dB_max);
+
+	elem_range_build_lut(hctl, ops, elem, range);
+
+	ALSA_CARD_DEBUG(hctl, "%s volume range [%ld - %ld] (%s), "
+	                "dB range [%ld - %ld] (%s, %s), lookup table: %u steps",
+	                ops->name, range->min, range->max, range->vol_ok ? "ok" : "invalid",
+	                range->dB_min, range->dB_max, range->dB_ok ? "ok" : "invalid",
+	                range->dB_linear ? "linear" : "logarithmic", range->lut_size);
 }
 
-/* Get normalized volume, return a value between 0 and 1 */
+/* Convert a raw volume to a volume between 0 and 1.
+ * If normalize is set, the volume is normalized according to the dB range,
+ * unless the dB range is not usable, in which case we fall back to the
+ * raw range. This doesn't involve any read from the hardware.
+ */
 static gboolean
-elem_get_volume_normalized(const char *hctl, snd_mixer_elem_t *elem, double *volume)
+elem_raw_to_volume(const char *hctl, const ElemOps *ops, snd_mixer_elem_t *elem,
+                   const ElemRange *range, gboolean normalize, long value, double *volume)
 {
-	snd_mixer_selem_channel_id_t channel = SND_MIXER_SCHN_FRONT_RIGHT;
 	int err;
-	long min, max, value;
-	double normalized, min_norm;
+	long dB;
 
 	*volume = 0;
 
-	err = snd_mixer_selem_get_playback_dB_range(elem, &min, &max);
-	if (err < 0) {
-		ALSA_CARD_ERR(hctl, err, "Can't get playback dB range");
+	if (!range->vol_ok)
 		return FALSE;
-	}
 
-	if (min >= max) {
-		ALSA_CARD_WARN(hctl, "Invalid playback dB range [%ld - %ld]", min, max);
-		return FALSE;
+	value = CLAMP(value, range->min, range->max);
+
+	if (normalize && range->dB_ok) {
+		/* Fast path, the normalized volume is in the lookup table */
+		if (range->lut) {
+			*volume = range->lut[value - range->min];
+			return TRUE;
+		}
+
+		err = ops->ask_vol_dB(elem, value, &dB);
+		if (err == 0) {
+			*volume = dB_to_normalized(dB, range->dB_min, range->dB_max,
+			                           range->dB_linear);
+			return TRUE;
+		}
+
+		ALSA_CARD_ERR(hctl, err, "Can't convert volume %ld to dB", value);
 	}
 
-	err = snd_mixer_selem_get_playback_dB(elem, channel, &value);
-	if (err < 0) {
-		ALSA_CARD_ERR(hctl, err, "Can't get playback dB");
+	*volume = (value - range->min) / (double) (range->max - range->min);
+
+	return TRUE;
+}
+
+/* Convert a volume between 0 and 1 to a raw volume, rounded according to
+ * the direction (-1: lowering, +1: raising, 0: setting).
+ * See elem_raw_to_volume() for details, it's the same logic the other way.
+ */
+static gboolean
+elem_volume_to_raw(const char *hctl, const ElemOps *ops, snd_mixer_elem_t *elem,
+                   const ElemRange *range, gboolean normalize, double volume, int dir, long *value)
+{
+	int err;
+	long dB;
+
+	if (!range->vol_ok)
 		return FALSE;
+
+	volume = CLAMP(volume, 0, 1);
+
+	if (normalize && range->dB_ok) {
+		/* Fast path, look for the raw volume step in the lookup table */
+		if (range->lut) {
+			*value = elem_range_lut_lookup(range, volume, dir);
+			return TRUE;
+		}
+
+		/* Otherwise, ask Alsa to convert the dB value for us. That's what
+		 * snd_mixer_selem_set_playback_dB() would do anyway, but this way
+		 * we know exactly which raw volume we set.
+		 */
+		dB = normalized_to_dB(volume, range->dB_min, range->dB_max,
+		                      range->dB_linear, dir);
+
+		err = ops->ask_dB_vol(elem, dB, dir, value);
+		if (err == 0)
+			return TRUE;
+
+		ALSA_CARD_ERR(hctl, err, "Can't convert %ld dB to volume", dB);
 	}
 
-	if (use_linear_dB_scale(min, max)) {
-		normalized = (value - min) / (double) (max - min);
+	*value = lrint_dir(volume * (range->max - range->min), dir) + range->min;
+	*value = CLAMP(*value, range->min, range->max);
+
+	return TRUE;
+}
+
+/*
+ * Channels of a mixer element.
+ * They're detected once, when we start using the element. Mono elements,
+ * or elements whose channels share the same volume, are handled as one
+ * channel.
+ */
+
+#define ELEM_MAX_CHANNELS BACKEND_MAX_CHANNELS
+
+struct elem_channels {
+	guint n;
+	snd_mixer_selem_channel_id_t ids[ELEM_MAX_CHANNELS];
+	gboolean mono;
+	gboolean joined;
+};
+
+typedef struct elem_channels ElemChannels;
+
+/* Detect the channels of a mixer element */
+static void
+elem_channels_fill(const char *hctl, const ElemOps *ops, snd_mixer_elem_t *elem,
+                   ElemChannels *chans)
+{
+	snd_mixer_selem_channel_id_t id;
+
+	memset(chans, 0, sizeof *chans);
+
+	chans->mono = ops->is_mono(elem) ? TRUE : FALSE;
+	chans->joined = ops->has_volume_joined(elem) ? TRUE : FALSE;
+
+	if (chans->mono || chans->joined) {
+		chans->ids[chans->n++] = SND_MIXER_SCHN_MONO;
 	} else {
-		normalized = exp10((value - max) / 6000.0);
-		if (min != SND_CTL_TLV_DB_GAIN_MUTE) {
-			min_norm = exp10((min - max) / 6000.0);
-			normalized = (normalized - min_norm) / (1 - min_norm);
+		for (id = 0; id < ELEM_MAX_CHANNELS; id++) {
+			if (ops->has_channel(elem, id))
+				chans->ids[chans->n++] = id;
 		}
 	}
 
-	*volume = normalized;
+	/* Should never happen, but let's be safe */
+	if (chans->n == 0)
+		chans->ids[chans->n++] = SND_MIXER_SCHN_MONO;
 
-	// ALSA_CARD_DEBUG(hctl, "Getting normalized volume: %lf", *volume);
+	ALSA_CARD_DEBUG(hctl, "Mixer elem has %u channel(s)%s%s", chans->n,
+	                chans->mono ? ", mono" : "", chans->joined ? ", joined" : "");
+}
 
-	return TRUE;
+/* Whether a channel is on the left or right side. Return -1 for left,
+ * +1 for right, 0 for the channels in the middle. Beware that the mono
+ * channel id is the same as front left, hence the special case.
+ */
+static int
+elem_channel_side(const ElemChannels *chans, guint index)
+{
+	if (chans->mono || chans->joined)
+		return 0;
+
+	switch (chans->ids[index]) {
+	case SND_MIXER_SCHN_FRONT_LEFT:
+	case SND_MIXER_SCHN_REAR_LEFT:
+	case SND_MIXER_SCHN_SIDE_LEFT:
+		return -1;
+	case SND_MIXER_SCHN_FRONT_RIGHT:
+	case SND_MIXER_SCHN_REAR_RIGHT:
+	case SND_MIXER_SCHN_SIDE_RIGHT:
+		return +1;
+	default:
+		return 0;
+	}
 }
 
-/* Set normalized volume, input value between 0 and 1 */
+/* Get the volume of a channel, so that the loudest side gets
+ * the given volume and the other side is scaled by the balance.
+ */
+static double
+elem_channel_balanced(const ElemChannels *chans, guint index,
+                      double volume, double balance)
+{
+	int side = elem_channel_side(chans, index);
+
+	if (side < 0)
+		return volume * (1 - MAX(balance, 0));
+	else if (side > 0)
+		return volume * (1 + MIN(balance, 0));
+	else
+		return volume;
+}
+
+/* Get the raw volume of every channel, in one batch */
 static gboolean
-elem_set_volume_normalized(const char *hctl, snd_mixer_elem_t *elem, double volume, int dir)
+elem_get_raw_volumes(const char *hctl, const ElemOps *ops, snd_mixer_elem_t *elem,
+                     const ElemChannels *chans, long *values)
 {
+	guint i;
 	int err;
-	long min, max, value;
 
-	err = snd_mixer_selem_get_playback_dB_range(elem, &min, &max);
-	if (err < 0) {
-		ALSA_CARD_ERR(hctl, err, "Can't get playback dB range");
-		return FALSE;
+	for (i = 0; i < chans->n; i++) {
+		err = ops->get_volume(elem, chans->ids[i], &values[i]);
+		if (err < 0) {
+			ALSA_CARD_ERR(hctl, err, "Can't get %s volume", ops->name);
+			return FALSE;
+		}
 	}
 
-	if (min >= max) {
-		ALSA_CARD_WARN(hctl, "Invalid playback dB range [%ld - %ld]", min, max);
-		return FALSE;
-	}
+	return TRUE;
+}
 
-	if (use_linear_dB_scale(min, max)) {
-		value = lrint_dir(volume * (max - min), dir) + min;
-	} else {
-		if (min != SND_CTL_TLV_DB_GAIN_MUTE) {
-			double min_norm = exp10((min - max) / 6000.0);
-			volume = volume * (1 - min_norm) + min_norm;
+/* Set the raw volume of every channel, in one batch.
+ * If all the channels have the same value, that's only one call.
+ */
+static gboolean
+elem_set_raw_volumes(const char *hctl, const ElemOps *ops, snd_mixer_elem_t *elem,
+                     const ElemChannels *chans, const long *values)
+{
+	gboolean same = TRUE;
+	guint i;
+	int err;
+
+	for (i = 1; i < chans->n; i++) {
+		if (values[i] != values[0]) {
+			same = FALSE;
+			break;
 		}
-		value = lrint_dir(6000.0 * log10(volume), dir) + max;
 	}
 
-	err = snd_mixer_selem_set_playback_dB_all(elem, value, dir);
-	if (err < 0) {
-		ALSA_CARD_ERR(hctl, err, "Can't set playback dB to %ld", value);
-		return FALSE;
+	if (same) {
+		err = ops->set_volume_all(elem, values[0]);
+		if (err < 0) {
+			ALSA_CARD_ERR(hctl, err, "Can't set %s volume to %ld",
+			              ops->name, values[0]);
+			return FALSE;
+		}
+		return TRUE;
 	}
 
-	// ALSA_CARD_DEBUG(hctl, "Normalized volume set: %lf (%d)", volume, dir);
+	for (i = 0; i < chans->n; i++) {
+		err = ops->set_volume(elem, chans->ids[i], values[i]);
+		if (err < 0) {
+			ALSA_CARD_ERR(hctl, err, "Can't set %s volume to %ld",
+			              ops->name, values[i]);
+			return FALSE;
+		}
+	}
 
 	return TRUE;
 }
 
 /* Whether the card can be muted */
 static gboolean
-elem_has_mute(G_GNUC_UNUSED const char *hctl, snd_mixer_elem_t *elem)
+elem_has_mute(G_GNUC_UNUSED const char *hctl, const ElemOps *ops, snd_mixer_elem_t *elem)
 {
-	return snd_mixer_selem_has_playback_switch(elem) ? TRUE : FALSE;
+	return ops->has_switch(elem) ? TRUE : FALSE;
 }
 
 /* Get the mute state, either TRUE or FALSE */
 static gboolean
-elem_get_mute(const char *hctl, snd_mixer_elem_t *elem, gboolean *muted)
+elem_get_mute(const char *hctl, const ElemOps *ops, snd_mixer_elem_t *elem,
+              const ElemChannels *chans, gboolean *muted)
 {
-	snd_mixer_selem_channel_id_t channel = SND_MIXER_SCHN_FRONT_RIGHT;
+	snd_mixer_selem_channel_id_t channel = chans->ids[0];
 	int err;
 	int value;
 
 	*muted = FALSE;
 
-	if (snd_mixer_selem_has_playback_switch(elem)) {
-		err = snd_mixer_selem_get_playback_switch(elem, channel, &value);
+	if (ops->has_switch(elem)) {
+		err = ops->get_switch(elem, channel, &value);
 		if (err < 0) {
-			ALSA_CARD_ERR(hctl, err, "Can't get playback switch");
+			ALSA_CARD_ERR(hctl, err, "Can't get %s switch", ops->name);
 			return FALSE;
 		}
 	} else {
-		/* If there's no playback switch, assume not muted */
+		/* If there's no switch, assume not muted */
 		value = 1;
 	}
 
@@ -292,7 +652,8 @@ elem_get_mute(const char *hctl, snd_mixer_elem_t *elem, gboolean *muted)
 
 /* Set the mute state, TRUE or FALSE */
 static gboolean
-elem_set_mute(const char *hctl, snd_mixer_elem_t *elem, gboolean mute)
+elem_set_mute(const char *hctl, const ElemOps *ops, snd_mixer_elem_t *elem,
+              gboolean mute)
 {
 	int err;
 	int value;
@@ -300,14 +661,14 @@ elem_set_mute(const char *hctl, snd_mixer_elem_t *elem, gboolean mute)
 	/* Value to set: 0 = muted, 1 = not muted */
 	value = mute ? 0 : 1;
 
-	if (snd_mixer_selem_has_playback_switch(elem)) {
-		err = snd_mixer_selem_set_playback_switch_all(elem, value);
+	if (ops->has_switch(elem)) {
+		err = ops->set_switch_all(elem, value);
 		if (err < 0) {
-			ALSA_CARD_ERR(hctl, err, "Can't set playback switch");
+			ALSA_CARD_ERR(hctl, err, "Can't set %s switch", ops->name);
 			return FALSE;
 		}
 	} else {
-		/* If there's no playback switch, do nothing */
+		/* If there's no switch, do nothing */
 	}
 
 	// ALSA_CARD_DEBUG(hctl, "Mute set: %d", mute);
@@ -346,43 +707,43 @@ mixer_get_poll_descriptors(const char *hctl, snd_mixer_t *mixer)
 	return fds;
 }
 
-/* Get the list of playable channels */
+/* Get the list of channels with a volume, playback or capture */
 static GSList *
-mixer_list_playable(G_GNUC_UNUSED const char *hctl, snd_mixer_t *mixer)
+mixer_list_elems(G_GNUC_UNUSED const char *hctl, const ElemOps *ops, snd_mixer_t *mixer)
 {
 	GSList *list = NULL;
 	snd_mixer_elem_t *elem = NULL;
 
 	elem = snd_mixer_first_elem(mixer);
 	while (elem) {
-		if (snd_mixer_selem_has_playback_volume(elem)) {
+		if (ops->has_volume(elem)) {
 			const char *chan_name = snd_mixer_selem_get_name(elem);
-			list = g_slist_append(list, g_strdup(chan_name));
+			list = g_slist_prepend(list, g_strdup(chan_name));
 		}
 		elem = snd_mixer_elem_next(elem);
 	}
 
-	return list;
+	return g_slist_reverse(list);
 }
 
 /* Return TRUE if the mixer has at least one playable channel, FALSE otherwise */
 static gboolean
-mixer_is_playable(const char *hctl, snd_mixer_t *mixer)
+mixer_is_playable(G_GNUC_UNUSED const char *hctl, snd_mixer_t *mixer)
 {
-	GSList *playable_chans;
+	snd_mixer_elem_t *elem;
 
-	playable_chans = mixer_list_playable(hctl, mixer);
-	if (playable_chans) {
-		g_slist_free_full(playable_chans, g_free);
-		return TRUE;
+	for (elem = snd_mixer_first_elem(mixer); elem; elem = snd_mixer_elem_next(elem)) {
+		if (snd_mixer_selem_has_playback_volume(elem))
+			return TRUE;
 	}
 
 	return FALSE;
 }
 
-/* Get a playable mixer element by name */
+/* Get a mixer element with a volume, playback or capture, by name */
 static snd_mixer_elem_t *
-mixer_get_playable_elem(const char *hctl, snd_mixer_t *mixer, const char *channel)
+mixer_get_elem(const char *hctl, const ElemOps *ops, snd_mixer_t *mixer,
+               const char *channel)
 {
 	snd_mixer_elem_t *elem;
 	snd_mixer_selem_id_t *sid;
@@ -390,7 +751,7 @@ mixer_get_playable_elem(const char *hctl, snd_mixer_t *mixer, const char *channe
 	if (!channel)
 		return NULL;
 
-	ALSA_CARD_DEBUG(hctl, "Looking for playable mixer element '%s'", channel);
+	ALSA_CARD_DEBUG(hctl, "Looking for %s mixer element '%s'", ops->name, channel);
 
 	/* Find the mixer element */
 	snd_mixer_selem_id_alloca(&sid);
@@ -401,33 +762,34 @@ mixer_get_playable_elem(const char *hctl, snd_mixer_t *mixer, const char *channe
 		return NULL;
 	}
 
-	/* Check that it's playable */
-	if (!snd_mixer_selem_has_playback_volume(elem)) {
-		ALSA_CARD_WARN(hctl, "Mixer element '%s' is not playable", channel);
+	/* Check that it has a volume */
+	if (!ops->has_volume(elem)) {
+		ALSA_CARD_WARN(hctl, "Mixer element '%s' has no %s volume",
+		               channel, ops->name);
 		return NULL;
 	}
 
 	return elem;
 }
 
-/* Get the first playable mixer element */
+/* Get the first mixer element with a volume, playback or capture */
 static snd_mixer_elem_t *
-mixer_get_first_playable_elem(const char *hctl, snd_mixer_t *mixer)
+mixer_get_first_elem(const char *hctl, const ElemOps *ops, snd_mixer_t *mixer)
 {
 	snd_mixer_elem_t *elem;
 
-	ALSA_CARD_DEBUG(hctl, "Looking for the first playable mixer element...");
+	ALSA_CARD_DEBUG(hctl, "Looking for the first %s mixer element...", ops->name);
 
-	/* Iterate on mixer elements, get the first playable */
+	/* Iterate on mixer elements, get the first usable */
 	elem = snd_mixer_first_elem(mixer);
 	while (elem) {
-		if (snd_mixer_selem_has_playback_volume(elem))
+		if (ops->has_volume(elem))
 			break;
 		elem = snd_mixer_elem_next(elem);
 	}
 
 	if (elem == NULL) {
-		ALSA_CARD_DEBUG(hctl, "No playable mixer element found");
+		ALSA_CARD_DEBUG(hctl, "No %s mixer element found", ops->name);
 		return NULL;
 	}
 
@@ -493,6 +855,99 @@ failure:
 	return NULL;
 }
 
+/*
+ * Alsa control handling (deals with 'snd_ctl_t').
+ * Loading the simple mixer of a card means reading every element of the
+ * card, and building the simple elements on top of them. That's overkill
+ * when we just want to know if a card is playable, so we have a quicker
+ * way that walks the list of control elements, without even reading them.
+ */
+
+/* Whether a control element name looks like a playback volume.
+ * The simple mixer maps both 'Foo Playback Volume' and 'Foo Volume'
+ * to a playback volume.
+ */
+static gboolean
+ctl_name_is_playback_volume(const char *name)
+{
+	if (g_str_has_suffix(name, " Playback Volume"))
+		return TRUE;
+
+	if (g_str_has_suffix(name, " Volume") &&
+	    !g_str_has_suffix(name, " Capture Volume"))
+		return TRUE;
+
+	return FALSE;
+}
+
+/* Probe a card for playback volume controls, using the control interface.
+ * Return 1 if the card is playable, 0 if it's not, and -1 if the probe
+ * failed and we can't tell.
+ */
+static int
+ctl_probe_playable(const char *hctl)
+{
+	snd_ctl_t *ctl;
+	snd_ctl_elem_list_t *list;
+	snd_ctl_elem_id_t *id;
+	snd_ctl_elem_info_t *info;
+	unsigned int i, count;
+	int err, ret = -1;
+
+	err = snd_ctl_open(&ctl, hctl, 0);
+	if (err < 0) {
+		ALSA_CARD_ERR(hctl, err, "Can't open control");
+		return -1;
+	}
+
+	snd_ctl_elem_list_alloca(&list);
+	snd_ctl_elem_id_alloca(&id);
+	snd_ctl_elem_info_alloca(&info);
+
+	/* Get the number of elements, then the elements themselves */
+	err = snd_ctl_elem_list(ctl, list);
+	if (err < 0)
+		goto exit;
+
+	count = snd_ctl_elem_list_get_count(list);
+	err = snd_ctl_elem_list_alloc_space(list, count);
+	if (err < 0)
+		goto exit;
+
+	err = snd_ctl_elem_list(ctl, list);
+	if (err < 0)
+		goto free_space;
+
+	/* Stop at the first playback volume */
+	ret = 0;
+	count = snd_ctl_elem_list_get_used(list);
+	for (i = 0; i < count; i++) {
+		if (snd_ctl_elem_list_get_interface(list, i) != SND_CTL_ELEM_IFACE_MIXER)
+			continue;
+
+		if (!ctl_name_is_playback_volume(snd_ctl_elem_list_get_name(list, i)))
+			continue;
+
+		snd_ctl_elem_list_get_id(list, i, id);
+		snd_ctl_elem_info_set_id(info, id);
+		if (snd_ctl_elem_info(ctl, info) < 0)
+			continue;
+
+		if (snd_ctl_elem_info_get_type(info) == SND_CTL_ELEM_TYPE_INTEGER) {
+			ret = 1;
+			break;
+		}
+	}
+
+free_space:
+	snd_ctl_elem_list_free_space(list);
+exit:
+	if (err < 0)
+		ALSA_CARD_ERR(hctl, err, "Can't list control elements");
+	snd_ctl_close(ctl);
+	return ret;
+}
+
 /*
  * Alsa card iterator.
  * The Alsa API is really awkward when it comes to deal with cards
@@ -584,145 +1039,938 @@ alsa_card_iter_loop(AlsaCardIter *iter)
 }
 
 /*
- * Alsa poll descriptors handling with GIO.
+ * Alsa mixer event source.
+ * A GSource that polls the descriptors of a mixer. When it wakes up, Alsa
+ * tells what happened through snd_mixer_poll_descriptors_revents(), and
+ * the callback is invoked once, whatever the number of pending events.
+ * It's up to the callback to handle them all with snd_mixer_handle_events().
  */
 
-/* Start watching the poll descriptors provided in the input array */
-static guint *
-watch_poll_descriptors(const char *hctl, struct pollfd *pollfds,
-                       GIOFunc func, gpointer data)
+typedef gboolean (*MixerSourceFunc) (unsigned short revents, gpointer data);
+
+struct mixer_source {
+	GSource source; /* Must come first */
+	snd_mixer_t *mixer;
+	struct pollfd *pollfds; /* As given by Alsa */
+	GPollFD *fds; /* As polled by GLib */
+	guint nfds;
+};
+
+typedef struct mixer_source MixerSource;
+
+static gboolean
+mixer_source_prepare(G_GNUC_UNUSED GSource *source, gint *timeout)
 {
-	int nfds, i;
-	guint *watch_ids;
+	*timeout = -1;
 
-	/* Count the number of poll file descriptors */
-	nfds = i = 0;
-	while (pollfds[i++].fd != -1)
-		nfds++;
+	return FALSE;
+}
 
-	/* Allocate a zero-termintated array to hold the watch ids */
-	watch_ids = g_new0(guint, nfds + 1);
+static gboolean
+mixer_source_check(GSource *source)
+{
+	MixerSource *ms = (MixerSource *) source;
+	guint i;
 
-	/* Watch every poll fd */
-	for (i = 0; i < nfds; i++) {
-		GIOChannel *gioc;
+	for (i = 0; i < ms->nfds; i++) {
+		if (ms->fds[i].revents)
+			return TRUE;
+	}
 
-		gioc = g_io_channel_unix_new(pollfds[i].fd);
-		watch_ids[i] = g_io_add_watch(gioc, G_IO_IN | G_IO_ERR, func, data);
-		g_io_channel_unref(gioc);
+	return FALSE;
+}
+
+static gboolean
+mixer_source_dispatch(GSource *source, GSourceFunc callback, gpointer data)
+{
+	MixerSource *ms = (MixerSource *) source;
+	MixerSourceFunc func = (MixerSourceFunc) (void (*)(void)) callback;
+	unsigned short revents;
+	guint i;
+	int err;
+
+	for (i = 0; i < ms->nfds; i++) {
+		ms->pollfds[i].revents = ms->fds[i].revents;
+		ms->fds[i].revents = 0;
 	}
 
-	ALSA_CARD_DEBUG(hctl, "%d poll descriptors are now watched", nfds);
+	/* Let Alsa make sense of what the descriptors say */
+	err = snd_mixer_poll_descriptors_revents(ms->mixer, ms->pollfds,
+	                                         ms->nfds, &revents);
+	if (err < 0)
+		revents = POLLERR;
+
+	if (func == NULL)
+		return G_SOURCE_REMOVE;
 
-	return watch_ids;
+	return func(revents, data);
 }
 
-/* Stop watching poll descriptors */
 static void
-unwatch_poll_descriptors(guint *watch_ids)
+mixer_source_finalize(GSource *source)
 {
-	int i;
+	MixerSource *ms = (MixerSource *) source;
 
-	for (i = 0; watch_ids[i] != 0; i++) {
-		g_source_remove(watch_ids[i]);
-		watch_ids[i] = 0;
-	}
+	g_free(ms->fds);
+	g_free(ms->pollfds);
 }
 
-/*
- * Public functions & signal handling
- */
+static GSourceFuncs mixer_source_funcs = {
+	mixer_source_prepare,
+	mixer_source_check,
+	mixer_source_dispatch,
+	mixer_source_finalize,
+	NULL,
+	NULL
+};
 
-struct alsa_card {
-	gboolean normalize; /* Whether we work with normalized volume */
+/* Create a source that watches the poll descriptors of a mixer */
+static GSource *
+mixer_source_new(const char *hctl, snd_mixer_t *mixer)
+{
+	struct pollfd *pollfds;
+	MixerSource *ms;
+	guint nfds, i;
+
+	pollfds = mixer_get_poll_descriptors(hctl, mixer);
+	if (pollfds == NULL)
+		return NULL;
+
+	nfds = 0;
+	while (pollfds[nfds].fd != -1)
+		nfds++;
+
+	ms = (MixerSource *) g_source_new(&mixer_source_funcs, sizeof(MixerSource));
+	ms->mixer = mixer;
+	ms->pollfds = pollfds;
+	ms->nfds = nfds;
+	ms->fds = g_new0(GPollFD, nfds);
+
+	for (i = 0; i < nfds; i++) {
+		ms->fds[i].fd = pollfds[i].fd;
+		ms->fds[i].events = pollfds[i].events;
+		g_source_add_poll(&ms->source, &ms->fds[i]);
+	}
+
+	ALSA_CARD_DEBUG(hctl, "%u poll descriptors are now watched", nfds);
+
+	return &ms->source;
+}
+
+/*
+ * Alsa card registry.
+ * Finding out which cards are playable means opening and loading the
+ * mixer of every card, which is slow. So we do it once, keep the result
+ * in memory, and watch the Alsa device directory with inotify. When a
+ * card appears or disappears, only this card is probed again.
+ * If inotify is not available, the registry is rebuilt each time.
+ */
+
+struct alsa_registry_entry {
+	int number; /* Card number, -1 for the default card */
+	char *name;
+	char *hctl;
+	gboolean playable;
+};
+
+typedef struct alsa_registry_entry AlsaRegistryEntry;
+
+struct alsa_registry {
+	gboolean loaded;
+	GSList *entries; /* Sorted by card number */
+	int inotify_fd;
+	guint watch_id;
+	/* User callback, to notify when the list of cards changes */
+	BackendCardsCb cb_func;
+	gpointer cb_data;
+};
+
+static struct alsa_registry registry = { FALSE, NULL, -1, 0, NULL, NULL };
+
+/* Free a registry entry */
+static void
+alsa_registry_entry_free(AlsaRegistryEntry *entry)
+{
+	if (entry == NULL)
+		return;
+
+	g_free(entry->name);
+	g_free(entry->hctl);
+	g_free(entry);
+}
+
+/* Create a registry entry, and probe the card to know if it's playable */
+static AlsaRegistryEntry *
+alsa_registry_entry_new(int number, const char *name, const char *hctl)
+{
+	AlsaRegistryEntry *entry;
+	int playable;
+
+	entry = g_new0(AlsaRegistryEntry, 1);
+	entry->number = number;
+	entry->name = g_strdup(name);
+	entry->hctl = g_strdup(hctl);
+
+	/* Try the quick way first, and load the whole mixer only if needed */
+	playable = ctl_probe_playable(hctl);
+	if (playable < 0) {
+		snd_mixer_t *mixer;
+
+		mixer = mixer_open(hctl);
+		if (mixer) {
+			playable = mixer_is_playable(hctl, mixer);
+			mixer_close(hctl, mixer);
+		}
+	}
+
+	entry->playable = playable > 0 ? TRUE : FALSE;
+
+	ALSA_CARD_DEBUG(hctl, "Registry: card '%s' is %s", name,
+	                entry->playable ? "playable" : "not playable");
+
+	return entry;
+}
+
+/* Compare registry entries by card number */
+static gint
+alsa_registry_entry_cmp(const AlsaRegistryEntry *e1, const AlsaRegistryEntry *e2)
+{
+	return e1->number - e2->number;
+}
+
+/* Remove the entry of a card from the registry. Return TRUE if there was one. */
+static gboolean
+alsa_registry_remove(int number)
+{
+	GSList *item;
+
+	for (item = registry.entries; item; item = item->next) {
+		AlsaRegistryEntry *entry = item->data;
+
+		if (entry->number != number)
+			continue;
+
+		registry.entries = g_slist_delete_link(registry.entries, item);
+		alsa_registry_entry_free(entry);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* (Re)probe a card and update the registry accordingly */
+static void
+alsa_registry_probe(int number)
+{
+	AlsaRegistryEntry *entry;
+	char *name = NULL;
+	char *hctl;
+	int err;
+
+	alsa_registry_remove(number);
+
+	if (number < 0) {
+		entry = alsa_registry_entry_new(-1, ALSA_DEFAULT_CARD, ALSA_DEFAULT_HCTL);
+		goto insert;
+	}
+
+	err = snd_card_get_name(number, &name);
+	if (err < 0) {
+		/* The card is gone, or not accessible yet */
+		DEBUG("Registry: can't get name of card %d: %s", number, snd_strerror(err));
+		return;
+	}
+
+	hctl = g_strdup_printf("hw:%d", number);
+	entry = alsa_registry_entry_new(number, name, hctl);
+	g_free(hctl);
+	free(name);
+
+insert:
+	registry.entries = g_slist_insert_sorted(registry.entries, entry,
+	                   (GCompareFunc) alsa_registry_entry_cmp);
+}
+
+/* Parse a device file name, and return the card number if it's a control
+ * device (like 'controlC0'), or -1 otherwise.
+ */
+static int
+alsa_registry_parse_device(const char *filename)
+{
+	const char *prefix = "controlC";
+	gchar *end;
+	gint64 number;
+
+	if (!g_str_has_prefix(filename, prefix))
+		return -1;
+
+	number = g_ascii_strtoll(filename + strlen(prefix), &end, 10);
+	if (end == filename + strlen(prefix) || *end != '\0')
+		return -1;
+
+	if (number < 0 || number > G_MAXINT)
+		return -1;
+
+	return number;
+}
+
+/* Callback invoked when something happens in the Alsa device directory */
+static gboolean
+alsa_registry_watch_cb(G_GNUC_UNUSED GIOChannel *source,
+                       G_GNUC_UNUSED GIOCondition condition,
+                       G_GNUC_UNUSED gpointer data)
+{
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	gboolean changed = FALSE;
+	ssize_t len;
+	char *ptr;
+
+	len = read(registry.inotify_fd, buf, sizeof buf);
+	if (len < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return TRUE;
+
+		ERROR("Can't read inotify events: %s", g_strerror(errno));
+		registry.watch_id = 0;
+		registry.loaded = FALSE;
+		close(registry.inotify_fd);
+		registry.inotify_fd = -1;
+		return FALSE;
+	}
+
+	for (ptr = buf; ptr < buf + len;
+	     ptr += sizeof(struct inotify_event) + ((struct inotify_event *) ptr)->len) {
+		const struct inotify_event *event = (const struct inotify_event *) ptr;
+		int number;
+
+		if (event->len == 0)
+			continue;
+
+		number = alsa_registry_parse_device(event->name);
+		if (number < 0)
+			continue;
+
+		if (event->mask & IN_DELETE) {
+			DEBUG("Registry: card %d removed", number);
+			alsa_registry_remove(number);
+		} else {
+			/* Either created, or permissions changed (udev usually
+			 * sets them right after the device is created).
+			 */
+			DEBUG("Registry: card %d added or changed", number);
+			alsa_registry_probe(number);
+		}
+
+		changed = TRUE;
+	}
+
+	if (changed == FALSE)
+		return TRUE;
+
+	/* The default card may be affected by any change */
+	alsa_registry_probe(-1);
+
+	if (registry.cb_func)
+		registry.cb_func(registry.cb_data);
+
+	return TRUE;
+}
+
+/* Start watching the Alsa device directory. Return TRUE on success. */
+static gboolean
+alsa_registry_watch(void)
+{
+	GIOChannel *gioc;
+	int fd, wd;
+
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0) {
+		WARN("Can't initialize inotify: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	wd = inotify_add_watch(fd, ALSA_DEVICE_DIR, IN_CREATE | IN_DELETE | IN_ATTRIB);
+	if (wd < 0) {
+		WARN("Can't watch '%s': %s", ALSA_DEVICE_DIR, g_strerror(errno));
+		close(fd);
+		return FALSE;
+	}
+
+	gioc = g_io_channel_unix_new(fd);
+	registry.watch_id = backend_attach_source(g_io_create_watch(gioc, G_IO_IN | G_IO_ERR),
+	                                          (GSourceFunc) (void (*)(void)) alsa_registry_watch_cb,
+	                                          NULL);
+	g_io_channel_unref(gioc);
+	registry.inotify_fd = fd;
+
+	DEBUG("Registry: watching '%s' for hotplug events", ALSA_DEVICE_DIR);
+
+	return TRUE;
+}
+
+/* Make sure the registry is loaded and up to date */
+static void
+alsa_registry_ensure(void)
+{
+	AlsaCardIter *iter;
+
+	/* If we're notified of hotplug events, the registry is up to date */
+	if (registry.loaded && registry.watch_id != 0)
+		return;
+
+	/* Otherwise, (re)build it from scratch.
+	 * Watch first, so that we don't miss any event.
+	 */
+	if (registry.watch_id == 0)
+		alsa_registry_watch();
+
+	g_slist_free_full(registry.entries, (GDestroyNotify) alsa_registry_entry_free);
+	registry.entries = NULL;
+
+	iter = alsa_card_iter_new();
+	while (alsa_card_iter_loop(iter)) {
+		AlsaRegistryEntry *entry;
+
+		entry = alsa_registry_entry_new(iter->number, iter->name, iter->hctl);
+		registry.entries = g_slist_append(registry.entries, entry);
+	}
+	alsa_card_iter_free(iter);
+
+	registry.loaded = TRUE;
+}
+
+/* Look for a card in the registry by name */
+static const AlsaRegistryEntry *
+alsa_registry_lookup(const char *card_name)
+{
+	GSList *item;
+
+	alsa_registry_ensure();
+
+	for (item = registry.entries; item; item = item->next) {
+		AlsaRegistryEntry *entry = item->data;
+
+		if (!g_strcmp0(entry->name, card_name))
+			return entry;
+	}
+
+	return NULL;
+}
+
+/*
+ * Public functions & signal handling
+ */
+
+/* A mixer elem that follows the main mixer elem of a card. Its volume
+ * is the volume of the main elem scaled by a weight, and it's muted
+ * along with it.
+ */
+struct linked_elem {
+	AlsaCard *card; /* Card this elem belongs to */
+	snd_mixer_elem_t *elem; /* NULL if the elem was removed */
+	char *name;
+	gdouble weight;
+	ElemRange range;
+	ElemChannels chans;
+	gboolean synced; /* Whether we wrote it already */
+	gboolean moved; /* Whether Alsa reported a value change since */
+};
+
+typedef struct linked_elem LinkedElem;
+
+struct alsa_card {
+	BackendCard parent; /* Must come first */
+	gboolean normalize; /* Whether we work with normalized volume */
+	const ElemOps *ops; /* Playback or capture functions */
 	/* Card names */
 	char *name; /* Real card name like 'HDA Intel PCH' */
 	char *hctl; /* HTCL device name, like 'hw:0' */
+	char *channel; /* Mixer elem name, like 'Master' */
 	/* Alsa data pointers */
 	snd_mixer_t *mixer; /* Alsa mixer */
 	snd_mixer_elem_t *mixer_elem; /* Alsa mixer elem */
-	/* Gio watch ids */
-	guint *watch_ids;
+	/* Cached volume ranges of the mixer elem */
+	ElemRange range;
+	/* Cached state of the mixer elem. It's refreshed when Alsa notifies
+	 * us of a change, and updated after our own changes. Therefore
+	 * getters never have to query Alsa.
+	 */
+	ElemChannels chans;
+	gboolean has_mute;
+	gboolean muted;
+	long raw[ELEM_MAX_CHANNELS]; /* Raw volume of each channel */
+	gdouble volumes[ELEM_MAX_CHANNELS]; /* Volume of each channel, 0 to 1 */
+	gdouble volume; /* Loudest channel, in percent */
+	gdouble balance; /* From -1 (left) to +1 (right) */
+	/* Mixer elems linked to the main one, list of LinkedElem */
+	GSList *linked;
+	/* Events reported by Alsa on the mixer elem, and not handled yet */
+	unsigned int elem_events;
+	/* Debug counters, to keep an eye on how often we talk to Alsa,
+	 * and how many events we get per wakeup.
+	 */
+	guint n_reads;
+	guint n_writes;
+	guint n_wakeups;
+	guint n_events;
+	/* Mixer event source id */
+	guint watch_id;
 	/* User callback, to notify when something happens */
-	AlsaCb cb_func;
+	BackendCb cb_func;
 	gpointer cb_data;
 };
 
+#define ALSA_CARD(card) ((AlsaCard *) (card))
+
+/* Get the volume ranges of the card mixer elem, querying Alsa
+ * only if they were invalidated since the last time. The channel
+ * layout is part of the elem info as well, so it's refreshed
+ * at the same time.
+ */
+static const ElemRange *
+card_get_range(AlsaCard *card)
+{
+	if (!card->range.valid) {
+		elem_range_fill(card->hctl, card->ops, card->mixer_elem, &card->range);
+		elem_channels_fill(card->hctl, card->ops, card->mixer_elem, &card->chans);
+	}
+
+	return &card->range;
+}
+
+/* Update the cached volumes from raw channel volumes. The balance is
+ * only computed from the channels if asked to, since rounding to raw
+ * volume steps would otherwise make it drift a little after each of
+ * our own changes. It's also left untouched when all channels are
+ * at zero, as there's no way to tell the balance in this case.
+ */
+static void
+card_update_volumes(AlsaCard *card, const long *raw, gboolean update_balance)
+{
+	const ElemRange *range = &card->range;
+	gdouble max = 0, left = 0, right = 0;
+	guint i;
+
+	for (i = 0; i < card->chans.n; i++) {
+		gdouble volume;
+		int side;
+
+		elem_raw_to_volume(card->hctl, card->ops, card->mixer_elem, range,
+		                   card->normalize, raw[i], &volume);
+
+		card->raw[i] = raw[i];
+		card->volumes[i] = volume;
+
+		side = elem_channel_side(&card->chans, i);
+		if (side < 0)
+			left = MAX(left, volume);
+		else if (side > 0)
+			right = MAX(right, volume);
+
+		max = MAX(max, volume);
+	}
+
+	card->volume = max * 100;
+
+	if (!update_balance || max <= 0)
+		return;
+
+	if (left == right)
+		card->balance = 0;
+	else if (left > right)
+		card->balance = -(1 - right / left);
+	else
+		card->balance = 1 - left / right;
+}
+
+/* Read the mixer elem state from Alsa, and save it in cache */
+static void
+card_refresh_state(AlsaCard *card)
+{
+	long raw[ELEM_MAX_CHANNELS];
+	gboolean same = TRUE;
+	guint i;
+
+	if (card->mixer_elem == NULL)
+		return;
+
+	card_get_range(card);
+	card->has_mute = elem_has_mute(card->hctl, card->ops, card->mixer_elem);
+
+	elem_get_mute(card->hctl, card->ops, card->mixer_elem, &card->chans, &card->muted);
+
+	/* Read all the channels at once */
+	if (elem_get_raw_volumes(card->hctl, card->ops, card->mixer_elem, &card->chans, raw)) {
+		for (i = 0; i < card->chans.n; i++) {
+			if (raw[i] != card->raw[i]) {
+				same = FALSE;
+				break;
+			}
+		}
+
+		/* Raw volumes didn't move, keep the balance we have */
+		card_update_volumes(card, raw, !same);
+	}
+
+	card->n_reads++;
+}
+
+/*
+ * Linked mixer elems.
+ * They just follow the main mixer elem. Changes are always applied to the
+ * main elem first, then to every linked elem in the same pass. Since they
+ * all belong to the same mixer, Alsa reports all the resulting events at
+ * once, and they end up in a single notification.
+ */
+
+/* Free a linked elem, detaching it from Alsa */
+static void
+linked_elem_free(LinkedElem *linked)
+{
+	if (linked == NULL)
+		return;
+
+	if (linked->elem) {
+		snd_mixer_elem_set_callback(linked->elem, NULL);
+		snd_mixer_elem_set_callback_private(linked->elem, NULL);
+	}
+
+	elem_range_clear(&linked->range);
+	g_free(linked->name);
+	g_free(linked);
+}
+
+/* Callback function for changes on a linked elem. Value changes are
+ * just recorded, card_restore_linked() looks at them once all pending
+ * events were handled. We also have to take care of the elem going
+ * away, or its ranges being changed.
+ */
+static int
+linked_elem_cb(snd_mixer_elem_t *elem, unsigned int mask)
+{
+	LinkedElem *linked = snd_mixer_elem_get_callback_private(elem);
+
+	if (linked == NULL)
+		return 0;
+
+	if (mask == SND_CTL_EVENT_MASK_REMOVE) {
+		ALSA_CARD_DEBUG(linked->card->hctl, "Linked mixer elem '%s' removed",
+		                linked->name);
+		linked->elem = NULL;
+		return 0;
+	}
+
+	if (mask & (SND_CTL_EVENT_MASK_INFO | SND_CTL_EVENT_MASK_TLV))
+		linked->range.valid = FALSE;
+
+	if (mask & SND_CTL_EVENT_MASK_VALUE)
+		linked->moved = TRUE;
+
+	return 0;
+}
+
+/* Get the volume ranges of a linked elem, see card_get_range() */
+static const ElemRange *
+linked_elem_get_range(LinkedElem *linked)
+{
+	if (!linked->range.valid) {
+		elem_range_fill(linked->card->hctl, linked->card->ops, linked->elem, &linked->range);
+		elem_channels_fill(linked->card->hctl, linked->card->ops, linked->elem, &linked->chans);
+	}
+
+	return &linked->range;
+}
+
+/* Compute the raw volumes of a linked elem from the state of the main
+ * elem. Return FALSE if a conversion failed.
+ */
+static gboolean
+linked_elem_volume_to_raw(LinkedElem *linked, int dir, long *raw)
+{
+	AlsaCard *card = linked->card;
+	const ElemRange *range;
+	gdouble volume;
+	guint i;
+
+	range = linked_elem_get_range(linked);
+	volume = card->volume / 100.0 * linked->weight;
+
+	for (i = 0; i < linked->chans.n; i++) {
+		gdouble chan_volume;
+
+		chan_volume = elem_channel_balanced(&linked->chans, i,
+		                                    volume, card->balance);
+		if (!elem_volume_to_raw(card->hctl, card->ops, linked->elem, range,
+		                        card->normalize, chan_volume, dir, &raw[i]))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Apply the volume of the main elem to every linked elem.
+ * Return the number of elems written.
+ */
+static guint
+card_sync_linked_volume(AlsaCard *card, int dir)
+{
+	GSList *item;
+	guint n = 0;
+
+	for (item = card->linked; item; item = item->next) {
+		LinkedElem *linked = item->data;
+		long raw[ELEM_MAX_CHANNELS];
+
+		if (linked->elem == NULL)
+			continue;
+
+		if (!linked_elem_volume_to_raw(linked, dir, raw))
+			continue;
+
+		if (elem_set_raw_volumes(card->hctl, card->ops, linked->elem, &linked->chans, raw)) {
+			linked->synced = TRUE;
+			n++;
+		}
+	}
+
+	return n;
+}
+
+/* Apply the mute state of the main elem to every linked elem.
+ * Return the number of elems written.
+ */
+static guint
+card_sync_linked_mute(AlsaCard *card)
+{
+	GSList *item;
+	guint n = 0;
+
+	for (item = card->linked; item; item = item->next) {
+		LinkedElem *linked = item->data;
+
+		if (linked->elem == NULL || !elem_has_mute(card->hctl, card->ops, linked->elem))
+			continue;
+
+		if (elem_set_mute(card->hctl, card->ops, linked->elem, card->muted)) {
+			linked->synced = TRUE;
+			n++;
+		}
+	}
+
+	return n;
+}
+
+/* Put back the linked elems that were changed by someone else, so that
+ * they keep following the main elem. A linked elem is left alone as long
+ * as it matches the main elem with any rounding: that's the case for the
+ * echo of our own changes, and for the changes of another card instance
+ * linking the same elem, so that instances never fight over it.
+ * Return the number of elems written.
+ */
+static guint
+card_restore_linked(AlsaCard *card)
+{
+	GSList *item;
+	guint n = 0;
+
+	for (item = card->linked; item; item = item->next) {
+		LinkedElem *linked = item->data;
+		long raw[ELEM_MAX_CHANNELS];
+		long target[ELEM_MAX_CHANNELS];
+		gboolean muted, matches = FALSE;
+		int dir;
+
+		if (!linked->moved)
+			continue;
+
+		linked->moved = FALSE;
+
+		if (linked->elem == NULL || !linked->synced)
+			continue;
+
+		linked_elem_get_range(linked);
+		card->n_reads++;
+
+		if (!elem_get_raw_volumes(card->hctl, card->ops, linked->elem,
+		                          &linked->chans, raw))
+			continue;
+
+		for (dir = -1; dir <= 1 && !matches; dir++) {
+			if (linked_elem_volume_to_raw(linked, dir, target) &&
+			    memcmp(raw, target, linked->chans.n * sizeof(long)) == 0)
+				matches = TRUE;
+		}
+
+		if (!matches && linked_elem_volume_to_raw(linked, 0, target)) {
+			ALSA_CARD_DEBUG(card->hctl, "Linked mixer elem '%s' changed, restoring it",
+			                linked->name);
+			if (elem_set_raw_volumes(card->hctl, card->ops, linked->elem,
+			                         &linked->chans, target))
+				n++;
+		}
+
+		if (!card->has_mute || !elem_has_mute(card->hctl, card->ops, linked->elem))
+			continue;
+
+		if (elem_get_mute(card->hctl, card->ops, linked->elem, &linked->chans, &muted) &&
+		    muted != card->muted) {
+			if (elem_set_mute(card->hctl, card->ops, linked->elem, card->muted))
+				n++;
+		}
+	}
+
+	return n;
+}
+
+/**
+ * Callback function for changes on the mixer elem.
+ * Invoked by Alsa from within snd_mixer_handle_events().
+ * Changes that don't concern our mixer elem (other channels, capture,
+ * jack sensing...) never get here. We just record the event mask, it's
+ * processed in poll_watch_cb() once all pending events were handled.
+ *
+ * @param elem the mixer elem that changed.
+ * @param mask the event mask (SND_CTL_EVENT_MASK_*).
+ * @return 0 on success.
+ */
+static int
+elem_cb(snd_mixer_elem_t *elem, unsigned int mask)
+{
+	AlsaCard *card = snd_mixer_elem_get_callback_private(elem);
+
+	if (card == NULL)
+		return 0;
+
+	/* The elem is about to disappear, forget about it right now */
+	if (mask == SND_CTL_EVENT_MASK_REMOVE) {
+		ALSA_CARD_DEBUG(card->hctl, "Mixer elem removed");
+		card->elem_events = SND_CTL_EVENT_MASK_REMOVE;
+		card->mixer_elem = NULL;
+		return 0;
+	}
+
+	/* Info changes may change the volume ranges we keep in cache */
+	if (mask & (SND_CTL_EVENT_MASK_INFO | SND_CTL_EVENT_MASK_TLV)) {
+		ALSA_CARD_DEBUG(card->hctl, "Mixer elem info changed, invalidating ranges");
+		card->range.valid = FALSE;
+	}
+
+	card->elem_events |= mask;
+
+	return 0;
+}
+
+/* Process the events recorded by elem_cb(), refresh the cached state
+ * accordingly, and return a mask of BACKEND_CHANGE_* values describing
+ * what really changed.
+ */
+static guint
+card_process_elem_events(AlsaCard *card)
+{
+	unsigned int events = card->elem_events;
+	gboolean old_has_mute, old_muted;
+	long old_raw[ELEM_MAX_CHANNELS];
+	guint old_n_chans;
+	guint changes = 0;
+
+	card->elem_events = 0;
+
+	if (events == 0)
+		return 0;
+
+	if (events == SND_CTL_EVENT_MASK_REMOVE)
+		return BACKEND_CHANGE_REMOVE;
+
+	if (events & (SND_CTL_EVENT_MASK_INFO | SND_CTL_EVENT_MASK_TLV))
+		changes |= BACKEND_CHANGE_INFO;
+
+	/* Our own changes are already in the cache. So if the state read
+	 * from Alsa is the same as the one we have, it's just the echo of
+	 * one of our own changes, or a change that doesn't matter to us.
+	 */
+	old_has_mute = card->has_mute;
+	old_muted = card->muted;
+	old_n_chans = card->chans.n;
+	memcpy(old_raw, card->raw, sizeof old_raw);
+
+	card_refresh_state(card);
+
+	if (card->chans.n != old_n_chans ||
+	    memcmp(old_raw, card->raw, card->chans.n * sizeof(long)) != 0)
+		changes |= BACKEND_CHANGE_VOLUME;
+	if (card->muted != old_muted || card->has_mute != old_has_mute)
+		changes |= BACKEND_CHANGE_SWITCH;
+
+	return changes;
+}
+
 /**
  * Callback function for volume changes.
  * We forward changes to higher level, through a callback mechanism again.
  *
- * @param source the GIOChannel event source.
- * @param condition the condition which has been satisfied.
- * @param card data set in g_io_add_watch().
+ * @param revents the poll events, as reported by Alsa.
+ * @param card the card being watched.
  * @return FALSE if the event source should be removed.
  */
 static gboolean
-poll_watch_cb(GIOChannel *source, GIOCondition condition, AlsaCard *card)
+poll_watch_cb(unsigned short revents, AlsaCard *card)
 {
-	gchar sbuf[256];
-	gsize sread = 1;
-	AlsaCb callback = card->cb_func;
+	BackendCb callback = card->cb_func;
 	gpointer data = card->cb_data;
-
-	// DEBUG("Entering %s()", __func__);
-
-	/* Handle pending mixer events.
-	 * Everything is broken if we don't do that !
-	 */
-	snd_mixer_handle_events(card->mixer);
+	guint changes;
+	int n_events;
 
 	/* Check if the soundcard has been unplugged. In such case,
-	 * the file descriptor we're watching disappeared, causing a G_IO_ERR.
+	 * the file descriptor we're watching disappeared.
 	 */
-	if (condition == G_IO_ERR) {
+	if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+		card->watch_id = 0;
 		if (callback)
-			callback(ALSA_CARD_DISCONNECTED, data);
+			callback(BACKEND_CARD_DISCONNECTED, BACKEND_CHANGE_REMOVE, data);
 		return FALSE;
 	}
 
-	/* Now read data from channel */
-	sread = 1;
-	while (sread) {
-		GIOStatus stat;
+	/* Handle every pending mixer event in one go.
+	 * Everything is broken if we don't do that !
+	 */
+	n_events = snd_mixer_handle_events(card->mixer);
+	if (n_events < 0) {
+		ALSA_CARD_ERR(card->hctl, n_events, "Can't handle mixer events");
+		if (callback)
+			callback(BACKEND_CARD_ERROR, 0, data);
+		return TRUE;
+	}
 
-		/* This handles the case where mixer_elem_cb() doesn't read all
-		 * the data on source. If we don't clear it out we'll go into an infinite
-		 * callback loop since there will be data on the channel forever.
-		 */
-		stat = g_io_channel_read_chars(source, sbuf, 256, &sread, NULL);
+	card->n_wakeups++;
+	card->n_events += n_events;
 
-		switch (stat) {
-		case G_IO_STATUS_AGAIN:
-			/* Normal, means alsa_cb cleared out the channel */
-			continue;
+	/* Arriving here, no errors happened. Let's see if something
+	 * happened to our mixer elem, and refresh our cached state if so.
+	 * It's the only place where we read it from Alsa.
+	 */
+	changes = card_process_elem_events(card);
 
-		case G_IO_STATUS_NORMAL:
-			/* Actually bad, alsa failed to clear channel */
-			ERROR("Alsa failed to clear the channel");
-			if (callback)
-				callback(ALSA_CARD_ERROR, data);
-			break;
+	/* Linked elems follow the main one, whoever changed them */
+	card->n_writes += card_restore_linked(card);
 
-		case G_IO_STATUS_ERROR:
-		case G_IO_STATUS_EOF:
-			ERROR("GIO error has occurred");
-			if (callback)
-				callback(ALSA_CARD_ERROR, data);
-			break;
+	if (changes == 0)
+		return TRUE;
 
-		default:
-			WARN("Unknown status from g_io_channel_read_chars()");
-		}
+	ALSA_CARD_DEBUG(card->hctl, "Mixer elem changed (0x%x): vol=%lg, muted=%s "
+	                "(io: %u reads, %u writes, %u events in %u wakeups)", changes,
+	                card->volume, card->muted ? "yes" : "no",
+	                card->n_reads, card->n_writes,
+	                card->n_events, card->n_wakeups);
 
+	if (changes & BACKEND_CHANGE_REMOVE) {
+		if (callback)
+			callback(BACKEND_CARD_DISCONNECTED, changes, data);
 		return TRUE;
 	}
 
-	/* Arriving here, no errors happened.
-	 * We can safely notify that values changed.
-	 */
+	/* We can safely notify that values changed */
 	if (callback)
-		callback(ALSA_CARD_VALUES_CHANGED, data);
+		callback(BACKEND_CARD_VALUES_CHANGED, changes, data);
 
 	return TRUE;
 }
@@ -731,12 +1979,14 @@ poll_watch_cb(GIOChannel *source, GIOCondition condition, AlsaCard *card)
  * Get the name of the card.
  * This is an internal string that shouldn't be modified.
  *
- * @param card a Card instance.
+ * @param base a Card instance.
  * @return the name of the card.
  */
-const char *
-alsa_card_get_name(AlsaCard *card)
+static const char *
+alsa_card_get_name(BackendCard *base)
 {
+	AlsaCard *card = ALSA_CARD(base);
+
 	return card->name;
 }
 
@@ -744,112 +1994,451 @@ alsa_card_get_name(AlsaCard *card)
  * Get the name of the channel.
  * This is an internal string that shouldn't be modified.
  *
- * @param card a Card instance.
+ * @param base a Card instance.
  * @return the name of the channel.
  */
-const char *
-alsa_card_get_channel(AlsaCard *card)
+static const char *
+alsa_card_get_channel(BackendCard *base)
 {
-	return elem_get_name(card->mixer_elem);
+	AlsaCard *card = ALSA_CARD(base);
+
+	return card->channel;
 }
 
 /**
  * Whether the card has mute capabilities.
  *
- * @param card a Card instance.
+ * @param base a Card instance.
  * @return TRUE if the card can be muted, FALSE otherwise.
  */
-gboolean
-alsa_card_has_mute(AlsaCard *card)
+static gboolean
+alsa_card_has_mute(BackendCard *base)
 {
-	return elem_has_mute(card->hctl, card->mixer_elem);
+	AlsaCard *card = ALSA_CARD(base);
+
+	return card->has_mute;
 }
 
 /**
  * Get the mute state, either TRUE or FALSE.
  *
- * @param card a Card instance.
+ * @param base a Card instance.
  * @return TRUE if the card is muted, FALSE otherwise.
  */
-gboolean
-alsa_card_is_muted(AlsaCard *card)
+static gboolean
+alsa_card_is_muted(BackendCard *base)
 {
-	gboolean muted;
+	AlsaCard *card = ALSA_CARD(base);
+
+	return card->muted;
+}
+
+/* Write the mute state to the main elem and the linked ones.
+ * Return TRUE on success, FALSE if the elem is gone or the write failed,
+ * in which case the cached state is left untouched.
+ */
+static gboolean
+card_write_mute(AlsaCard *card, gboolean muted)
+{
+	if (card->mixer_elem == NULL)
+		return FALSE;
 
-	elem_get_mute(card->hctl, card->mixer_elem, &muted);
-	return muted;
+	if (!elem_set_mute(card->hctl, card->ops, card->mixer_elem, muted))
+		return FALSE;
+
+	card->muted = muted;
+	card->n_writes++;
+	card->n_writes += card_sync_linked_mute(card);
+
+	return TRUE;
 }
 
 /**
  * Toggle the mute state.
  *
- * @param card a Card instance.
+ * @param base a Card instance.
  */
-void
-alsa_card_toggle_mute(AlsaCard *card)
+static void
+alsa_card_toggle_mute(BackendCard *base)
 {
-	gboolean muted;
+	AlsaCard *card = ALSA_CARD(base);
+
+	/* Nothing to toggle without a switch */
+	if (!card->has_mute || card->mixer_elem == NULL)
+		return;
 
-	/* Set mute */
-	muted = alsa_card_is_muted(card);
-	elem_set_mute(card->hctl, card->mixer_elem, !muted);
+	card_write_mute(card, !card->muted);
 }
 
 /**
  * Get the volume in percent (value between 0 and 100).
  *
- * @param card a Card instance.
+ * @param base a Card instance.
  * @return the volume in percent.
  */
-gdouble
-alsa_card_get_volume(AlsaCard *card)
+static gdouble
+alsa_card_get_volume(BackendCard *base)
+{
+	AlsaCard *card = ALSA_CARD(base);
+
+	return card->volume;
+}
+
+/**
+ * Get the volume of each channel of the mixer, along with the balance.
+ * Doesn't query Alsa, the values are taken from the cached state.
+ *
+ * @param card a AlsaCard instance.
+ * @param volumes the structure to fill.
+ */
+static void
+alsa_card_get_volumes(BackendCard *base, BackendVolumes *volumes)
+{
+	AlsaCard *card = ALSA_CARD(base);
+	guint i;
+
+	memset(volumes, 0, sizeof *volumes);
+
+	volumes->n_channels = card->chans.n;
+	for (i = 0; i < card->chans.n; i++)
+		volumes->volume[i] = card->volumes[i] * 100;
+	volumes->balance = card->balance;
+}
+
+/* Write the volume of each channel to the main elem and the linked ones.
+ * Channels that are not given get the volume of the last one given.
+ * Return TRUE if the raw volumes changed, FALSE if there was nothing
+ * to write or the write failed.
+ */
+static gboolean
+card_write_volumes(AlsaCard *card, const BackendVolumes *volumes, int dir)
+{
+	const ElemRange *range;
+	long raw[ELEM_MAX_CHANNELS];
+	gboolean changed = FALSE;
+	guint i, j;
+
+	if (volumes->n_channels == 0)
+		return FALSE;
+
+	range = card_get_range(card);
+
+	for (i = 0; i < card->chans.n; i++) {
+		j = MIN(i, volumes->n_channels - 1);
+		if (!elem_volume_to_raw(card->hctl, card->ops, card->mixer_elem, range,
+		                        card->normalize, volumes->volume[j] / 100.0,
+		                        dir, &raw[i]))
+			return FALSE;
+
+		if (raw[i] != card->raw[i])
+			changed = TRUE;
+	}
+
+	/* Don't bother Alsa with the volumes it has already */
+	if (!changed)
+		return FALSE;
+
+	if (!elem_set_raw_volumes(card->hctl, card->ops, card->mixer_elem, &card->chans, raw))
+		return FALSE;
+
+	card_update_volumes(card, raw, TRUE);
+	card->n_writes++;
+	card->n_writes += card_sync_linked_volume(card, dir);
+
+	ALSA_CARD_DEBUG(card->hctl, "Volumes set: vol=%lg, balance=%lg",
+	                card->volume, card->balance);
+
+	return TRUE;
+}
+
+/**
+ * Set the volume of each channel of the mixer, in one go.
+ * The balance is recomputed from the new channel volumes.
+ * Channels that are not given get the volume of the last one given.
+ *
+ * @param card a AlsaCard instance.
+ * @param volumes the volumes to set, in percent.
+ * @param dir the direction for rounding, see alsa_card_set_volume().
+ */
+static void
+alsa_card_set_volumes(BackendCard *base, const BackendVolumes *volumes, int dir)
+{
+	AlsaCard *card = ALSA_CARD(base);
+
+	if (card->mixer_elem == NULL)
+		return;
+
+	card_write_volumes(card, volumes, dir);
+}
+
+/* Get the step index of the volume, that is the raw volume of the
+ * loudest channel, counted from the bottom of the range.
+ */
+static guint
+card_get_step(AlsaCard *card, guint *n_steps)
 {
-	gdouble volume = 0;
-	gboolean gotten = FALSE;
+	const ElemRange *range;
+	long max;
+	guint i;
+
+	range = card_get_range(card);
+	if (!range->vol_ok || card->chans.n == 0) {
+		*n_steps = 0;
+		return 0;
+	}
+
+	max = range->min;
+	for (i = 0; i < card->chans.n; i++)
+		max = MAX(max, card->raw[i]);
+
+	*n_steps = range->max - range->min;
 
-	if (card->normalize)
-		gotten = elem_get_volume_normalized(card->hctl, card->mixer_elem, &volume);
+	return CLAMP(max, range->min, range->max) - range->min;
+}
+
+/* Get the volume in percent of a step index */
+static gdouble
+card_step_to_volume(AlsaCard *card, guint step)
+{
+	const ElemRange *range;
+	gdouble volume;
 
-	if (!gotten)
-		elem_get_volume(card->hctl, card->mixer_elem, &volume);
+	range = card_get_range(card);
+	elem_raw_to_volume(card->hctl, card->ops, card->mixer_elem, range,
+	                   card->normalize, range->min + step, &volume);
 
 	return volume * 100;
 }
 
+/* Write the volume to the main elem and the linked ones, scaling each
+ * channel according to the balance. Nothing is written if the raw volumes
+ * we'd write are the ones we have already.
+ * Return TRUE if the raw volumes changed, FALSE if there was nothing
+ * to write or the write failed.
+ */
+static gboolean
+card_write_volume(AlsaCard *card, gdouble value, int dir)
+{
+	const ElemRange *range;
+	long raw[ELEM_MAX_CHANNELS];
+	gdouble volume, balance;
+	gboolean changed = FALSE;
+	guint i;
+
+	range = card_get_range(card);
+	volume = value / 100.0;
+	balance = card->balance;
+
+	/* Scale each channel according to the balance */
+	for (i = 0; i < card->chans.n; i++) {
+		gdouble chan_volume;
+
+		chan_volume = elem_channel_balanced(&card->chans, i, volume, balance);
+		if (!elem_volume_to_raw(card->hctl, card->ops, card->mixer_elem, range,
+		                        card->normalize, chan_volume, dir, &raw[i]))
+			return FALSE;
+
+		if (raw[i] != card->raw[i])
+			changed = TRUE;
+	}
+
+	/* Don't bother Alsa with the volume it has already */
+	if (!changed)
+		return FALSE;
+
+	/* Set all the channels at once. We know what we set,
+	 * no need to read it back. If it fails, the error is logged
+	 * and the cache keeps what Alsa really has.
+	 */
+	if (!elem_set_raw_volumes(card->hctl, card->ops, card->mixer_elem, &card->chans, raw))
+		return FALSE;
+
+	card_update_volumes(card, raw, FALSE);
+	card->n_writes++;
+	card->n_writes += card_sync_linked_volume(card, dir);
+
+	ALSA_CARD_DEBUG(card->hctl, "Volume set: vol=%lg (io: %u reads, %u writes)",
+	                card->volume, card->n_reads, card->n_writes);
+
+	return TRUE;
+}
+
 /**
  * Set the volume in percent (value between 0 and 100).
  *
- * @param card a Card instance.
+ * @param base a Card instance.
  * @param value the volume in percent.
  * @param dir the direction of the volume change
  *        (-1: lowering, +1: raising, 0: setting).
  */
-void
-alsa_card_set_volume(AlsaCard *card, gdouble value, int dir)
+static void
+alsa_card_set_volume(BackendCard *base, gdouble value, int dir)
 {
-	gdouble volume;
-	gboolean set = FALSE;
+	AlsaCard *card = ALSA_CARD(base);
 
-	volume = value / 100.0;
+	/* The mixer elem is gone, we're about to be disconnected */
+	if (card->mixer_elem == NULL)
+		return;
+
+	card_write_volume(card, value, dir);
+}
+
+/**
+ * Get the volume as a step index, that is the raw volume of the loudest
+ * channel, from 0 to the number of raw steps.
+ *
+ * @param base a Card instance.
+ * @param step where to store the step index.
+ * @param n_steps where to store the number of steps.
+ */
+static void
+alsa_card_get_steps(BackendCard *base, guint *step, guint *n_steps)
+{
+	AlsaCard *card = ALSA_CARD(base);
+
+	if (card->mixer_elem == NULL) {
+		*step = *n_steps = 0;
+		return;
+	}
+
+	*step = card_get_step(card, n_steps);
+}
+
+/**
+ * Apply a transaction: volume and mute state are set in one pass.
+ * The resulting raw volumes are computed from the cached ranges, so that
+ * the elems are only written if something really changes, and the
+ * changes we make end up in a single Alsa notification.
+ *
+ * @param base a Card instance.
+ * @param trans the transaction to apply.
+ * @return TRUE if the volume or the mute state changed, FALSE otherwise.
+ */
+static gboolean
+alsa_card_apply(BackendCard *base, const BackendTransaction *trans)
+{
+	AlsaCard *card = ALSA_CARD(base);
+	BackendOutcome outcome;
+	gboolean volume_changed = FALSE, mute_changed = FALSE, set_mute;
+	guint step, n_steps;
+
+	/* The mixer elem is gone, we're about to be disconnected */
+	if (card->mixer_elem == NULL)
+		return FALSE;
+
+	step = card_get_step(card, &n_steps);
+	backend_transaction_resolve(trans, card->volume, card->muted, n_steps,
+	                            &outcome);
+	set_mute = outcome.set_mute && card->has_mute && outcome.muted != card->muted;
+
+	/* Mute before the volume changes, so that the change is not heard */
+	if (set_mute && outcome.muted)
+		mute_changed = card_write_mute(card, TRUE);
+
+	if (outcome.set_volumes) {
+		volume_changed = card_write_volumes(card, &outcome.volumes, outcome.dir);
+	} else if (outcome.set_volume) {
+		gdouble volume = outcome.volume;
+
+		/* Step indexes are exact, no need to go through percents */
+		if (outcome.step >= 0)
+			volume = card_step_to_volume(card, outcome.step);
 
-	/* Set volume */
-	if (card->normalize)
-		set = elem_set_volume_normalized(card->hctl, card->mixer_elem, volume, dir);
+		volume_changed = card_write_volume(card, volume, outcome.dir);
 
-	if (!set)
-		elem_set_volume(card->hctl, card->mixer_elem, volume, dir);
+		/* A volume step smaller than a hardware step would be lost,
+		 * so move by one hardware step at least. A mute change
+		 * doesn't count, the volume must move.
+		 */
+		if (!volume_changed && outcome.stepped) {
+			if (outcome.dir > 0 && step < n_steps)
+				volume_changed = card_write_volume(card, card_step_to_volume(card, step + 1), +1);
+			else if (outcome.dir < 0 && step > 0)
+				volume_changed = card_write_volume(card, card_step_to_volume(card, step - 1), -1);
+		}
+	}
+
+	/* Unmute once the volume is set */
+	if (set_mute && !outcome.muted)
+		mute_changed = card_write_mute(card, FALSE);
+
+	return volume_changed || mute_changed;
+}
+
+/**
+ * Link another mixer elem of the card to the main one. From now on,
+ * volume and mute changes are applied to both elems at once. The volume
+ * of the linked elem is the volume of the main elem times the weight.
+ * Only changes made through this card are propagated. Once written,
+ * a linked elem changed by another application is put back in line with
+ * the main elem, without notifying the callback.
+ *
+ * @param card a AlsaCard instance.
+ * @param channel the name of the mixer elem to link, like 'Headphone'.
+ * @param weight the volume ratio to apply, between 0 and 1.
+ * @return TRUE on success, FALSE otherwise.
+ */
+static gboolean
+alsa_card_link_channel(BackendCard *base, const char *channel, gdouble weight)
+{
+	AlsaCard *card = ALSA_CARD(base);
+	snd_mixer_elem_t *elem;
+	LinkedElem *linked;
+	GSList *item;
+
+	if (card->mixer_elem == NULL)
+		return FALSE;
+
+	elem = mixer_get_elem(card->hctl, card->ops, card->mixer, channel);
+	if (elem == NULL)
+		return FALSE;
+
+	/* Linking the main elem, or an elem twice, makes no sense */
+	if (elem == card->mixer_elem) {
+		ALSA_CARD_WARN(card->hctl, "Can't link '%s' to itself", channel);
+		return FALSE;
+	}
+
+	for (item = card->linked; item; item = item->next) {
+		linked = item->data;
+		if (linked->elem == elem) {
+			ALSA_CARD_WARN(card->hctl, "Mixer elem '%s' already linked", channel);
+			return FALSE;
+		}
+	}
+
+	linked = g_new0(LinkedElem, 1);
+	linked->card = card;
+	linked->elem = elem;
+	linked->name = g_strdup(elem_get_name(elem));
+	linked->weight = CLAMP(weight, 0, 1);
+	linked_elem_get_range(linked);
+
+	snd_mixer_elem_set_callback_private(elem, linked);
+	snd_mixer_elem_set_callback(elem, linked_elem_cb);
+
+	card->linked = g_slist_append(card->linked, linked);
+
+	ALSA_CARD_DEBUG(card->hctl, "Mixer elem '%s' linked to '%s' (weight: %lg)",
+	                linked->name, card->channel, linked->weight);
+
+	return TRUE;
 }
 
 /**
  * Set a callback invoked on volume/mute changes.
+ * Only changes on the mixer elem in use are reported, along with
+ * a mask of BACKEND_CHANGE_* values telling what changed.
  *
- * @param card a Card instance.
+ * @param base a Card instance.
  * @param callback the callback to be invoked.
  * @param user_data the user data passed to the callback.
  */
-void
-alsa_card_install_callback(AlsaCard *card, AlsaCb callback, gpointer user_data)
+static void
+alsa_card_install_callback(BackendCard *base, BackendCb callback, gpointer user_data)
 {
+	AlsaCard *card = ALSA_CARD(base);
+
 	card->cb_func = callback;
 	card->cb_data = user_data;
 }
@@ -857,20 +2446,32 @@ alsa_card_install_callback(AlsaCard *card, AlsaCb callback, gpointer user_data)
 /**
  * Free a card instance, therefore closing mixer and freeing any allocated ressources.
  *
- * @param card a Card instance.
+ * @param base a Card instance.
  */
-void
-alsa_card_free(AlsaCard *card)
+static void
+alsa_card_free(BackendCard *base)
 {
+	AlsaCard *card = ALSA_CARD(base);
+
 	if (card == NULL)
 		return;
 
-	if (card->watch_ids)
-		unwatch_poll_descriptors(card->watch_ids);
+	if (card->watch_id)
+		backend_remove_source(card->watch_id);
+
+	if (card->mixer_elem) {
+		snd_mixer_elem_set_callback(card->mixer_elem, NULL);
+		snd_mixer_elem_set_callback_private(card->mixer_elem, NULL);
+	}
+
+	g_slist_free_full(card->linked, (GDestroyNotify) linked_elem_free);
 
 	if (card->mixer)
 		mixer_close(card->hctl, card->mixer);
 
+	elem_range_clear(&card->range);
+
+	g_free(card->channel);
 	g_free(card->hctl);
 	g_free(card->name);
 	g_free(card);
@@ -885,37 +2486,37 @@ alsa_card_free(AlsaCard *card)
  *
  * @param card_name the name of the card, or NULL to use the default card.
  * @param channel the name of the channel, or NULL to use the first playable channel.
+ * @param stream whether we control the playback or the capture volume.
  * @param normalize whether we use normalized volume or not.
  * @return a newly allocated Card instance, or NULL on failure.
  */
-AlsaCard *
-alsa_card_new(const char *card_name, const char *channel, gboolean normalize)
+static BackendCard *
+alsa_card_new(const char *card_name, const char *channel, BackendStream stream,
+              gboolean normalize)
 {
 	AlsaCard *card;
-	AlsaCardIter *iter;
+	const AlsaRegistryEntry *entry;
+	GSource *source;
 
 	card = g_new0(AlsaCard, 1);
+	card->parent.backend = &alsa_backend;
 
 	/* Save normalize parameter */
 	card->normalize = normalize;
 
+	/* Pick the functions for the stream direction */
+	card->ops = elem_ops_get(stream);
+
 	/* Save card name */
 	if (!card_name)
 		card_name = ALSA_DEFAULT_CARD;
 	card->name = g_strdup(card_name);
 
 	/* Get corresponding HCTL name */
-	iter = alsa_card_iter_new();
-	while (alsa_card_iter_loop(iter)) {
-		if (!g_strcmp0(iter->name, card_name)) {
-			card->hctl = g_strdup(iter->hctl);
-			break;
-		}
-	}
-	alsa_card_iter_free(iter);
-
-	if (card->hctl == NULL)
+	entry = alsa_registry_lookup(card_name);
+	if (entry == NULL)
 		goto failure;
+	card->hctl = g_strdup(entry->hctl);
 
 	/* Open mixer */
 	card->mixer = mixer_open(card->hctl);
@@ -923,33 +2524,43 @@ alsa_card_new(const char *card_name, const char *channel, gboolean normalize)
 		goto failure;
 
 	/* Get mixer element */
-	card->mixer_elem = mixer_get_playable_elem(card->hctl, card->mixer, channel);
+	card->mixer_elem = mixer_get_elem(card->hctl, card->ops, card->mixer, channel);
 	if (card->mixer_elem == NULL)
-		card->mixer_elem = mixer_get_first_playable_elem(card->hctl, card->mixer);
+		card->mixer_elem = mixer_get_first_elem(card->hctl, card->ops, card->mixer);
 	if (card->mixer_elem == NULL)
 		goto failure;
 
-	/* Get mixer poll descriptors and watch them using gio.
+	card->channel = g_strdup(elem_get_name(card->mixer_elem));
+
+	/* Query the volume ranges and channels once and for all. They're
+	 * invalidated by the elem callback if ever Alsa reports an info change.
+	 */
+	card_get_range(card);
+	snd_mixer_elem_set_callback_private(card->mixer_elem, card);
+	snd_mixer_elem_set_callback(card->mixer_elem, elem_cb);
+
+	/* Read the initial state */
+	card_refresh_state(card);
+
+	/* Watch the mixer poll descriptors.
 	 * That's how we get notified from every volume/mute changes,
 	 * may it be external or due to PNMixer.
 	 */
-	struct pollfd *pollfds;
-	pollfds = mixer_get_poll_descriptors(card->hctl, card->mixer);
-	if (pollfds == NULL)
+	source = mixer_source_new(card->hctl, card->mixer);
+	if (source == NULL)
 		goto failure;
 
-	card->watch_ids = watch_poll_descriptors(card->hctl, pollfds,
-	                  (GIOFunc) poll_watch_cb, card);
-	g_free(pollfds);
+	card->watch_id = backend_attach_source(source, (GSourceFunc) (void (*)(void)) poll_watch_cb,
+	                                       card);
 
 	/* Sum up the situation */
-	DEBUG("'%s': Card '%s' with channel '%s' initialized !",
-	      card->hctl, card->name, elem_get_name(card->mixer_elem));
+	DEBUG("'%s': Card '%s' with %s channel '%s' initialized !",
+	      card->hctl, card->name, card->ops->name, card->channel);
 
-	return card;
+	return &card->parent;
 
 failure:
-	alsa_card_free(card);
+	alsa_card_free(&card->parent);
 	return NULL;
 }
 
@@ -957,76 +2568,101 @@ failure:
  * Alsa listing functions
  */
 
+/**
+ * Set a callback invoked when a card is plugged or unplugged.
+ * It's driven by the registry hotplug events, so the registry is
+ * loaded right now, to start watching.
+ *
+ * @param callback the callback to be invoked, or NULL.
+ * @param data the user data passed to the callback.
+ */
+static void
+alsa_set_cards_callback(BackendCardsCb callback, gpointer data)
+{
+	registry.cb_func = callback;
+	registry.cb_data = data;
+
+	if (callback)
+		alsa_registry_ensure();
+}
+
+/**
+ * Forget about the registry and stop watching the Alsa device directory.
+ * The watch lives in the main context of the thread that used the backend,
+ * and must go along with it. The registry is rebuilt on the next call.
+ */
+static void
+alsa_cleanup(void)
+{
+	if (registry.watch_id)
+		backend_remove_source(registry.watch_id);
+	if (registry.inotify_fd >= 0)
+		close(registry.inotify_fd);
+
+	g_slist_free_full(registry.entries, (GDestroyNotify) alsa_registry_entry_free);
+	registry.entries = NULL;
+	registry.loaded = FALSE;
+	registry.inotify_fd = -1;
+	registry.watch_id = 0;
+	registry.cb_func = NULL;
+	registry.cb_data = NULL;
+
+	DEBUG("Registry: cleaned up");
+}
+
 /**
  * Return the list of playable cards as a GSList.
  * Must be freed using g_slist_free_full() and g_free().
  *
  * @return a list of playable cards.
  */
-GSList *
+static GSList *
 alsa_list_cards(void)
 {
-	AlsaCardIter *iter;
-	GSList *list = NULL;
+	GSList *item, *list = NULL;
 
-	iter = alsa_card_iter_new();
-
-	while (alsa_card_iter_loop(iter)) {
-		snd_mixer_t *mixer;
+	alsa_registry_ensure();
 
-		/* Open mixer */
-		mixer = mixer_open(iter->hctl);
-		if (mixer == NULL)
-			continue;
-
-		/* Only keep cards with playable channels */
-		if (mixer_is_playable(iter->hctl, mixer))
-			list = g_slist_append(list, g_strdup(iter->name));
+	/* Only keep cards with playable channels */
+	for (item = registry.entries; item; item = item->next) {
+		AlsaRegistryEntry *entry = item->data;
 
-		/* Close mixer */
-		mixer_close(iter->hctl, mixer);
+		if (entry->playable)
+			list = g_slist_prepend(list, g_strdup(entry->name));
 	}
 
-	alsa_card_iter_free(iter);
-
-	return list;
+	return g_slist_reverse(list);
 }
 
 /**
- * For a given card name, return the list of playable channels as a GSList.
- * Must be freed using g_slist_free_full() and g_free().
+ * For a given card name, return the list of playable or capture channels
+ * as a GSList. Must be freed using g_slist_free_full() and g_free().
  *
  * @param card_name the name of the card for which we list the channels
- * @return a list of playable channels.
+ * @param stream whether we list playback or capture channels.
+ * @return a list of channels.
  */
-GSList *
-alsa_list_channels(const char *card_name)
+static GSList *
+alsa_list_channels(const char *card_name, BackendStream stream)
 {
-	AlsaCardIter *iter;
+	const AlsaRegistryEntry *entry;
 	char *hctl = NULL;
 	snd_mixer_t *mixer = NULL;
 	GSList *list = NULL;
 
-	/* Iterate over cards to find the one provided in argument */
-	iter = alsa_card_iter_new();
-	while (alsa_card_iter_loop(iter)) {
-		if (!g_strcmp0(iter->name, card_name)) {
-			hctl = g_strdup(iter->hctl);
-			break;
-		}
-	}
-	alsa_card_iter_free(iter);
-
-	if (hctl == NULL)
+	/* Look for the card provided in argument */
+	entry = alsa_registry_lookup(card_name);
+	if (entry == NULL)
 		goto exit;
+	hctl = g_strdup(entry->hctl);
 
 	/* Open the mixer */
 	mixer = mixer_open(hctl);
 	if (mixer == NULL)
 		goto exit;
 
-	/* Get a list of playable channels */
-	list = mixer_list_playable(hctl, mixer);
+	/* Get a list of channels */
+	list = mixer_list_elems(hctl, elem_ops_get(stream), mixer);
 
 exit:
 	/* Cleanup */
@@ -1037,3 +2673,31 @@ exit:
 
 	return list;
 }
+
+/*
+ * Backend
+ */
+
+/** The Alsa backend, the one PNMixer uses by default. */
+const Backend alsa_backend = {
+	.name = "alsa",
+	.list_cards = alsa_list_cards,
+	.list_channels = alsa_list_channels,
+	.set_cards_callback = alsa_set_cards_callback,
+	.cleanup = alsa_cleanup,
+	.card_new = alsa_card_new,
+	.card_free = alsa_card_free,
+	.card_link_channel = alsa_card_link_channel,
+	.card_install_callback = alsa_card_install_callback,
+	.card_get_name = alsa_card_get_name,
+	.card_get_channel = alsa_card_get_channel,
+	.card_has_mute = alsa_card_has_mute,
+	.card_is_muted = alsa_card_is_muted,
+	.card_toggle_mute = alsa_card_toggle_mute,
+	.card_get_volume = alsa_card_get_volume,
+	.card_set_volume = alsa_card_set_volume,
+	.card_get_volumes = alsa_card_get_volumes,
+	.card_set_volumes = alsa_card_set_volumes,
+	.card_get_steps = alsa_card_get_steps,
+	.card_apply = alsa_card_apply,
+};
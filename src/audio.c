@@ -11,19 +11,47 @@
 /**
  * @file audio.c
  * This file holds the audio related code.
- * It is a middleman between the low-level audio backend (alsa),
+ * It is a middleman between the low-level audio backends (see backend.h),
  * and the high-level ui code.
  * This abstraction layer allows the high-level code to be completely
  * unaware of the underlying audio implementation, may it be alsa or whatever.
  * @brief Audio subsystem.
  */
 
+#include <string.h>
 #include <glib.h>
 
 #include "audio.h"
-#include "alsa.h"
+#include "backend.h"
 #include "prefs.h"
 #include "support-log.h"
+#include "worker.h"
+
+/* Time to wait after a card was plugged or unplugged, before reloading */
+#define AUDIO_HOTPLUG_DELAY 100 /* ms */
+
+/* Default acceleration of the volume steps made in a burst */
+#define AUDIO_ACCEL_INTERVAL 100 /* ms, max delay between two steps of a burst */
+#define AUDIO_ACCEL_FACTOR 0.5   /* Growth of the step, for each step of a burst */
+#define AUDIO_ACCEL_MAX 4.0      /* Max ratio between the step and 'ScrollStep' */
+
+/* Retries to hook the preferred card, when it's there but unusable */
+#define AUDIO_RETRY_DELAY_MIN 1000 /* ms */
+#define AUDIO_RETRY_DELAY_MAX 60000 /* ms */
+
+/* Volume ramps */
+#define AUDIO_RAMP_TICK 16 /* ms, about one frame */
+#define AUDIO_RAMP_WRITE_INTERVAL 30 /* ms, default min delay between two writes */
+#define AUDIO_RAMP_TOLERANCE 2.0 /* percent, how far off our writes may come back */
+
+/* Default pace of the updates for changes made by someone else.
+ * 0 dispatches them at once, as they come, like it always did.
+ */
+#define AUDIO_UPDATE_INTERVAL 0 /* ms */
+
+/* Writes we wait the echo of. Older ones are forgotten. */
+#define AUDIO_MAX_PENDING_WRITES 8
+#define AUDIO_WRITE_TIMEOUT (G_USEC_PER_SEC) /* us */
 
 /*
  * Enumeration to string, for friendly debug messages.
@@ -60,655 +88,1761 @@ audio_signal_to_str(AudioSignal signal)
 		return "card error";
 	case AUDIO_VALUES_CHANGED:
 		return "values changed";
+	case AUDIO_CAPTURE_VALUES_CHANGED:
+		return "capture values changed";
 	default:
 		return "unknown";
 	}
 }
 
-/*
- * Audio Event.
- * An audio event is a struct that contains the current audio status.
- * It's passed in parameters of the user signal handlers, so that
- * user doesn't have to query the audio system to know about it.
- * It make things a little more efficient.
- */
-
-/* Free an audio event */
-static void
-audio_event_free(AudioEvent *event)
-{
-	if (event == NULL)
-		return;
-
-	g_free(event);
-}
-
-/* Create a new audio event */
-static AudioEvent *
-audio_event_new(Audio *audio, AudioSignal signal, AudioUser user)
-{
-	AudioEvent *event;
-
-	/* At the moment there's no need to duplicate card/channel
-	 * name strings, so let's optimize a very little and make
-	 * them const pointers.
-	 */
-
-	event = g_new0(AudioEvent, 1);
-
-	event->signal = signal;
-	event->user = user;
-	event->card = audio_get_card(audio);
-	event->channel = audio_get_channel(audio);
-	event->has_mute = audio_has_mute(audio);
-	event->muted = audio_is_muted(audio);
-	event->volume = audio_get_volume(audio);
-
-	return event;
-}
-
 /*
  * Audio Signal Handlers.
- * An audio signal handler is made of a callback and a data pointer.
- * It's the basic type that holds user signal handlers.
+ * An audio signal handler is made of a callback and a data pointer,
+ * along with what it's interested in: a mask of signals, a mask of users
+ * and a visibility check. Handlers live in slots of a compact array,
+ * free slots are reused. The id handed out to the user is made of the
+ * slot index and a sequence number, bumped each time the slot is reused,
+ * so that a stale id can't disconnect someone else.
  */
 
 struct audio_handler {
-	AudioCallback callback;
+	AudioCallback callback; /* NULL for a free slot */
 	gpointer data;
+	guint signals;
+	guint users;
+	AudioVisibleFunc visible;
+	guint16 seq;
+	gint next_free; /* Next free slot, or -1 */
 };
 
 typedef struct audio_handler AudioHandler;
 
-/* Free an audio handler */
-static void
-audio_handler_free(AudioHandler *handler)
-{
-	g_free(handler);
-}
+#define AUDIO_HANDLER_ID(index, seq) (((guint) (seq) << 16) | ((index) + 1))
+#define AUDIO_HANDLER_INDEX(id) ((gint) ((id) & 0xFFFF) - 1)
+#define AUDIO_HANDLER_SEQ(id) ((guint16) ((id) >> 16))
+#define AUDIO_MAX_HANDLERS 0xFFFF
 
-/* Create a new audio handler */
-static AudioHandler *
-audio_handler_new(AudioCallback callback, gpointer data)
+/* Check if a handler wants to hear about an event */
+static gboolean
+audio_handler_wants(const AudioHandler *handler, const AudioEvent *event)
 {
-	AudioHandler *handler;
-
-	handler = g_new0(AudioHandler, 1);
-	handler->callback = callback;
-	handler->data = data;
-
-	return handler;
-}
+	if (handler->callback == NULL)
+		return FALSE;
 
-/* Check if two handlers are the identical. We compare the content
- * of the structures, not the pointers.
- */
-static gint
-audio_handler_cmp(AudioHandler *h1, AudioHandler *h2)
-{
-	if (h1->callback == h2->callback && h1->data == h2->data)
-		return 0;
-	return -1;
-}
+	if (!(handler->signals & AUDIO_SIGNAL_MASK(event->signal)))
+		return FALSE;
 
-/* Add a handler to a handler list */
-static GSList *
-audio_handler_list_append(GSList *list, AudioHandler *handler)
-{
-	GSList *item;
+	if (!(handler->users & AUDIO_USER_MASK(event->user)))
+		return FALSE;
 
-	/* Ensure that the handler is not already part of the list.
-	 * It's probably an error to have a duplicated handler.
-	 */
-	item = g_slist_find_custom(list, handler, (GCompareFunc) audio_handler_cmp);
-	if (item) {
-		WARN("Audio handler already in the list");
-		return list;
-	}
+	if (handler->visible && !handler->visible(handler->data))
+		return FALSE;
 
-	/* Append the handler to the list */
-	return g_slist_append(list, handler);
+	return TRUE;
 }
 
-/* Remove a handler from a handler list */
-static GSList *
-audio_handler_list_remove(GSList *list, AudioHandler *handler)
+/* Get the audio backend selected in the preferences. NULL if the worker
+ * must let go of the cards of another backend before it can run this one.
+ */
+static const Backend *
+audio_get_backend(void)
 {
-	GSList *item;
+	const Backend *backend;
+	gchar *name;
 
-	/* Find the handler */
-	item = g_slist_find_custom(list, handler, (GCompareFunc) audio_handler_cmp);
-	if (item == NULL) {
-		WARN("Audio handler wasn't found in the list");
-		return list;
-	}
+	name = prefs_get_string("AudioBackend", NULL);
+	backend = backend_get(name);
+	g_free(name);
 
-	/* Remove the handler from the list.
-	 * We assume there's only one such handler.
-	 */
-	list = g_slist_remove_link(list, item);
-	g_slist_free_full(item, (GDestroyNotify) audio_handler_free);
-	return list;
+	/* Keep slow cards from freezing the ui */
+	if (prefs_get_boolean("AudioWorker", TRUE))
+		backend = worker_get_backend(backend);
+
+	return backend;
 }
 
 /*
  * Public functions & signals handlers
  */
 
+/* A write we made, with the state we expect to see once it's done */
+struct audio_write {
+	guint generation;
+	gint64 time; /* Monotonic time */
+	guint parts; /* Mask of AUDIO_STATE_* values */
+	gboolean muted;
+	gdouble volume;
+	gboolean capture_muted;
+	gdouble capture_volume;
+};
+
+typedef struct audio_write AudioWrite;
+
+/* A volume ramp, driven by the ramp scheduler of the main instance */
+struct audio_ramp {
+	gboolean active;
+	AudioUser user;
+	gdouble from;
+	gdouble to;
+	gint64 start;     /* Monotonic time */
+	guint duration;   /* In ms */
+	gboolean muted;   /* Mute state during the ramp */
+	gboolean mute;    /* Mute at the end, and restore the volume */
+	gdouble restore;
+	gdouble last;     /* Last volume written */
+	gint64 last_time; /* Monotonic time of the last write */
+};
+
+typedef struct audio_ramp AudioRamp;
+
 struct audio {
 	/* Preferences */
 	gdouble scroll_step;
+	guint accel_interval; /* In ms, 0 to disable the acceleration */
+	gdouble accel_factor;
+	gdouble accel_max;
 	gboolean normalize;
-	/* Underlying sound card */
-	AlsaCard *soundcard;
+	guint update_interval; /* In ms, 0 to dispatch external changes at once */
+	guint mute_fade; /* In ms, 0 to mute and unmute at once */
+	/* Audio backend in use */
+	const Backend *backend;
+	/* Underlying sound card, and its capture side if any */
+	BackendCard *soundcard;
+	BackendCard *capture;
 	/* Cached value (to avoid querying the underlying
 	 * sound card each time we need the info).
 	 */
 	gchar *card;
 	gchar *channel;
-	/* Last action performed (volume/mute change) */
-	gint64 last_action_timestamp;
 	/* True if we're not working with the preferred card */
 	gboolean fallback;
-	gint64 fallback_last_check;
+	/* Pending reload, after a card was plugged or unplugged */
+	guint hotplug_id;
+	/* Card events being dispatched, reloads must wait until they're done */
+	guint in_card_event;
+	/* Pending retry to hook the preferred card, while in fallback */
+	gchar *preferred;
+	guint retry_id;
+	guint retry_delay; /* In ms */
+	/* Every card available is hooked at the same time, each one by its
+	 * own instance, owned by the main instance. The main instance has no
+	 * card of its own, it acts on the active card instance.
+	 */
+	Audio *parent; /* Main instance, NULL for the main instance itself */
+	GSList *cards; /* Card instances, list of Audio */
+	Audio *active; /* Active card instance, may be NULL */
+	gchar *settings; /* Settings the card was hooked with */
+	/* Current burst of volume steps */
+	gint64 accel_time; /* Monotonic time of the last step */
+	AudioUser accel_user;
+	BackendStream accel_stream;
+	gint accel_dir;
+	guint accel_streak;
+	/* Snapshot of the audio status, handed to the signal handlers */
+	AudioState state;
+	/* External changes not dispatched yet, mask of AUDIO_STATE_* values */
+	guint deferred;
+	guint deferred_id;
+	/* Our own writes, oldest first, so that we can tell their echoes
+	 * from real external changes.
+	 */
+	AudioWrite writes[AUDIO_MAX_PENDING_WRITES];
+	guint n_writes;
+	guint generation;
+	/* Echoes suppressed, and external changes dispatched although
+	 * nothing changed, see audio_get_dispatch_counters().
+	 */
+	guint n_echoes;
+	guint n_duplicates;
+	/* Volume ramp of a card instance. Cards without a mute switch are
+	 * faded out to zero, and the volume they had is kept here.
+	 */
+	AudioRamp ramp;
+	guint write_interval; /* In ms, min delay between two ramp writes */
+	gboolean faded;
+	gdouble faded_volume;
+	/* Ramp scheduler of the main instance, ticking while ramps are active */
+	guint ramp_id;
 	/* User signal handlers.
 	 * To be invoked when the audio status changes.
 	 */
-	GSList *handlers;
+	GArray *handlers;
+	gint free_handler; /* First free slot, or -1 */
 };
 
-/**
- * Convenient function to invoke the handlers
- *
- * @param audio an Audio instance.
- * @param signal the signal to dispatch.
- * @param user the user that made the action.
+/* Get the instance that does the job: the active card instance for
+ * the main instance, or the card instance itself.
  */
-static void
-invoke_handlers(Audio *audio, AudioSignal signal, AudioUser user)
+static Audio *
+audio_target(Audio *audio)
 {
-	AudioEvent *event;
-	GSList *item;
-
-	/* Nothing to do if there is no handlers */
-	if (audio->handlers == NULL)
-		return;
+	return audio->active ? audio->active : audio;
+}
 
-	/* Create a new event */
-	event = audio_event_new(audio, signal, user);
+/*
+ * Audio State.
+ * The audio state is a snapshot of the audio status. Each instance keeps
+ * its own, refreshed when something changes, and hands it out to the
+ * user signal handlers. This way, dispatching a signal doesn't have to
+ * query the audio system, and doesn't allocate anything.
+ */
 
-	/* Invoke the various handlers around */
-	DEBUG("** Dispatching signal '%s' from '%s', vol=%lg, has_mute=%s, muted=%s",
-	      audio_signal_to_str(signal), audio_user_to_str(user),
-	      event->volume, event->has_mute ? "yes" : "no", event->muted ? "yes" : "no");
+enum audio_state_part {
+	AUDIO_STATE_PLAYBACK = 1 << 0,
+	AUDIO_STATE_CAPTURE  = 1 << 1,
+	AUDIO_STATE_ALL      = AUDIO_STATE_PLAYBACK | AUDIO_STATE_CAPTURE
+};
 
-	for (item = audio->handlers; item; item = item->next) {
-		AudioHandler *handler = item->data;
-		handler->callback(audio, event, handler->data);
+/* Tell which parts of the state a signal is about */
+static guint
+audio_state_parts(AudioSignal signal)
+{
+	switch (signal) {
+	case AUDIO_VALUES_CHANGED:
+		return AUDIO_STATE_PLAYBACK;
+	case AUDIO_CAPTURE_VALUES_CHANGED:
+		return AUDIO_STATE_CAPTURE;
+	case AUDIO_CARD_DISCONNECTED:
+	case AUDIO_CARD_ERROR:
+		/* The card is still hooked, nothing changed yet */
+		return 0;
+	default:
+		return AUDIO_STATE_ALL;
 	}
-
-	/* Then free the event */
-	audio_event_free(event);
 }
 
-/**
- * Callback invoked when an alsa event happens.
- *
- * @param event the event that happened.
- * @param data associated data.
+/* Refresh some parts of the audio state, and bump the serial
+ * if anything changed.
  */
 static void
-on_alsa_event(enum alsa_event event, gpointer data)
+audio_state_refresh(Audio *audio, guint parts)
 {
-	Audio *audio = (Audio *) data;
+	AudioState *state = &audio->state;
+	AudioState old = *state;
 
-	/* If we are responsible for this event (aka we changed the volume/mute
-	 * values beforehand), we know that we left a timestamp to indicate
-	 * when the action was performed.
-	 */
-	if (audio->last_action_timestamp != 0) {
-		gint64 last, now, delay;
+	state->card = audio_get_card(audio);
+	state->channel = audio_get_channel(audio);
 
-		last = audio->last_action_timestamp;
-		now = g_get_monotonic_time();
+	if (parts & AUDIO_STATE_PLAYBACK) {
+		state->has_mute = audio_has_mute(audio);
+		state->muted = audio_is_muted(audio);
+		state->volume = audio_get_volume(audio);
+		state->balance = audio_get_balance(audio);
+	}
 
-		/* Discard the timestamp */
-		audio->last_action_timestamp = 0;
+	if (parts & AUDIO_STATE_CAPTURE) {
+		state->has_capture = audio_has_capture(audio);
+		state->capture_has_mute = audio_capture_has_mute(audio);
+		state->capture_muted = audio_capture_is_muted(audio);
+		state->capture_volume = audio_get_capture_volume(audio);
+	}
 
-		/* The delay here is the time between the moment the action
-		 * was performed and the moment the callback was invoked.
-		 */
-		delay = now - last;
+	/* Card and channel names are compared by pointer, since the old
+	 * strings may be gone already. They're only replaced on reload.
+	 */
+	if (state->card != old.card || state->channel != old.channel ||
+	    state->has_mute != old.has_mute ||
+	    state->muted != old.muted ||
+	    state->volume != old.volume ||
+	    state->balance != old.balance ||
+	    state->has_capture != old.has_capture ||
+	    state->capture_has_mute != old.capture_has_mute ||
+	    state->capture_muted != old.capture_muted ||
+	    state->capture_volume != old.capture_volume)
+		state->serial++;
+}
 
-		/* The delay is supposed to be very quick, a matter of milliseconds.
-		 * We set its maximum delay to 1 second, it's probably far too much.
-		 * However it doesn't hurt to set it too long. On the other hand,
-		 * setting it too short could hurt.
-		 */
-		if (delay < 1000000)
-			return;
+/*
+ * Write generations.
+ * Each time we change the values, we record the state we expect, with
+ * a generation number. When the backend reports a change, the new state
+ * is matched against the pending writes: if it's one of them, it's just
+ * the echo of our own write, already dispatched, and it's dropped.
+ * Along with it, older writes are dropped as well, they're superseded.
+ */
 
-		/* In some situation we can find a timestamp that was never used */
-		DEBUG("Discarding last timestamp, too old");
-	}
+/* Record a write, from the state that was just refreshed */
+static void
+audio_record_write(Audio *audio, guint parts)
+{
+	const AudioState *state = &audio->state;
+	AudioWrite *write;
 
-	/* Here, we are not at the origin of this change.
-	 * We must invoke the handlers.
-	 */
-	switch (event) {
-	case ALSA_CARD_ERROR:
-		invoke_handlers(audio, AUDIO_CARD_ERROR, AUDIO_USER_UNKNOWN);
-		break;
-	case ALSA_CARD_DISCONNECTED:
-		invoke_handlers(audio, AUDIO_CARD_DISCONNECTED, AUDIO_USER_UNKNOWN);
-		break;
-	case ALSA_CARD_VALUES_CHANGED:
-		invoke_handlers(audio, AUDIO_VALUES_CHANGED, AUDIO_USER_UNKNOWN);
-		break;
-	default:
-		WARN("Unhandled alsa event: %d", event);
+	if (audio->n_writes == AUDIO_MAX_PENDING_WRITES) {
+		memmove(&audio->writes[0], &audio->writes[1],
+		        (AUDIO_MAX_PENDING_WRITES - 1) * sizeof(AudioWrite));
+		audio->n_writes--;
 	}
+
+	write = &audio->writes[audio->n_writes++];
+	write->generation = ++audio->generation;
+	write->time = g_get_monotonic_time();
+	write->parts = parts;
+	write->muted = state->muted;
+	write->volume = state->volume;
+	write->capture_muted = state->capture_muted;
+	write->capture_volume = state->capture_volume;
 }
 
-/**
- * Disconnect a signal handler designed by 'callback' and 'data'.
- *
- * @param audio an Audio instance.
- * @param callback the callback to disconnect.
- * @param data the data to pass to the callback.
- */
-void
-audio_signals_disconnect(Audio *audio, AudioCallback callback, gpointer data)
+/* Drop the writes that are too old to be echoed anymore */
+static void
+audio_expire_writes(Audio *audio)
 {
-	AudioHandler *handler;
+	gint64 now = g_get_monotonic_time();
+	guint i;
+
+	for (i = 0; i < audio->n_writes; i++) {
+		if (now - audio->writes[i].time < AUDIO_WRITE_TIMEOUT)
+			break;
+	}
+
+	if (i == 0)
+		return;
 
-	handler = audio_handler_new(callback, data);
-	audio->handlers = audio_handler_list_remove(audio->handlers, handler);
-	audio_handler_free(handler);
+	audio->n_writes -= i;
+	memmove(&audio->writes[0], &audio->writes[i],
+	        audio->n_writes * sizeof(AudioWrite));
 }
 
-/**
- * Connect a signal handler designed by 'callback' and 'data'.
- * Remember to always pair 'connect' calls with 'disconnect' calls,
- * otherwise you'll be in trouble.
- *
- * @param audio an Audio instance.
- * @param callback the callback to connect.
- * @param data the data to pass to the callback.
+/* Size of a hardware step of a card, in percent. The volume we read
+ * back after a write is rounded to the steps of the card, so it may be
+ * off by that much from the volume we asked.
  */
-void
-audio_signals_connect(Audio *audio, AudioCallback callback, gpointer data)
+static gdouble
+audio_step_size(BackendCard *card)
 {
-	AudioHandler *handler;
+	guint step, n_steps;
+
+	if (card == NULL)
+		return 0;
 
-	handler = audio_handler_new(callback, data);
-	audio->handlers = audio_handler_list_append(audio->handlers, handler);
+	backend_card_get_steps(card, &step, &n_steps);
+
+	return n_steps > 0 ? 100.0 / n_steps : 0;
 }
 
-/**
- * Whether the audio should be reloaded. In other words, if we're in fallback
- * mode (aka we're not operating on the preferred soundcard because it's not
- * available), we should check if the preferred soundcard is available, and
- * reload the audio in case it is. We don't want to do that too often, so we
- * maintain a timestamp of the last time we checked.
- *
- * @param audio an Audio instance.
- * @return TRUE if the audio should be reloaded, FALSE otherwise.
+/* Check if the state that was just refreshed is the echo of a pending
+ * write. If it is, this write and the older ones are dropped. Volumes
+ * match when they're within one hardware step.
  */
 static gboolean
-audio_should_reload(Audio *audio)
+audio_match_write(Audio *audio, guint parts)
 {
-	gboolean ret = FALSE;
-	gint64 last, now;
+	const AudioState *state = &audio->state;
+	gdouble tolerance, capture_tolerance;
+	guint i;
 
-	/* If we're not in fallback mode, bail out */
-	if (audio->fallback == FALSE)
-		return FALSE;
+	audio_expire_writes(audio);
 
-	/* Check only if the last check was done more than 10 secs ago */
-	last = audio->fallback_last_check;
-	now = g_get_monotonic_time();
-	if (now - last > 10000000) {
-		gchar *cardname = prefs_get_string("AlsaCard", NULL);
-		GSList *cards = alsa_list_cards();
-		GSList *item = g_slist_find_custom(cards, cardname,
-						   (GCompareFunc) g_strcmp0);
-
-		if (item) {
-			DEBUG("Preferred card available, audio should be reloaded");
-			ret = TRUE;
-		}
-		g_free(cardname);
-		g_slist_free_full(cards, g_free);
+	tolerance = audio_step_size(audio->soundcard);
+	capture_tolerance = audio_step_size(audio->capture);
+
+	for (i = audio->n_writes; i > 0; i--) {
+		const AudioWrite *write = &audio->writes[i - 1];
+
+		if ((write->parts & parts) != parts)
+			continue;
 
-		audio->fallback_last_check = now;
+		if (parts & AUDIO_STATE_PLAYBACK &&
+		    (write->muted != state->muted ||
+		     ABS(write->volume - state->volume) > tolerance))
+			continue;
+
+		if (parts & AUDIO_STATE_CAPTURE &&
+		    (write->capture_muted != state->capture_muted ||
+		     ABS(write->capture_volume - state->capture_volume) >
+		     capture_tolerance))
+			continue;
+
+		DEBUG("Echo of write #%u, dropping it", write->generation);
+
+		audio->n_writes -= i;
+		memmove(&audio->writes[0], &audio->writes[i],
+		        audio->n_writes * sizeof(AudioWrite));
+		return TRUE;
 	}
 
-	return ret;
+	return FALSE;
 }
 
-/**
- * Get the name of the card currently hooked.
- * This is an internal string that shouldn't be modified.
- *
- * @param audio an Audio instance.
- * @return the name of the card.
- */
-const char *
-audio_get_card(Audio *audio)
+/* Invoke the handlers of a single instance */
+static void
+dispatch_handlers(Audio *audio, const AudioEvent *event)
 {
-	return audio->card;
+	guint i;
+
+	if (audio->handlers == NULL)
+		return;
+
+	/* Handlers may connect or disconnect during the dispatch, and the
+	 * array may be reallocated, so don't keep pointers around.
+	 */
+	for (i = 0; i < audio->handlers->len; i++) {
+		AudioHandler handler = g_array_index(audio->handlers, AudioHandler, i);
+
+		if (!audio_handler_wants(&handler, event))
+			continue;
+
+		handler.callback(audio, event, handler.data);
+	}
 }
 
-/**
- * Get the name of the channel currently in use.
- * This is an internal string that shouldn't be modified.
- *
- * @param audio a Audio instance.
- * @return the name of the channel.
+/* Dispatch a signal with the current state. The active card instance
+ * speaks for the main instance as well, so the handlers of both are
+ * invoked, with the same state.
  */
-const char *
-audio_get_channel(Audio *audio)
+static void
+dispatch_signal(Audio *audio, AudioSignal signal, AudioUser user)
 {
-	return audio->channel;
+	const AudioState *state = &audio->state;
+	AudioEvent event;
+
+	event.signal = signal;
+	event.user = user;
+	event.state = state;
+
+	DEBUG("** Dispatching signal '%s' from '%s', vol=%lg, has_mute=%s, muted=%s, "
+	      "capture vol=%lg, capture muted=%s (state #%u)",
+	      audio_signal_to_str(signal), audio_user_to_str(user),
+	      state->volume, state->has_mute ? "yes" : "no", state->muted ? "yes" : "no",
+	      state->capture_volume, state->capture_muted ? "yes" : "no", state->serial);
+
+	dispatch_handlers(audio, &event);
+
+	if (audio->parent && audio->parent->active == audio)
+		dispatch_handlers(audio->parent, &event);
 }
 
 /**
- * Whether the card has mute capabilities.
+ * Convenient function to invoke the handlers.
+ * The audio state is refreshed first, according to the signal.
+ * If it's about values we changed ourselves, the new state is recorded
+ * as a pending write, so that we recognize its echo later on.
  *
  * @param audio an Audio instance.
- * @return TRUE if the card can be muted, FALSE otherwise.
+ * @param signal the signal to dispatch.
+ * @param user the user that made the action.
  */
-gboolean
-audio_has_mute(Audio *audio)
+static void
+invoke_handlers(Audio *audio, AudioSignal signal, AudioUser user)
 {
-	AlsaCard *soundcard;
+	guint parts = audio_state_parts(signal);
 
-	if (audio_should_reload(audio))
-		audio_reload(audio);
+	audio_state_refresh(audio, parts);
 
-	soundcard = audio->soundcard;
-	if (!soundcard)
-		return FALSE;
+	if (user != AUDIO_USER_UNKNOWN &&
+	    (signal == AUDIO_VALUES_CHANGED || signal == AUDIO_CAPTURE_VALUES_CHANGED))
+		audio_record_write(audio, parts);
 
-	return alsa_card_has_mute(soundcard);
+	dispatch_signal(audio, signal, user);
 }
 
-/**
- * Get the mute state, either TRUE or FALSE.
- *
- * @param audio an Audio instance.
- * @return TRUE if the card is muted, FALSE otherwise.
+/* Stop the ramp of a card instance, if any. The volume stays where the
+ * ramp left it, and a fade-out is forgotten.
  */
-gboolean
-audio_is_muted(Audio *audio)
+static void
+audio_cancel_ramp(Audio *audio)
 {
-	AlsaCard *soundcard;
-
-	if (audio_should_reload(audio))
-		audio_reload(audio);
+	audio->faded = FALSE;
 
-	soundcard = audio->soundcard;
-	if (!soundcard)
-		return TRUE;
+	if (!audio->ramp.active)
+		return;
 
-	return alsa_card_is_muted(soundcard);
+	DEBUG("Volume ramp of '%s' cancelled", audio->card);
+	audio->ramp.active = FALSE;
 }
 
-/**
- * Toggle the mute state.
- *
- * @param audio an Audio instance.
- * @param user the user who performs the action.
+/* Check if someone else took over the volume while a ramp is going on.
+ * Our own writes may come back a little off, rounded to the hardware
+ * steps, hence the tolerance.
  */
-void
-audio_toggle_mute(Audio *audio, AudioUser user)
+static void
+audio_check_ramp(Audio *audio)
 {
-	AlsaCard *soundcard;
+	const AudioState *state = &audio->state;
+	gdouble tolerance;
 
-	if (audio_should_reload(audio))
-		audio_reload(audio);
-
-	soundcard = audio->soundcard;
-	if (!soundcard)
+	if (!audio->ramp.active || audio->soundcard == NULL)
 		return;
 
-	/* Leave a trace */
-	audio->last_action_timestamp = g_get_real_time();
+	tolerance = MAX(AUDIO_RAMP_TOLERANCE, audio_step_size(audio->soundcard));
 
-	/* Toggle mute state */
-	alsa_card_toggle_mute(soundcard);
+	if (state->muted == audio->ramp.muted &&
+	    ABS(state->volume - audio->ramp.last) <= tolerance)
+		return;
 
-	/* Invoke the handlers */
-	invoke_handlers(audio, AUDIO_VALUES_CHANGED, user);
+	DEBUG("Volume changed by someone else during a ramp");
+	audio_cancel_ramp(audio);
 }
 
-/**
- * Get the volume in percent (value between 0 and 100).
- *
- * @param audio an Audio instance.
- * @return the volume in percent.
+/* Invoke the handlers for values changed by someone else, unless it's
+ * the echo of one of our own writes.
  */
-gdouble
-audio_get_volume(Audio *audio)
+static void
+invoke_handlers_external(Audio *audio, AudioSignal signal)
 {
-	AlsaCard *soundcard;
-	gdouble volume;
+	guint parts = audio_state_parts(signal);
+	guint serial = audio->state.serial;
 
-	if (audio_should_reload(audio))
-		audio_reload(audio);
+	audio_state_refresh(audio, parts);
 
-	soundcard = audio->soundcard;
-	if (!soundcard)
-		return 0;
+	if (audio_match_write(audio, parts)) {
+		audio->n_echoes++;
+		DEBUG("Echo suppressed (%u echoes, %u duplicates so far)",
+		      audio->n_echoes, audio->n_duplicates);
+		return;
+	}
 
-	volume = alsa_card_get_volume(soundcard);
+	/* Someone else may be taking over a ramp */
+	if (parts & AUDIO_STATE_PLAYBACK)
+		audio_check_ramp(audio);
 
-	/* With PulseAudio, it is perfectly possible for the volume to go above 100%.
-	 * Since we don't really expect or handle that, let's clip it right now.
+	/* Not an echo, but nothing changed either. It gets through, since
+	 * we can't tell what it's about, but we keep an eye on it.
 	 */
-	if (volume < 0)
-		volume = 0;
-	if (volume > 100)
-		volume = 100;
+	if (audio->state.serial == serial) {
+		audio->n_duplicates++;
+		DEBUG("Duplicate dispatch (%u echoes, %u duplicates so far)",
+		      audio->n_echoes, audio->n_duplicates);
+	}
 
-	return volume;
+	dispatch_signal(audio, signal, AUDIO_USER_UNKNOWN);
 }
 
-/**
- * Set the volume.
- *
- * @param audio an Audio instance.
- * @param user the user who performs the action.
- * @param cur_volume the current volume value, in percent.
- * @param new_volume the volume value to set, in percent.
- * @param dir the direction for the volume change
- *        (-1: lowering, +1: raising, 0: setting).
- */
-void
-_audio_set_volume(Audio *audio, AudioUser user, gdouble cur_volume,
-                  gdouble new_volume, gint dir)
+/* Dispatch the changes that were deferred */
+static gboolean
+audio_flush_deferred(gpointer data)
 {
-	AlsaCard *soundcard = audio->soundcard;
+	Audio *audio = (Audio *) data;
+	guint parts = audio->deferred;
 
-	/* Set the volume */
-	DEBUG("Setting volume from %lg to %lg (dir: %d)",
-	      cur_volume, new_volume, dir);
-	alsa_card_set_volume(soundcard, new_volume, dir);
+	audio->deferred = 0;
+	audio->deferred_id = 0;
 
-	/* Automatically unmute the volume */
-	if (alsa_card_is_muted(soundcard))
-		alsa_card_toggle_mute(soundcard);
+	if (parts & AUDIO_STATE_PLAYBACK)
+		invoke_handlers_external(audio, AUDIO_VALUES_CHANGED);
+	if (parts & AUDIO_STATE_CAPTURE)
+		invoke_handlers_external(audio, AUDIO_CAPTURE_VALUES_CHANGED);
 
-	/* Check if the volume really changed. If it doesn't,
-	 * there's no need to invoke any handlers. It also means
-	 * that no alsa callback will be triggered, so we don't
-	 * save the 'last_action_timestamp'.
-	 */
-	new_volume = alsa_card_get_volume(soundcard);
-	if (new_volume == cur_volume)
-		return;
+	return G_SOURCE_REMOVE;
+}
 
-	/* Leave a trace */
-	audio->last_action_timestamp = g_get_real_time();
+/* Forget about the changes that were deferred */
+static void
+audio_cancel_deferred(Audio *audio)
+{
+	if (audio->deferred_id)
+		g_source_remove(audio->deferred_id);
+
+	audio->deferred = 0;
+	audio->deferred_id = 0;
+}
+
+/**
+ * Invoke the handlers for a change of values made by someone else.
+ * Such changes may come in storms, when another application ramps the
+ * volume, and there's no point redrawing everything for each of them.
+ * So the change is just recorded, and the handlers are invoked once
+ * per update interval, with the latest state.
+ *
+ * @param audio an Audio instance.
+ * @param signal the signal to dispatch, AUDIO_VALUES_CHANGED or
+ *        AUDIO_CAPTURE_VALUES_CHANGED.
+ */
+static void
+invoke_handlers_deferred(Audio *audio, AudioSignal signal)
+{
+	if (audio->update_interval == 0) {
+		invoke_handlers_external(audio, signal);
+		return;
+	}
+
+	audio->deferred |= audio_state_parts(signal);
+
+	if (audio->deferred_id == 0)
+		audio->deferred_id = g_timeout_add(audio->update_interval,
+		                                   audio_flush_deferred, audio);
+}
+
+/**
+ * Unhook the currently hooked audio card.
+ *
+ * @param audio an Audio instance.
+ */
+static void
+audio_unhook_soundcard(Audio *audio)
+{
+	if (audio->soundcard == NULL)
+		return;
+
+	DEBUG("Unhooking soundcard from the audio system");
+
+	/* Pending changes, writes and ramps are meaningless now */
+	audio_cancel_deferred(audio);
+	audio_cancel_ramp(audio);
+	audio->n_writes = 0;
+
+	/* Free the soundcard, capture side first */
+	backend_card_free(audio->capture);
+	audio->capture = NULL;
+	backend_card_free(audio->soundcard);
+	audio->soundcard = NULL;
+
+	/* Invoke user handlers */
+	invoke_handlers(audio, AUDIO_CARD_CLEANED_UP, AUDIO_USER_UNKNOWN);
+}
+
+/**
+ * Callback invoked when a card event happens.
+ * The backend only reports changes on the mixer elem we use, and it
+ * already knows about the changes we made ourselves. So if we get there,
+ * someone else changed something.
+ *
+ * @param event the event that happened.
+ * @param changes mask of what changed (BACKEND_CHANGE_* values).
+ * @param data associated data.
+ */
+static void
+on_card_event(enum backend_event event, guint changes, gpointer data)
+{
+	Audio *audio = (Audio *) data;
+	Audio *owner = audio->parent ? audio->parent : audio;
+
+	DEBUG("Card event %d (changes: 0x%x)", event, changes);
+
+	/* Handlers may ask for a reload, it must wait: it would free
+	 * the card that is reporting this event.
+	 */
+	owner->in_card_event++;
+
+	/* Here, we are not at the origin of this change.
+	 * We must invoke the handlers.
+	 */
+	switch (event) {
+	case BACKEND_CARD_ERROR:
+	case BACKEND_CARD_DISCONNECTED:
+		/* The card must be reopened on the next reload */
+		g_free(audio->settings);
+		audio->settings = NULL;
+
+		invoke_handlers(audio, event == BACKEND_CARD_ERROR ?
+		                AUDIO_CARD_ERROR : AUDIO_CARD_DISCONNECTED,
+		                AUDIO_USER_UNKNOWN);
+
+		/* Only the active card triggers a reload. The others
+		 * are just unhooked, until the next reload.
+		 */
+		if (audio->parent && audio->parent->active != audio)
+			audio_unhook_soundcard(audio);
+		break;
+	case BACKEND_CARD_VALUES_CHANGED:
+		invoke_handlers_deferred(audio, AUDIO_VALUES_CHANGED);
+		break;
+	default:
+		WARN("Unhandled card event: %d", event);
+	}
+
+	owner->in_card_event--;
+}
+
+/**
+ * Callback invoked when a card event happens on the capture side.
+ * Same as on_card_event(), except that losing the capture side is not
+ * a reason to reload everything: we just forget about it.
+ *
+ * @param event the event that happened.
+ * @param changes mask of what changed (BACKEND_CHANGE_* values).
+ * @param data associated data.
+ */
+static void
+on_capture_event(enum backend_event event, guint changes, gpointer data)
+{
+	Audio *audio = (Audio *) data;
+
+	DEBUG("Capture event %d (changes: 0x%x)", event, changes);
+
+	switch (event) {
+	case BACKEND_CARD_ERROR:
+	case BACKEND_CARD_DISCONNECTED:
+		backend_card_free(audio->capture);
+		audio->capture = NULL;
+		invoke_handlers(audio, AUDIO_CAPTURE_VALUES_CHANGED, AUDIO_USER_UNKNOWN);
+		break;
+	case BACKEND_CARD_VALUES_CHANGED:
+		invoke_handlers_deferred(audio, AUDIO_CAPTURE_VALUES_CHANGED);
+		break;
+	default:
+		WARN("Unhandled capture event: %d", event);
+	}
+}
+
+/**
+ * Disconnect a signal handler.
+ *
+ * @param audio an Audio instance.
+ * @param id the handler id, as returned when it was connected.
+ */
+void
+audio_signals_disconnect(Audio *audio, guint id)
+{
+	AudioHandler *handler;
+	gint index = AUDIO_HANDLER_INDEX(id);
+
+	if (audio->handlers == NULL || index < 0 ||
+	    (guint) index >= audio->handlers->len) {
+		WARN("Audio handler %u doesn't exist", id);
+		return;
+	}
+
+	handler = &g_array_index(audio->handlers, AudioHandler, index);
+	if (handler->callback == NULL || handler->seq != AUDIO_HANDLER_SEQ(id)) {
+		WARN("Audio handler %u was already disconnected", id);
+		return;
+	}
+
+	/* Free the slot */
+	handler->callback = NULL;
+	handler->data = NULL;
+	handler->next_free = audio->free_handler;
+	audio->free_handler = index;
+}
+
+/**
+ * Get the counters of the changes reported by the card in use, that
+ * were not dispatched as they were: echoes of our own writes, that
+ * were dropped, and changes dispatched although nothing changed.
+ *
+ * @param audio an Audio instance.
+ * @param n_echoes where to store the number of echoes, or NULL.
+ * @param n_duplicates where to store the number of duplicates, or NULL.
+ */
+void
+audio_get_dispatch_counters(Audio *audio, guint *n_echoes, guint *n_duplicates)
+{
+	audio = audio_target(audio);
+
+	if (n_echoes)
+		*n_echoes = audio->n_echoes;
+	if (n_duplicates)
+		*n_duplicates = audio->n_duplicates;
+}
+
+/**
+ * Connect a signal handler designed by 'callback' and 'data', that is
+ * only invoked for some signals, coming from some users, and only
+ * if 'visible' returns TRUE.
+ * Remember to always pair 'connect' calls with 'disconnect' calls,
+ * otherwise you'll be in trouble.
+ *
+ * @param audio an Audio instance.
+ * @param callback the callback to connect.
+ * @param data the data to pass to the callback.
+ * @param signals a mask of AUDIO_SIGNAL_MASK() values.
+ * @param users a mask of AUDIO_USER_MASK() values.
+ * @param visible a function that tells if 'data' needs to be updated,
+ *        or NULL to always invoke the callback.
+ * @return the handler id, to be given to audio_signals_disconnect().
+ */
+guint
+audio_signals_connect_full(Audio *audio, AudioCallback callback, gpointer data,
+                           guint signals, guint users, AudioVisibleFunc visible)
+{
+	AudioHandler *handler;
+	gint index;
+
+	g_return_val_if_fail(callback != NULL, 0);
+
+	if (audio->handlers == NULL) {
+		audio->handlers = g_array_new(FALSE, TRUE, sizeof(AudioHandler));
+		audio->free_handler = -1;
+	}
+
+	/* Reuse a free slot if any, otherwise grow the array */
+	if (audio->free_handler >= 0) {
+		index = audio->free_handler;
+		handler = &g_array_index(audio->handlers, AudioHandler, index);
+		audio->free_handler = handler->next_free;
+		handler->seq++;
+	} else {
+		g_return_val_if_fail(audio->handlers->len < AUDIO_MAX_HANDLERS, 0);
+		index = audio->handlers->len;
+		g_array_set_size(audio->handlers, index + 1);
+		handler = &g_array_index(audio->handlers, AudioHandler, index);
+	}
+
+	handler->callback = callback;
+	handler->data = data;
+	handler->signals = signals;
+	handler->users = users;
+	handler->visible = visible;
+	handler->next_free = -1;
+
+	return AUDIO_HANDLER_ID(index, handler->seq);
+}
+
+/**
+ * Connect a signal handler designed by 'callback' and 'data', that is
+ * invoked for every signal.
+ * Remember to always pair 'connect' calls with 'disconnect' calls,
+ * otherwise you'll be in trouble.
+ *
+ * @param audio an Audio instance.
+ * @param callback the callback to connect.
+ * @param data the data to pass to the callback.
+ * @return the handler id, to be given to audio_signals_disconnect().
+ */
+guint
+audio_signals_connect(Audio *audio, AudioCallback callback, gpointer data)
+{
+	return audio_signals_connect_full(audio, callback, data,
+	                                  AUDIO_ALL_SIGNALS, AUDIO_ALL_USERS, NULL);
+}
+
+/**
+ * Get the name of the card currently hooked.
+ * This is an internal string that shouldn't be modified.
+ *
+ * @param audio an Audio instance.
+ * @return the name of the card.
+ */
+const char *
+audio_get_card(Audio *audio)
+{
+	return audio_target(audio)->card;
+}
+
+/**
+ * Get the name of the channel currently in use.
+ * This is an internal string that shouldn't be modified.
+ *
+ * @param audio a Audio instance.
+ * @return the name of the channel.
+ */
+const char *
+audio_get_channel(Audio *audio)
+{
+	return audio_target(audio)->channel;
+}
+
+/**
+ * Whether the card has mute capabilities.
+ *
+ * @param audio an Audio instance.
+ * @return TRUE if the card can be muted, FALSE otherwise.
+ */
+gboolean
+audio_has_mute(Audio *audio)
+{
+	BackendCard *soundcard;
+
+	audio = audio_target(audio);
+	soundcard = audio->soundcard;
+	if (!soundcard)
+		return FALSE;
+
+	return backend_card_has_mute(soundcard);
+}
+
+/**
+ * Get the mute state, either TRUE or FALSE.
+ *
+ * @param audio an Audio instance.
+ * @return TRUE if the card is muted, FALSE otherwise.
+ */
+gboolean
+audio_is_muted(Audio *audio)
+{
+	BackendCard *soundcard;
+
+	audio = audio_target(audio);
+	soundcard = audio->soundcard;
+	if (!soundcard)
+		return TRUE;
+
+	return backend_card_is_muted(soundcard);
+}
+
+/**
+ * Toggle the mute state.
+ * If 'MuteFadeDuration' is set, the volume fades out before muting,
+ * and fades in after unmuting. Toggling during a fade-out fades back in.
+ *
+ * @param audio an Audio instance.
+ * @param user the user who performs the action.
+ */
+void
+audio_toggle_mute(Audio *audio, AudioUser user)
+{
+	BackendCard *soundcard;
+
+	audio = audio_target(audio);
+	soundcard = audio->soundcard;
+	if (!soundcard)
+		return;
+
+	if (audio->mute_fade > 0) {
+		if (audio->faded || backend_card_is_muted(soundcard) ||
+		    (audio->ramp.active && audio->ramp.mute))
+			audio_fade_in(audio, user, audio->mute_fade);
+		else
+			audio_fade_out(audio, user, audio->mute_fade);
+		return;
+	}
+
+	/* The user takes over */
+	audio_cancel_ramp(audio);
+
+	/* Toggle mute state */
+	backend_card_toggle_mute(soundcard);
+
+	/* Invoke the handlers */
+	invoke_handlers(audio, AUDIO_VALUES_CHANGED, user);
+}
+
+/**
+ * Get the volume in percent (value between 0 and 100).
+ *
+ * @param audio an Audio instance.
+ * @return the volume in percent.
+ */
+gdouble
+audio_get_volume(Audio *audio)
+{
+	BackendCard *soundcard;
+	gdouble volume;
+
+	audio = audio_target(audio);
+	soundcard = audio->soundcard;
+	if (!soundcard)
+		return 0;
+
+	volume = backend_card_get_volume(soundcard);
+
+	/* With PulseAudio, it is perfectly possible for the volume to go above 100%.
+	 * Since we don't really expect or handle that, let's clip it right now.
+	 */
+	if (volume < 0)
+		volume = 0;
+	if (volume > 100)
+		volume = 100;
+
+	return volume;
+}
+
+/* Apply a transaction to a card of an instance, the playback or the
+ * capture one, and invoke the handlers with 'signal' if something changed.
+ */
+static void
+audio_apply_card_transaction(Audio *audio, BackendCard *card, AudioSignal signal,
+                             AudioUser user, const AudioTransaction *trans)
+{
+	BackendTransaction backend_trans = { 0 };
+	guint i, j;
+
+	/* Volume steps are given in scroll steps */
+	backend_trans.n_ops = MIN(trans->n_ops, BACKEND_MAX_OPS);
+	for (i = 0; i < backend_trans.n_ops; i++) {
+		const AudioOp *op = &trans->ops[i];
+		BackendOp *backend_op = &backend_trans.ops[i];
+
+		backend_op->dir = op->dir;
+		backend_op->muted = op->muted;
+		backend_op->value = op->value;
+
+		switch (op->type) {
+		case AUDIO_OP_SET_VOLUME:
+			backend_op->type = BACKEND_OP_SET_VOLUME;
+			break;
+		case AUDIO_OP_STEP_VOLUME:
+			backend_op->type = BACKEND_OP_STEP_VOLUME;
+			backend_op->value = op->value * audio->scroll_step;
+			break;
+		case AUDIO_OP_SET_STEP:
+			backend_op->type = BACKEND_OP_SET_STEP;
+			break;
+		case AUDIO_OP_SET_VOLUMES:
+			backend_op->type = BACKEND_OP_SET_VOLUMES;
+			backend_op->volumes.n_channels = MIN(op->volumes.n_channels,
+			                                     BACKEND_MAX_CHANNELS);
+			for (j = 0; j < backend_op->volumes.n_channels; j++)
+				backend_op->volumes.volume[j] = op->volumes.volume[j];
+			break;
+		case AUDIO_OP_SET_MUTE:
+			backend_op->type = BACKEND_OP_SET_MUTE;
+			break;
+		}
+	}
+
+	/* If nothing changed, there's no need to invoke any handlers */
+	if (!backend_card_apply(card, &backend_trans))
+		return;
 
 	/* Invoke handlers manually.
-	 * In theory, we could skip this step, since the Alsa callback
-	 * will be triggered anyway after the volume change is effective,
-	 * and we could invoke the handlers at this moment.
-	 * In practice, relying on the Alsa callback is not so reliable.
+	 * The Alsa callback won't be triggered for this change, since
+	 * the alsa layer filters out the changes we made ourselves.
+	 * Anyway, relying on the Alsa callback is not so reliable.
 	 * It seems that it's kind of broken if PulseAudio is running.
 	 * So, invoking the handlers at this point makes PNMixer more robust.
 	 */
-	invoke_handlers(audio, AUDIO_VALUES_CHANGED, user);
+	invoke_handlers(audio, signal, user);
+}
+
+/* Apply a transaction to the playback card of an instance */
+static void
+audio_apply_transaction(Audio *audio, AudioUser user, const AudioTransaction *trans)
+{
+	audio_apply_card_transaction(audio, audio->soundcard, AUDIO_VALUES_CHANGED,
+	                             user, trans);
+}
+
+/**
+ * Apply a transaction: a few operations on the volume and the mute state,
+ * sent to the card in one go. Handlers are invoked once, and only if
+ * something really changed. A volume ramp in progress is cancelled.
+ *
+ * @param audio an Audio instance.
+ * @param user the user who performs the action.
+ * @param trans the operations to apply.
+ */
+void
+audio_apply(Audio *audio, AudioUser user, const AudioTransaction *trans)
+{
+	audio = audio_target(audio);
+	if (!audio->soundcard)
+		return;
+
+	/* The user takes over */
+	audio_cancel_ramp(audio);
+
+	audio_apply_transaction(audio, user, trans);
+}
+
+/* Change the volume and unmute, in one transaction */
+static void
+audio_apply_volume(Audio *audio, AudioUser user, AudioOpType type,
+                   gdouble value, gint dir)
+{
+	AudioTransaction trans = { 0 };
+
+	DEBUG("Changing volume: %s %lg (dir: %d)",
+	      type == AUDIO_OP_STEP_VOLUME ? "step" : "set", value, dir);
+
+	trans.ops[trans.n_ops].type = type;
+	trans.ops[trans.n_ops].value = value;
+	trans.ops[trans.n_ops].dir = dir;
+	trans.n_ops++;
+
+	/* Automatically unmute the volume */
+	trans.ops[trans.n_ops].type = AUDIO_OP_SET_MUTE;
+	trans.ops[trans.n_ops].muted = FALSE;
+	trans.n_ops++;
+
+	audio_apply(audio, user, &trans);
+}
+
+/**
+ * Set the volume, unmuting if needed.
+ *
+ * @param audio an Audio instance.
+ * @param user the user who performs the action.
+ * @param new_volume the volume value to set, in percent.
+ * @param dir the direction for the volume change
+ *        (-1: lowering, +1: raising, 0: setting).
+ */
+void
+audio_set_volume(Audio *audio, AudioUser user, gdouble new_volume, gint dir)
+{
+	audio_apply_volume(audio, user, AUDIO_OP_SET_VOLUME, new_volume, dir);
+}
+
+/* Get the number of scroll steps to move the volume by.
+ * Steps that come in a burst, like a flick of the mouse wheel or a key
+ * held down, grow with each step, so that the volume gets where the user
+ * wants with fewer writes. A burst is made of steps from the same user,
+ * on the same side (playback or capture), in the same direction, less
+ * than 'ScrollAccelInterval' ms apart. The
+ * step grows by 'ScrollAccelFactor' times 'ScrollStep' for each step of
+ * the burst, up to 'ScrollAccelMax' times 'ScrollStep'.
+ */
+static gdouble
+audio_accel_steps(Audio *audio, AudioUser user, BackendStream stream, gint dir)
+{
+	gint64 now = g_get_monotonic_time();
+	gdouble steps;
+
+	if (audio->accel_interval > 0 && audio->accel_user == user &&
+	    audio->accel_stream == stream && audio->accel_dir == dir &&
+	    now - audio->accel_time <= audio->accel_interval * (gint64) 1000)
+		audio->accel_streak++;
+	else
+		audio->accel_streak = 0;
+
+	audio->accel_time = now;
+	audio->accel_user = user;
+	audio->accel_stream = stream;
+	audio->accel_dir = dir;
+
+	steps = MIN(1 + audio->accel_factor * audio->accel_streak, audio->accel_max);
+
+	if (audio->accel_streak > 0)
+		DEBUG("Volume step #%u of a burst, x%lg", audio->accel_streak, steps);
+
+	return steps;
+}
+
+/**
+ * Lower the volume. The step grows when the volume is lowered several
+ * times in a row, quickly.
+ *
+ * @param audio an Audio instance.
+ * @param user the user who performs the action.
+ */
+void
+audio_lower_volume(Audio *audio, AudioUser user)
+{
+	gdouble steps;
+
+	audio = audio_target(audio);
+	if (!audio->soundcard)
+		return;
+
+	steps = audio_accel_steps(audio, user, BACKEND_STREAM_PLAYBACK, -1);
+	audio_apply_volume(audio, user, AUDIO_OP_STEP_VOLUME, -steps, -1);
+}
+
+/**
+ * Raise the volume. The step grows when the volume is raised several
+ * times in a row, quickly.
+ *
+ * @param audio an Audio instance.
+ * @param user the user who performs the action.
+ */
+void
+audio_raise_volume(Audio *audio, AudioUser user)
+{
+	gdouble steps;
+
+	audio = audio_target(audio);
+	if (!audio->soundcard)
+		return;
+
+	steps = audio_accel_steps(audio, user, BACKEND_STREAM_PLAYBACK, +1);
+	audio_apply_volume(audio, user, AUDIO_OP_STEP_VOLUME, +steps, +1);
+}
+
+/*
+ * Volume ramps.
+ * A ramp moves the volume of a card to a target over some time. All the
+ * ramps are driven by a single timer of the main instance, that runs only
+ * while some ramps are active. Each tick makes one write per card at most,
+ * and never more often than the 'MinWriteInterval' of the card, so that
+ * slow mixers are not flooded. A ramp is cancelled when the user changes
+ * the volume, or when someone else does.
+ */
+
+/* Move the volume of a card instance along its ramp */
+static void
+audio_ramp_tick(Audio *audio, gint64 now)
+{
+	AudioRamp *ramp = &audio->ramp;
+	AudioTransaction trans = { 0 };
+	gdouble progress, volume;
+	gint dir;
+
+	if (now - ramp->last_time < audio->write_interval * (gint64) 1000)
+		return;
+
+	progress = 1;
+	if (ramp->duration > 0)
+		progress = MIN((now - ramp->start) / (ramp->duration * 1000.0), 1);
+
+	volume = ramp->from + (ramp->to - ramp->from) * progress;
+	dir = ramp->to > ramp->from ? +1 : -1;
+
+	if (progress < 1 || !ramp->mute) {
+		trans.ops[trans.n_ops].type = AUDIO_OP_SET_VOLUME;
+		trans.ops[trans.n_ops].value = volume;
+		trans.ops[trans.n_ops].dir = dir;
+		trans.n_ops++;
+	} else if (backend_card_has_mute(audio->soundcard)) {
+		/* Fade-out done: mute, and get the volume back */
+		trans.ops[trans.n_ops].type = AUDIO_OP_SET_MUTE;
+		trans.ops[trans.n_ops].muted = TRUE;
+		trans.n_ops++;
+		trans.ops[trans.n_ops].type = AUDIO_OP_SET_VOLUME;
+		trans.ops[trans.n_ops].value = ramp->restore;
+		trans.n_ops++;
+	} else {
+		/* Fade-out done, without a mute switch: stay at zero, and
+		 * keep the volume for the next fade-in.
+		 */
+		trans.ops[trans.n_ops].type = AUDIO_OP_SET_VOLUME;
+		trans.ops[trans.n_ops].value = 0;
+		trans.ops[trans.n_ops].dir = -1;
+		trans.n_ops++;
+		audio->faded = TRUE;
+		audio->faded_volume = ramp->restore;
+	}
+
+	if (progress >= 1) {
+		DEBUG("Volume ramp of '%s' done", audio->card);
+		ramp->active = FALSE;
+	}
+
+	ramp->last = volume;
+	ramp->last_time = now;
+
+	audio_apply_transaction(audio, ramp->user, &trans);
+}
+
+/* Tick of the ramp scheduler, for every card instance */
+static gboolean
+on_ramp_timeout(Audio *audio)
+{
+	gint64 now = g_get_monotonic_time();
+	gboolean active = FALSE;
+	GSList *item;
+
+	for (item = audio->cards; item; item = item->next) {
+		Audio *instance = item->data;
+
+		if (!instance->ramp.active)
+			continue;
+
+		audio_ramp_tick(instance, now);
+		active |= instance->ramp.active;
+	}
+
+	if (active)
+		return G_SOURCE_CONTINUE;
+
+	DEBUG("No more volume ramps, stopping the scheduler");
+	audio->ramp_id = 0;
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Start a ramp on a card instance, and the scheduler if needed */
+static void
+audio_start_ramp(Audio *audio, AudioUser user, gdouble from, gdouble to,
+                 guint duration, gboolean mute)
+{
+	Audio *parent = audio->parent;
+	AudioRamp *ramp = &audio->ramp;
+
+	DEBUG("Volume ramp of '%s' from %lg to %lg in %u ms%s", audio->card,
+	      from, to, duration, mute ? ", then mute" : "");
+
+	ramp->active = TRUE;
+	ramp->user = user;
+	ramp->from = from;
+	ramp->to = CLAMP(to, 0, 100);
+	ramp->start = g_get_monotonic_time();
+	ramp->duration = duration;
+	ramp->muted = backend_card_is_muted(audio->soundcard);
+	ramp->mute = mute;
+	ramp->restore = from;
+	ramp->last = from;
+	ramp->last_time = 0;
+
+	if (parent->ramp_id == 0)
+		parent->ramp_id = g_timeout_add(AUDIO_RAMP_TICK,
+		                                (GSourceFunc) on_ramp_timeout, parent);
+}
+
+/**
+ * Ramp the volume to a given value over some time. A ramp in progress
+ * is replaced, from where it is. The mute state is left alone.
+ *
+ * @param audio an Audio instance.
+ * @param user the user who performs the action.
+ * @param volume the volume to reach, in percent.
+ * @param duration the duration of the ramp, in ms.
+ */
+void
+audio_ramp_volume(Audio *audio, AudioUser user, gdouble volume, guint duration)
+{
+	audio = audio_target(audio);
+	if (!audio->soundcard)
+		return;
+
+	audio_cancel_ramp(audio);
+	audio_start_ramp(audio, user, backend_card_get_volume(audio->soundcard),
+	                 volume, duration, FALSE);
+}
+
+/**
+ * Whether a volume ramp is going on. For a card instance, that's the
+ * ramp of the card. For the main instance, that's whether the ramp
+ * scheduler runs: it stops at the first tick without any active ramp.
+ *
+ * @param audio an Audio instance.
+ * @return TRUE if a ramp is going on, FALSE otherwise.
+ */
+gboolean
+audio_is_ramping(Audio *audio)
+{
+	if (audio->parent == NULL)
+		return audio->ramp_id != 0;
+
+	return audio->ramp.active;
+}
+
+/**
+ * Fade the volume out, then mute. Once muted, the volume is set back
+ * to what it was, so that unmuting gets it back. Cards without a mute
+ * switch are left at zero, and audio_fade_in() gets the volume back.
+ *
+ * @param audio an Audio instance.
+ * @param user the user who performs the action.
+ * @param duration the duration of the fade, in ms.
+ */
+void
+audio_fade_out(Audio *audio, AudioUser user, guint duration)
+{
+	BackendCard *soundcard;
+	gdouble restore;
+
+	audio = audio_target(audio);
+	soundcard = audio->soundcard;
+	if (!soundcard)
+		return;
+
+	/* Nothing to fade out */
+	if (audio->faded || backend_card_is_muted(soundcard) ||
+	    (audio->ramp.active && audio->ramp.mute))
+		return;
+
+	/* If a ramp is going on, the volume to get back is the one
+	 * it was heading to.
+	 */
+	restore = audio->ramp.active ? audio->ramp.to :
+	          backend_card_get_volume(soundcard);
+
+	audio_cancel_ramp(audio);
+	audio_start_ramp(audio, user, backend_card_get_volume(soundcard),
+	                 0, duration, TRUE);
+	audio->ramp.restore = restore;
+}
+
+/**
+ * Unmute and fade the volume in, from zero to the volume the card had.
+ * On cards without a mute switch, that's the volume before the last
+ * audio_fade_out(). A fade-out in progress is reversed, from where
+ * it is.
+ *
+ * @param audio an Audio instance.
+ * @param user the user who performs the action.
+ * @param duration the duration of the fade, in ms.
+ */
+void
+audio_fade_in(Audio *audio, AudioUser user, guint duration)
+{
+	BackendCard *soundcard;
+	gdouble volume;
+
+	audio = audio_target(audio);
+	soundcard = audio->soundcard;
+	if (!soundcard)
+		return;
+
+	if (audio->ramp.active && audio->ramp.mute) {
+		volume = audio->ramp.restore;
+		audio_cancel_ramp(audio);
+	} else if (audio->faded) {
+		volume = audio->faded_volume;
+		audio_cancel_ramp(audio);
+	} else if (backend_card_has_mute(soundcard) &&
+	           backend_card_is_muted(soundcard)) {
+		AudioTransaction trans = { 0 };
+
+		volume = backend_card_get_volume(soundcard);
+		audio_cancel_ramp(audio);
+
+		/* Unmute at zero */
+		trans.ops[trans.n_ops].type = AUDIO_OP_SET_VOLUME;
+		trans.ops[trans.n_ops].value = 0;
+		trans.ops[trans.n_ops].dir = -1;
+		trans.n_ops++;
+		trans.ops[trans.n_ops].type = AUDIO_OP_SET_MUTE;
+		trans.ops[trans.n_ops].muted = FALSE;
+		trans.n_ops++;
+		audio_apply_transaction(audio, user, &trans);
+	} else {
+		/* Nothing to fade in */
+		return;
+	}
+
+	audio_start_ramp(audio, user, backend_card_get_volume(soundcard),
+	                 volume, duration, FALSE);
+}
+
+/**
+ * Get the balance between left and right channels.
+ *
+ * @param audio an Audio instance.
+ * @return the balance, from -1 (left only) to +1 (right only).
+ */
+gdouble
+audio_get_balance(Audio *audio)
+{
+	AudioVolumes volumes;
+
+	audio_get_volumes(audio, &volumes);
+
+	return volumes.balance;
+}
+
+/**
+ * Get the volume of each channel, along with the balance.
+ *
+ * @param audio an Audio instance.
+ * @param volumes the structure to fill.
+ */
+void
+audio_get_volumes(Audio *audio, AudioVolumes *volumes)
+{
+	BackendCard *soundcard;
+	BackendVolumes card_volumes;
+	guint i;
+
+	G_STATIC_ASSERT(AUDIO_MAX_CHANNELS == BACKEND_MAX_CHANNELS);
+
+	memset(volumes, 0, sizeof *volumes);
+
+	audio = audio_target(audio);
+	soundcard = audio->soundcard;
+	if (!soundcard)
+		return;
+
+	backend_card_get_volumes(soundcard, &card_volumes);
+
+	volumes->n_channels = card_volumes.n_channels;
+	for (i = 0; i < card_volumes.n_channels; i++)
+		volumes->volume[i] = CLAMP(card_volumes.volume[i], 0, 100);
+	volumes->balance = card_volumes.balance;
+}
+
+/**
+ * Set the volume of each channel at once, unmuting if needed.
+ * The balance is deduced from the channel volumes. It's one transaction,
+ * so handlers are invoked once, and only if something really changed.
+ *
+ * @param audio an Audio instance.
+ * @param user the user who performs the action.
+ * @param volumes the volumes to set, in percent.
+ */
+void
+audio_set_volumes(Audio *audio, AudioUser user, const AudioVolumes *volumes)
+{
+	AudioTransaction trans = { 0 };
+
+	trans.ops[trans.n_ops].type = AUDIO_OP_SET_VOLUMES;
+	trans.ops[trans.n_ops].volumes = *volumes;
+	trans.n_ops++;
+
+	/* Automatically unmute the volume */
+	trans.ops[trans.n_ops].type = AUDIO_OP_SET_MUTE;
+	trans.ops[trans.n_ops].muted = FALSE;
+	trans.n_ops++;
+
+	audio_apply(audio, user, &trans);
+}
+
+/**
+ * Whether the card has a capture side (a microphone) we can control.
+ *
+ * @param audio an Audio instance.
+ * @return TRUE if there's a capture channel, FALSE otherwise.
+ */
+gboolean
+audio_has_capture(Audio *audio)
+{
+	return audio_target(audio)->capture != NULL;
+}
+
+/**
+ * Get the name of the capture channel currently in use.
+ * This is an internal string that shouldn't be modified.
+ *
+ * @param audio an Audio instance.
+ * @return the name of the capture channel, or NULL if there's none.
+ */
+const char *
+audio_get_capture_channel(Audio *audio)
+{
+	audio = audio_target(audio);
+
+	if (!audio->capture)
+		return NULL;
+
+	return backend_card_get_channel(audio->capture);
+}
+
+/**
+ * Whether the capture channel has mute capabilities.
+ *
+ * @param audio an Audio instance.
+ * @return TRUE if the capture can be muted, FALSE otherwise.
+ */
+gboolean
+audio_capture_has_mute(Audio *audio)
+{
+	audio = audio_target(audio);
+
+	if (!audio->capture)
+		return FALSE;
+
+	return backend_card_has_mute(audio->capture);
+}
+
+/**
+ * Get the capture mute state, either TRUE or FALSE.
+ *
+ * @param audio an Audio instance.
+ * @return TRUE if the capture is muted, FALSE otherwise.
+ */
+gboolean
+audio_capture_is_muted(Audio *audio)
+{
+	audio = audio_target(audio);
+
+	if (!audio->capture)
+		return TRUE;
+
+	return backend_card_is_muted(audio->capture);
 }
 
+/**
+ * Toggle the capture mute state.
+ * The state is cached by the alsa layer, so this is a single write.
+ *
+ * @param audio an Audio instance.
+ * @param user the user who performs the action.
+ */
 void
-audio_set_volume(Audio *audio, AudioUser user, gdouble new_volume, gint dir)
+audio_toggle_capture_mute(Audio *audio, AudioUser user)
 {
-	AlsaCard *soundcard;
-	gdouble cur_volume;
+	audio = audio_target(audio);
 
-	if (audio_should_reload(audio))
-		audio_reload(audio);
-
-	soundcard = audio->soundcard;
-	if (!soundcard)
+	if (!audio->capture)
 		return;
 
-	cur_volume = alsa_card_get_volume(soundcard);
-	_audio_set_volume(audio, user, cur_volume, new_volume, dir);
+	backend_card_toggle_mute(audio->capture);
+
+	invoke_handlers(audio, AUDIO_CAPTURE_VALUES_CHANGED, user);
 }
 
 /**
- * Lower the volume.
+ * Get the capture volume in percent (value between 0 and 100).
  *
  * @param audio an Audio instance.
- * @param user the user who performs the action.
+ * @return the capture volume in percent.
  */
-void
-audio_lower_volume(Audio *audio, AudioUser user)
+gdouble
+audio_get_capture_volume(Audio *audio)
 {
-	AlsaCard *soundcard;
-	gdouble cur_volume, new_volume;
+	audio = audio_target(audio);
 
-	if (audio_should_reload(audio))
-		audio_reload(audio);
-
-	soundcard = audio->soundcard;
-	if (!soundcard)
-		return;
+	if (!audio->capture)
+		return 0;
 
-	cur_volume = alsa_card_get_volume(soundcard);
-	new_volume = cur_volume - audio->scroll_step;
-	if (new_volume < 0)
-		new_volume = 0;
-	_audio_set_volume(audio, user, cur_volume, new_volume, -1);
+	return CLAMP(backend_card_get_volume(audio->capture), 0, 100);
 }
 
 /**
- * Raise the volume.
+ * Set the capture volume.
  *
  * @param audio an Audio instance.
  * @param user the user who performs the action.
+ * @param new_volume the volume value to set, in percent.
+ * @param dir the direction for the volume change
+ *        (-1: lowering, +1: raising, 0: setting).
  */
 void
-audio_raise_volume(Audio *audio, AudioUser user)
+audio_set_capture_volume(Audio *audio, AudioUser user, gdouble new_volume, gint dir)
 {
-	AlsaCard *soundcard;
-	gdouble cur_volume, new_volume;
-
-	if (audio_should_reload(audio))
-		audio_reload(audio);
+	AudioTransaction trans = { 0 };
 
-	soundcard = audio->soundcard;
-	if (!soundcard)
+	audio = audio_target(audio);
+	if (!audio->capture)
 		return;
 
-	cur_volume = alsa_card_get_volume(soundcard);
-	new_volume = cur_volume + audio->scroll_step;
-	if (new_volume > 100)
-		new_volume = 100;
-	_audio_set_volume(audio, user, cur_volume, new_volume, +1);
+	/* The card tells whether the raw volume moved, no need to
+	 * compare percents.
+	 */
+	trans.ops[trans.n_ops].type = AUDIO_OP_SET_VOLUME;
+	trans.ops[trans.n_ops].value = new_volume;
+	trans.ops[trans.n_ops].dir = dir;
+	trans.n_ops++;
+
+	audio_apply_card_transaction(audio, audio->capture,
+	                             AUDIO_CAPTURE_VALUES_CHANGED, user, &trans);
 }
 
-/**
- * Unhook the currently hooked audio card.
- *
- * @param audio an Audio instance.
+/* Move the capture volume by a scroll step, or more in a burst.
+ * Unlike the playback volume, the microphone is not unmuted.
  */
 static void
-audio_unhook_soundcard(Audio *audio)
+audio_step_capture_volume(Audio *audio, AudioUser user, gint dir)
 {
-	if (audio->soundcard == NULL)
+	AudioTransaction trans = { 0 };
+	gdouble steps;
+
+	audio = audio_target(audio);
+	if (!audio->capture)
 		return;
 
-	DEBUG("Unhooking soundcard from the audio system");
+	steps = audio_accel_steps(audio, user, BACKEND_STREAM_CAPTURE, dir);
 
-	/* Free the soundcard */
-	alsa_card_free(audio->soundcard);
-	audio->soundcard = NULL;
+	trans.ops[trans.n_ops].type = AUDIO_OP_STEP_VOLUME;
+	trans.ops[trans.n_ops].value = dir * steps;
+	trans.ops[trans.n_ops].dir = dir;
+	trans.n_ops++;
 
-	/* Invoke user handlers */
-	invoke_handlers(audio, AUDIO_CARD_CLEANED_UP, AUDIO_USER_UNKNOWN);
+	audio_apply_card_transaction(audio, audio->capture,
+	                             AUDIO_CAPTURE_VALUES_CHANGED, user, &trans);
+}
+
+/**
+ * Lower the capture volume. The step grows when the capture volume is
+ * lowered several times in a row, quickly.
+ *
+ * @param audio an Audio instance.
+ * @param user the user who performs the action.
+ */
+void
+audio_lower_capture_volume(Audio *audio, AudioUser user)
+{
+	audio_step_capture_volume(audio, user, -1);
 }
 
 /**
- * Attempt to hook an audio soundcard.
- * Try everything possible, the goal is to have a working soundcard.
- * So if the selected soundcard fails, we try any others until at some
- * point we have a working soundcard.
+ * Raise the capture volume. The step grows when the capture volume is
+ * raised several times in a row, quickly.
  *
  * @param audio an Audio instance.
+ * @param user the user who performs the action.
+ */
+void
+audio_raise_capture_volume(Audio *audio, AudioUser user)
+{
+	audio_step_capture_volume(audio, user, +1);
+}
+
+/* Link the channels listed in the preferences to the channel in use,
+ * so that they're all controlled together.
  */
 static void
-audio_hook_soundcard(Audio *audio)
+audio_link_channels(BackendCard *soundcard)
 {
-	AlsaCard *soundcard;
-	GSList *card_list, *item;
+	gchar **channels;
+	gchar **channel;
 
-	g_assert(audio->soundcard == NULL);
+	channels = prefs_get_linked_channels(backend_card_get_name(soundcard));
+	if (channels == NULL)
+		return;
 
-	/* Attempt to create the card */
-	DEBUG("Hooking soundcard '%s (%s)' to the audio system", audio->card, audio->channel);
+	for (channel = channels; *channel; channel++) {
+		gchar *name = *channel;
+		gchar *sep, *end;
+		gdouble weight = 1;
+
+		/* Parse the optional weight, 'Name:weight' */
+		sep = strrchr(name, ':');
+		if (sep) {
+			weight = g_ascii_strtod(sep + 1, &end);
+			if (end != sep + 1 && *end == '\0')
+				*sep = '\0';
+			else
+				weight = 1;
+		}
+
+		g_strstrip(name);
+		if (*name == '\0')
+			continue;
 
-	soundcard = alsa_card_new(audio->card, audio->channel, audio->normalize);
-	if (soundcard) {
-		audio->fallback = FALSE;
-		goto end;
+		DEBUG("Linking channel '%s' (weight: %lg)", name, weight);
+		backend_card_link_channel(soundcard, name, weight);
 	}
 
-	/* On failure, try to create the card from the list of available cards.
-	 * We don't try with the card name that just failed.
-	 */
-	DEBUG("Could not hook soundcard, trying every card available");
-	audio->fallback = TRUE;
+	g_strfreev(channels);
+}
 
-	card_list = alsa_list_cards();
-	item = g_slist_find_custom(card_list, audio->card, (GCompareFunc) g_strcmp0);
-	if (item) {
-		DEBUG("Removing '%s' from card list", (char *) item->data);
-		card_list = g_slist_remove(card_list, item);
-		g_slist_free_full(item, g_free);
-	}
+/* Hook the capture side of the soundcard in use, if it has one.
+ * It's not an error if there's none, a lot of cards are playback only.
+ */
+static void
+audio_hook_capture(Audio *audio)
+{
+	BackendCard *capture;
+	const char *card;
+	gchar *channel;
 
-	/* Now iterate on card list and attempt to get a working soundcard */
-	for (item = card_list; item; item = item->next) {
-		const char *card = item->data;
-		char *channel;
+	g_assert(audio->capture == NULL);
+
+	if (!prefs_get_boolean("EnableCapture", TRUE))
+		return;
 
-		channel = prefs_get_channel(card);
-		soundcard = alsa_card_new(card, channel, audio->normalize);
-		g_free(channel);
+	card = backend_card_get_name(audio->soundcard);
+	channel = prefs_get_capture_channel(card);
+	capture = backend_card_new(audio->backend, card, channel,
+	                           BACKEND_STREAM_CAPTURE, audio->normalize);
+	g_free(channel);
 
-		if (soundcard)
-			break;
+	if (capture == NULL) {
+		DEBUG("No capture channel on this soundcard");
+		return;
 	}
 
-	/* Free card list */
-	g_slist_free_full(card_list, g_free);
+	backend_card_install_callback(capture, on_capture_event, audio);
+	audio->capture = capture;
+}
+
+/* Settings a card instance is hooked with. As long as they don't change,
+ * there's no need to reopen the card when the audio is reloaded.
+ */
+static gchar *
+audio_card_settings(Audio *audio, const gchar *channel)
+{
+	gchar **linked;
+	gchar *linked_str, *capture_channel, *settings;
+
+	linked = prefs_get_linked_channels(audio->card);
+	linked_str = linked ? g_strjoinv(";", linked) : g_strdup("");
+	capture_channel = prefs_get_capture_channel(audio->card);
+
+	settings = g_strdup_printf("%s|%s|%d|%s|%d|%s", audio->backend->name,
+	                           channel ? channel : "", audio->normalize,
+	                           linked_str, prefs_get_boolean("EnableCapture", TRUE),
+	                           capture_channel ? capture_channel : "");
+
+	g_free(capture_channel);
+	g_free(linked_str);
+	g_strfreev(linked);
+
+	return settings;
+}
+
+/**
+ * Attempt to hook the soundcard of a card instance.
+ *
+ * @param audio a card instance.
+ * @param channel the channel to use, NULL for the first one.
+ */
+static void
+audio_hook_soundcard(Audio *audio, const gchar *channel)
+{
+	BackendCard *soundcard;
+
+	g_assert(audio->soundcard == NULL);
+
+	/* Attempt to create the card */
+	DEBUG("Hooking soundcard '%s (%s)' to the audio system", audio->card, channel);
+
+	soundcard = backend_card_new(audio->backend, audio->card, channel,
+	                             BACKEND_STREAM_PLAYBACK, audio->normalize);
 
-end:
 	/* Save soundcard NOW !
 	 * We're going to invoke handlers later on, and these guys
 	 * need a valid soundcard pointer.
@@ -717,81 +1851,467 @@ end:
 
 	/* Finish making everything ready */
 	if (soundcard == NULL) {
-		DEBUG("No soundcard could be hooked !");
+		DEBUG("Could not hook soundcard '%s'", audio->card);
 
-		/* Card and channel names set to emptry string */
-		g_free(audio->card);
-		audio->card = g_strdup("");
+		/* Channel name set to empty string */
 		g_free(audio->channel);
 		audio->channel = g_strdup("");
 
 		/* Tell the world */
 		invoke_handlers(audio, AUDIO_NO_CARD, AUDIO_USER_UNKNOWN);
 	} else {
-		DEBUG("Soundcard successfully hooked (scroll step: %lg, normalize: %s)",
-		      audio->scroll_step, audio->normalize ? "true" : "false");
+		DEBUG("Soundcard '%s' successfully hooked (scroll step: %lg, normalize: %s)",
+		      audio->card, audio->scroll_step, audio->normalize ? "true" : "false");
 
-		/* Card and channel names must match the truth.
-		 * Indeed, in case of failure, we may end up using a soundcard
-		 * different from the one specified in the preferences.
+		/* Channel name must match the truth, we may end up using
+		 * a channel different from the one specified in the preferences.
 		 */
-		g_free(audio->card);
-		audio->card = g_strdup(alsa_card_get_name(soundcard));
 		g_free(audio->channel);
-		audio->channel = g_strdup(alsa_card_get_channel(soundcard));
+		audio->channel = g_strdup(backend_card_get_channel(soundcard));
+
+		/* Link other channels to the one in use */
+		audio_link_channels(soundcard);
+
+		/* Hook the microphone as well */
+		audio_hook_capture(audio);
 
 		/* Install callbacks */
-		alsa_card_install_callback(soundcard, on_alsa_event, audio);
+		backend_card_install_callback(soundcard, on_card_event, audio);
 
 		/* Tell the world */
 		invoke_handlers(audio, AUDIO_CARD_INITIALIZED, AUDIO_USER_UNKNOWN);
 	}
 }
 
+/* Reload a card instance. The card is reopened only if it's not hooked,
+ * or if its settings changed since it was hooked.
+ */
+static void
+audio_reload_card(Audio *audio)
+{
+	Audio *parent = audio->parent;
+	gchar *channel, *settings;
+
+	/* Get preferences from the main instance */
+	audio->backend = parent->backend;
+	audio->normalize = parent->normalize;
+	audio->scroll_step = parent->scroll_step;
+	audio->accel_interval = parent->accel_interval;
+	audio->accel_factor = parent->accel_factor;
+	audio->accel_max = parent->accel_max;
+	audio->update_interval = parent->update_interval;
+	audio->mute_fade = parent->mute_fade;
+	audio->write_interval = MAX(prefs_get_card_integer(audio->card, "MinWriteInterval",
+	                                                   AUDIO_RAMP_WRITE_INTERVAL), 0);
+	channel = prefs_get_channel(audio->card);
+	settings = audio_card_settings(audio, channel);
+
+	/* Rehook soundcard, if needed */
+	if (audio->soundcard == NULL || g_strcmp0(settings, audio->settings)) {
+		audio_unhook_soundcard(audio);
+		audio_hook_soundcard(audio, channel);
+	}
+
+	g_free(audio->settings);
+	audio->settings = audio->soundcard ? settings : NULL;
+	if (audio->soundcard == NULL)
+		g_free(settings);
+	g_free(channel);
+}
+
+/* Free a card instance, or the main instance with every card instance */
+static void
+audio_free_instance(Audio *audio)
+{
+	g_slist_free_full(audio->cards, (GDestroyNotify) audio_free_instance);
+	audio_unhook_soundcard(audio);
+	audio_cancel_deferred(audio);
+	if (audio->handlers)
+		g_array_free(audio->handlers, TRUE);
+	g_free(audio->settings);
+	g_free(audio->preferred);
+	g_free(audio->channel);
+	g_free(audio->card);
+	g_free(audio);
+}
+
+/* Create a card instance */
+static Audio *
+audio_new_instance(Audio *parent, const char *card)
+{
+	Audio *audio;
+
+	audio = g_new0(Audio, 1);
+	audio->parent = parent;
+	audio->card = g_strdup(card);
+	audio->channel = g_strdup("");
+
+	return audio;
+}
+
+/**
+ * Get the list of card instances, one per card.
+ * The list belongs to the main instance and must not be modified.
+ * Card instances can be used like the main instance, but they always act
+ * on their own card, may it be the active one or not. Card instances
+ * live as long as the main instance.
+ *
+ * @param audio the main Audio instance.
+ * @return a list of Audio instances.
+ */
+GSList *
+audio_get_card_instances(Audio *audio)
+{
+	return audio->cards;
+}
+
+/**
+ * Get the card instance of a card, by name.
+ *
+ * @param audio the main Audio instance.
+ * @param card the name of the card.
+ * @return an Audio instance, or NULL if there's no such card.
+ */
+Audio *
+audio_get_card_instance(Audio *audio, const char *card)
+{
+	GSList *item;
+
+	if (audio->parent)
+		audio = audio->parent;
+
+	for (item = audio->cards; item; item = item->next) {
+		Audio *instance = item->data;
+
+		if (!g_strcmp0(instance->card, card))
+			return instance;
+	}
+
+	return NULL;
+}
+
+/* Switch the active card instance. No card is reopened here. */
+static void
+audio_set_active(Audio *audio, Audio *active)
+{
+	DEBUG("Soundcard '%s' is now the active one", active->card);
+
+	audio->active = active;
+	invoke_handlers(audio, AUDIO_CARD_INITIALIZED, AUDIO_USER_UNKNOWN);
+}
+
+/**
+ * Make a card instance the active one, the one the main instance acts on.
+ * The card is already hooked, so it's cheap, it's just a pointer swap.
+ * It lasts until the next reload, where the preferred card is picked again.
+ * Does nothing for the main instance.
+ *
+ * @param audio a card instance.
+ * @return TRUE on success, FALSE if the card is not hooked.
+ */
+gboolean
+audio_activate(Audio *audio)
+{
+	if (audio->parent == NULL)
+		return TRUE;
+
+	if (audio->soundcard == NULL)
+		return FALSE;
+
+	if (audio->parent->active != audio)
+		audio_set_active(audio->parent, audio);
+
+	return TRUE;
+}
+
+/*
+ * Fallback recovery.
+ * When the preferred card is listed but can't be hooked (it may be busy,
+ * or not ready yet), no hotplug event will tell us when it gets usable.
+ * So we try to hook it again from time to time, backing off after each
+ * failure. Only the preferred card is retried, cards are not listed
+ * again and the other instances are left alone.
+ */
+
+/* Cancel the pending retry, if any */
+static void
+audio_cancel_retry(Audio *audio)
+{
+	if (audio->retry_id) {
+		g_source_remove(audio->retry_id);
+		audio->retry_id = 0;
+	}
+}
+
+/* Get the delay before the next retry, backing off */
+static guint
+audio_next_retry_delay(Audio *audio)
+{
+	if (audio->retry_delay == 0)
+		audio->retry_delay = AUDIO_RETRY_DELAY_MIN;
+	else
+		audio->retry_delay = MIN(audio->retry_delay * 2, AUDIO_RETRY_DELAY_MAX);
+
+	DEBUG("Retrying to hook '%s' in %u ms", audio->preferred, audio->retry_delay);
+
+	return audio->retry_delay;
+}
+
+/* Try to hook the preferred card again */
+static gboolean
+on_retry_timeout(Audio *audio)
+{
+	Audio *instance;
+
+	audio->retry_id = 0;
+
+	/* If the card is gone, a hotplug event will bring it back */
+	instance = audio_get_card_instance(audio, audio->preferred);
+	if (instance == NULL || !audio->fallback)
+		return G_SOURCE_REMOVE;
+
+	audio_reload_card(instance);
+	if (instance->soundcard == NULL) {
+		audio->retry_id = g_timeout_add(audio_next_retry_delay(audio),
+		                                (GSourceFunc) on_retry_timeout, audio);
+		return G_SOURCE_REMOVE;
+	}
+
+	DEBUG("Preferred soundcard '%s' is back", instance->card);
+
+	audio->fallback = FALSE;
+	audio->retry_delay = 0;
+
+	if (audio->active) {
+		audio->active = NULL;
+		invoke_handlers(audio, AUDIO_CARD_CLEANED_UP, AUDIO_USER_UNKNOWN);
+	}
+	audio_set_active(audio, instance);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Reload after a card was plugged or unplugged */
+static gboolean
+on_hotplug_timeout(Audio *audio)
+{
+	audio->hotplug_id = 0;
+
+	if (audio->fallback)
+		DEBUG("Cards changed, the preferred card may be back");
+	else
+		DEBUG("Cards changed, rehooking cards");
+
+	audio_reload(audio);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Callback invoked by the backend when a card is plugged or unplugged.
+ * Hotplug events come in bursts (a device node is created, then its
+ * permissions are set), and the card may not be usable right away,
+ * so we wait a little and reload once.
+ */
+static void
+on_cards_changed(gpointer data)
+{
+	Audio *audio = (Audio *) data;
+
+	if (audio->hotplug_id)
+		return;
+
+	audio->hotplug_id = g_timeout_add(AUDIO_HOTPLUG_DELAY,
+	                                  (GSourceFunc) on_hotplug_timeout, audio);
+}
+
 /**
- * Reload the current preferences, and reload the hooked soundcard.
+ * Reload the current preferences, and reload the hooked soundcards.
+ * Every card available is hooked. The preferred card is the active
+ * one, unless it's not available, in which case we try any others until
+ * at some point we have a working soundcard.
  * This has to be called each time the preferences are modified.
+ * Card instances are reloaded along with the main instance.
+ * When called by a signal handler while a card event is dispatched,
+ * the reload is deferred, since it would free the card of the event.
  *
  * @param audio an Audio instance.
  */
 void
 audio_reload(Audio *audio)
 {
+	const Backend *backend;
+	GSList *card_list, *item;
+	Audio *active;
+	gchar *preferred;
+
+	if (audio->parent)
+		audio = audio->parent;
+
+	/* Not from within a card event, it's deferred like a hotplug reload */
+	if (audio->in_card_event) {
+		DEBUG("Reload asked during a card event, deferring it");
+		on_cards_changed(audio);
+		return;
+	}
+
+	/* A pending hotplug reload or retry is pointless now */
+	if (audio->hotplug_id) {
+		g_source_remove(audio->hotplug_id);
+		audio->hotplug_id = 0;
+	}
+	audio_cancel_retry(audio);
+
 	/* Get preferences */
-	g_free(audio->card);
-	audio->card = prefs_get_string("AlsaCard", NULL);
-	g_free(audio->channel);
-	audio->channel = prefs_get_channel(audio->card);
+	preferred = prefs_get_string("AlsaCard", NULL);
+	if (preferred == NULL)
+		preferred = g_strdup(BACKEND_DEFAULT_CARD);
 	audio->normalize = prefs_get_boolean("NormalizeVolume", TRUE);
 	audio->scroll_step = prefs_get_double("ScrollStep", 5);
+	audio->accel_interval = MAX(prefs_get_integer("ScrollAccelInterval",
+	                                              AUDIO_ACCEL_INTERVAL), 0);
+	audio->accel_factor = MAX(prefs_get_double("ScrollAccelFactor",
+	                                           AUDIO_ACCEL_FACTOR), 0);
+	audio->accel_max = MAX(prefs_get_double("ScrollAccelMax",
+	                                        AUDIO_ACCEL_MAX), 1);
+	audio->update_interval = MAX(prefs_get_integer("ExternalUpdateInterval",
+	                                               AUDIO_UPDATE_INTERVAL), 0);
+	audio->mute_fade = MAX(prefs_get_integer("MuteFadeDuration", 0), 0);
+
+	/* Forget about the active card while we reload */
+	if (audio->active) {
+		audio->active = NULL;
+		invoke_handlers(audio, AUDIO_CARD_CLEANED_UP, AUDIO_USER_UNKNOWN);
+	}
 
-	/* Rehook soundcard */
-	audio_unhook_soundcard(audio);
-	audio_hook_soundcard(audio);
+	/* Watch the backend for hotplug events. When switching backends,
+	 * every card of the old one goes first, so that the worker can
+	 * switch too.
+	 */
+	if (audio->backend)
+		backend_set_cards_callback(audio->backend, NULL, NULL);
+	backend = audio_get_backend();
+	if (audio->backend && backend != audio->backend) {
+		DEBUG("Switching audio backend, unhooking every card");
+		for (item = audio->cards; item; item = item->next)
+			audio_unhook_soundcard(item->data);
+		backend_cleanup(audio->backend);
+		backend = audio_get_backend();
+	}
+	g_assert(backend);
+	audio->backend = backend;
+	backend_set_cards_callback(audio->backend, on_cards_changed, audio);
+
+	/* Card and channel names of the main instance are only visible
+	 * when there's no active card.
+	 */
+	g_free(audio->card);
+	audio->card = g_strdup("");
+	g_free(audio->channel);
+	audio->channel = g_strdup("");
+
+	/* Hook every card available, reusing the instances we already have */
+	card_list = backend_list_cards(audio->backend);
+	for (item = card_list; item; item = item->next) {
+		const char *card = item->data;
+		Audio *instance;
+
+		instance = audio_get_card_instance(audio, card);
+		if (instance == NULL) {
+			instance = audio_new_instance(audio, card);
+			audio->cards = g_slist_append(audio->cards, instance);
+		}
+
+		audio_reload_card(instance);
+	}
+
+	/* Unhook the cards that are gone. Their instances are kept, since
+	 * someone may be listening to them, and they may come back.
+	 */
+	for (item = audio->cards; item; item = item->next) {
+		Audio *instance = item->data;
+
+		if (g_slist_find_custom(card_list, instance->card,
+		                        (GCompareFunc) g_strcmp0) == NULL)
+			audio_unhook_soundcard(instance);
+	}
+
+	g_slist_free_full(card_list, g_free);
+
+	/* Pick the active card, the preferred one if possible */
+	active = audio_get_card_instance(audio, preferred);
+	audio->fallback = FALSE;
+	if (active == NULL || active->soundcard == NULL) {
+		DEBUG("Could not hook preferred soundcard, trying every card available");
+		audio->fallback = TRUE;
+
+		active = NULL;
+		for (item = audio->cards; item; item = item->next) {
+			Audio *instance = item->data;
+
+			if (instance->soundcard) {
+				active = instance;
+				break;
+			}
+		}
+	}
+
+	/* Keep trying the preferred card if it's there, but unusable.
+	 * The backoff goes on as long as reloads don't get it back.
+	 */
+	g_free(audio->preferred);
+	audio->preferred = preferred;
+	if (audio->fallback && audio_get_card_instance(audio, preferred))
+		audio->retry_id = g_timeout_add(audio_next_retry_delay(audio),
+		                                (GSourceFunc) on_retry_timeout, audio);
+	else
+		audio->retry_delay = 0;
+
+	/* Tell the world */
+	if (active == NULL) {
+		DEBUG("No soundcard could be hooked !");
+		invoke_handlers(audio, AUDIO_NO_CARD, AUDIO_USER_UNKNOWN);
+	} else {
+		audio_set_active(audio, active);
+	}
 }
 
 /**
- * Free an audio instance, therefore unhooking the sound card and
- * freeing any allocated ressources.
+ * Free an audio instance, therefore unhooking the sound cards and
+ * freeing any allocated ressources. Card instances belong to the
+ * main instance, only the main instance can be freed.
  *
- * @param audio an Audio instance.
+ * @param audio the main Audio instance.
  */
 void
 audio_free(Audio *audio)
 {
+	const Backend *backend;
+
 	if (audio == NULL)
 		return;
 
-	audio_unhook_soundcard(audio);
-	g_free(audio->channel);
-	g_free(audio->card);
-	g_free(audio);
+	g_assert(audio->parent == NULL);
+
+	if (audio->hotplug_id)
+		g_source_remove(audio->hotplug_id);
+	if (audio->ramp_id)
+		g_source_remove(audio->ramp_id);
+	audio_cancel_retry(audio);
+	backend = audio->backend;
+	if (backend)
+		backend_set_cards_callback(backend, NULL, NULL);
+
+	audio_free_instance(audio);
+
+	/* Every card is gone, the backend can let go of the rest */
+	if (backend)
+		backend_cleanup(backend);
 }
 
 /**
  * Create a new Audio instance.
  * This does almost nothing actually, all the heavy job is done
- * in the audio_hook_soundcard() function.
+ * in the audio_reload() function.
  *
  * @return a newly allocated Audio instance.
  */
@@ -808,25 +2328,40 @@ audio_new(void)
 /**
  * Return the list of playable cards as a GSList.
  * Must be freed using g_slist_free_full() and g_free().
+ * The list comes from the backend selected in the preferences. If it's
+ * not the one in use, it can't be asked until the next reload.
  *
- * @return a list of playable cards.
+ * @return a list of playable cards, NULL if there's none.
  */
 GSList *
 audio_get_card_list(void)
 {
-	return alsa_list_cards();
+	const Backend *backend;
+
+	backend = audio_get_backend();
+	if (backend == NULL)
+		return NULL;
+
+	return backend_list_cards(backend);
 }
 
 /**
  * For a given card name, return the list of playable channels as a GSList.
  * Must be freed using g_slist_free_full() and g_free().
+ * Same as audio_get_card_list(), regarding the backend.
  *
  * @param card_name the name of the card for which we list the channels
- * @return a list of playable channels.
+ * @return a list of playable channels, NULL if there's none.
  */
 GSList *
 audio_get_channel_list(const char *card_name)
 {
-	return alsa_list_channels(card_name);
+	const Backend *backend;
+
+	backend = audio_get_backend();
+	if (backend == NULL)
+		return NULL;
+
+	return backend_list_channels(backend, card_name, BACKEND_STREAM_PLAYBACK);
 }
 
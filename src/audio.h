@@ -32,6 +32,15 @@ Audio *audio_new(void);
 void audio_free(Audio *audio);
 void audio_reload(Audio *audio);
 
+/* Every card available is hooked, each one by its own card instance.
+ * The main instance, the one returned by audio_new(), acts on the
+ * active card instance.
+ */
+
+GSList *audio_get_card_instances(Audio *audio);
+Audio *audio_get_card_instance(Audio *audio, const char *card);
+gboolean audio_activate(Audio *audio);
+
 /* Audio status: card & channel name, mute & volume handling.
  * Everyone who changes the volume must say who he is.
  */
@@ -45,6 +54,50 @@ enum audio_user {
 
 typedef enum audio_user AudioUser;
 
+#define AUDIO_MAX_CHANNELS 8
+
+struct audio_volumes {
+	guint n_channels;
+	gdouble volume[AUDIO_MAX_CHANNELS]; /* In percent */
+	gdouble balance; /* From -1 (left) to +1 (right) */
+};
+
+typedef struct audio_volumes AudioVolumes;
+
+/* Transactions: a few operations applied at once, that end up
+ * in a single AUDIO_VALUES_CHANGED signal.
+ */
+
+enum audio_op_type {
+	AUDIO_OP_SET_VOLUME,  /* Set the volume to 'value' percent */
+	AUDIO_OP_STEP_VOLUME, /* Raise or lower the volume by 'value' scroll steps,
+	                       * moving by one hardware step at least */
+	AUDIO_OP_SET_STEP,    /* Set the volume to the step index 'value' */
+	AUDIO_OP_SET_VOLUMES, /* Set the volume of each channel to 'volumes' */
+	AUDIO_OP_SET_MUTE     /* Set the mute state to 'muted' */
+};
+
+typedef enum audio_op_type AudioOpType;
+
+struct audio_op {
+	AudioOpType type;
+	gdouble value;
+	gint dir; /* For AUDIO_OP_SET_VOLUME(S), see audio_set_volume() */
+	gboolean muted;
+	AudioVolumes volumes;
+};
+
+typedef struct audio_op AudioOp;
+
+#define AUDIO_MAX_OPS 4
+
+struct audio_transaction {
+	guint n_ops;
+	AudioOp ops[AUDIO_MAX_OPS];
+};
+
+typedef struct audio_transaction AudioTransaction;
+
 const char *audio_get_card(Audio *audio);
 const char *audio_get_channel(Audio *audio);
 gboolean audio_has_mute(Audio *audio);
@@ -54,6 +107,28 @@ gdouble audio_get_volume(Audio *audio);
 void audio_set_volume(Audio *audio, AudioUser user, gdouble volume, gint direction);
 void audio_lower_volume(Audio *audio, AudioUser user);
 void audio_raise_volume(Audio *audio, AudioUser user);
+gdouble audio_get_balance(Audio *audio);
+void audio_get_volumes(Audio *audio, AudioVolumes *volumes);
+void audio_set_volumes(Audio *audio, AudioUser user, const AudioVolumes *volumes);
+void audio_apply(Audio *audio, AudioUser user, const AudioTransaction *trans);
+void audio_ramp_volume(Audio *audio, AudioUser user, gdouble volume, guint duration);
+gboolean audio_is_ramping(Audio *audio);
+void audio_fade_out(Audio *audio, AudioUser user, guint duration);
+void audio_fade_in(Audio *audio, AudioUser user, guint duration);
+
+/* Capture (microphone) handling, on the same card.
+ * It's optional, the card may not have any capture channel.
+ */
+
+gboolean audio_has_capture(Audio *audio);
+const char *audio_get_capture_channel(Audio *audio);
+gboolean audio_capture_has_mute(Audio *audio);
+gboolean audio_capture_is_muted(Audio *audio);
+void audio_toggle_capture_mute(Audio *audio, AudioUser user);
+gdouble audio_get_capture_volume(Audio *audio);
+void audio_set_capture_volume(Audio *audio, AudioUser user, gdouble volume, gint direction);
+void audio_lower_capture_volume(Audio *audio, AudioUser user);
+void audio_raise_capture_volume(Audio *audio, AudioUser user);
 
 /* Signal handling.
  * The audio system sends signals out there when something happens.
@@ -66,25 +141,51 @@ enum audio_signal {
 	AUDIO_CARD_DISCONNECTED,
 	AUDIO_CARD_ERROR,
 	AUDIO_VALUES_CHANGED,
+	AUDIO_CAPTURE_VALUES_CHANGED,
 };
 
 typedef enum audio_signal AudioSignal;
 
-struct audio_event {
-	AudioSignal signal;
-	AudioUser user;
+/* Snapshot of the audio status, kept up to date by the audio system.
+ * The serial is bumped each time something in there changes.
+ */
+struct audio_state {
+	guint serial;
 	const gchar *card;
 	const gchar *channel;
 	gboolean has_mute;
 	gboolean muted;
 	gdouble volume;
+	gdouble balance;
+	gboolean has_capture;
+	gboolean capture_has_mute;
+	gboolean capture_muted;
+	gdouble capture_volume;
+};
+
+typedef struct audio_state AudioState;
+
+struct audio_event {
+	AudioSignal signal;
+	AudioUser user;
+	const AudioState *state;
 };
 
 typedef struct audio_event AudioEvent;
 
-typedef void (*AudioCallback) (Audio *audio, AudioEvent *event, gpointer data);
+typedef void (*AudioCallback) (Audio *audio, const AudioEvent *event, gpointer data);
+typedef gboolean (*AudioVisibleFunc) (gpointer data);
+
+/* Handlers may only subscribe to some signals, from some users */
+#define AUDIO_SIGNAL_MASK(signal) (1u << (signal))
+#define AUDIO_ALL_SIGNALS (~0u)
+#define AUDIO_USER_MASK(user) (1u << (user))
+#define AUDIO_ALL_USERS (~0u)
 
-void audio_signals_connect(Audio *audio, AudioCallback callback, gpointer data);
-void audio_signals_disconnect(Audio *audio, AudioCallback callback, gpointer data);
+guint audio_signals_connect(Audio *audio, AudioCallback callback, gpointer data);
+guint audio_signals_connect_full(Audio *audio, AudioCallback callback, gpointer data,
+                                 guint signals, guint users, AudioVisibleFunc visible);
+void audio_signals_disconnect(Audio *audio, guint id);
+void audio_get_dispatch_counters(Audio *audio, guint *n_echoes, guint *n_duplicates);
 
 #endif				// _AUDIO_H
@@ -0,0 +1,518 @@
+/* backend.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file backend.c
+ * This file holds the audio backend interface.
+ * A backend is a table of functions, and each card knows the backend
+ * it belongs to. The functions here are just there to dispatch calls
+ * to the right backend, so that the frontend (audio.c) doesn't have
+ * to know which backend it's talking to.
+ * @brief Audio backend interface.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <string.h>
+#include <glib.h>
+
+#include "backend.h"
+#include "alsa.h"
+#ifdef WITH_MOCK_BACKEND
+#include "mock.h"
+#endif
+#ifdef WITH_PULSEAUDIO
+#include "pulse.h"
+#endif
+#include "support-log.h"
+
+/* Every backend available, the first one is the default */
+static const Backend *backends[] = {
+	&alsa_backend,
+#ifdef WITH_PULSEAUDIO
+	&pulse_backend,
+#endif
+#ifdef WITH_MOCK_BACKEND
+	&mock_backend,
+#endif
+	NULL
+};
+
+/**
+ * Get a backend by name. If there's no backend with this name,
+ * the default backend is returned.
+ *
+ * @param name the name of the backend, like 'alsa', or NULL.
+ * @return a backend, never NULL.
+ */
+const Backend *
+backend_get(const char *name)
+{
+	guint i;
+
+	if (name == NULL)
+		return backends[0];
+
+	for (i = 0; backends[i]; i++) {
+		if (!g_strcmp0(backends[i]->name, name))
+			return backends[i];
+	}
+
+	WARN("Unknown audio backend '%s', using '%s' instead", name, backends[0]->name);
+
+	return backends[0];
+}
+
+/**
+ * Attach a source to the main context of the calling thread, and give up
+ * our reference on it. Backends must use that instead of g_io_add_watch(),
+ * g_idle_add() and friends, since they may run in the audio worker thread,
+ * that has its own main context.
+ *
+ * @param source the source to attach.
+ * @param func the callback of the source.
+ * @param data the user data passed to the callback.
+ * @return the id of the source.
+ */
+guint
+backend_attach_source(GSource *source, GSourceFunc func, gpointer data)
+{
+	guint id;
+
+	g_source_set_callback(source, func, data, NULL);
+	id = g_source_attach(source, g_main_context_get_thread_default());
+	g_source_unref(source);
+
+	return id;
+}
+
+/**
+ * Remove a source attached with backend_attach_source().
+ * Does nothing if the source was already removed.
+ *
+ * @param id the id of the source.
+ */
+void
+backend_remove_source(guint id)
+{
+	GSource *source;
+
+	source = g_main_context_find_source_by_id(g_main_context_get_thread_default(), id);
+	if (source)
+		g_source_destroy(source);
+}
+
+/**
+ * Return the list of playable cards as a GSList.
+ * Must be freed using g_slist_free_full() and g_free().
+ *
+ * @param backend the backend to ask.
+ * @return a list of playable cards.
+ */
+GSList *
+backend_list_cards(const Backend *backend)
+{
+	return backend->list_cards();
+}
+
+/**
+ * For a given card name, return the list of channels as a GSList.
+ * Must be freed using g_slist_free_full() and g_free().
+ *
+ * @param backend the backend to ask.
+ * @param card_name the name of the card for which we list the channels.
+ * @param stream whether we list playback or capture channels.
+ * @return a list of channels.
+ */
+GSList *
+backend_list_channels(const Backend *backend, const char *card_name,
+                      BackendStream stream)
+{
+	return backend->list_channels(card_name, stream);
+}
+
+/**
+ * Set a callback invoked when the list of cards changes, that is
+ * when a card is plugged or unplugged. There's only one such callback
+ * per backend, setting a new one replaces the previous one.
+ *
+ * @param backend the backend to watch.
+ * @param callback the callback to be invoked, or NULL.
+ * @param data the user data passed to the callback.
+ */
+void
+backend_set_cards_callback(const Backend *backend, BackendCardsCb callback,
+                           gpointer data)
+{
+	backend->set_cards_callback(callback, data);
+}
+
+/**
+ * Release what a backend keeps between calls: its registry of cards,
+ * its hotplug watch and the other sources it attached. It must be called
+ * in the thread that used the backend, once every card is freed, since
+ * the sources live in the main context of this thread. The backend can
+ * be used again afterwards, it starts over.
+ *
+ * @param backend the backend to clean up.
+ */
+void
+backend_cleanup(const Backend *backend)
+{
+	if (backend->cleanup)
+		backend->cleanup();
+}
+
+/**
+ * Create a new card.
+ *
+ * @param backend the backend to use.
+ * @param card_name the name of the card, or NULL for the default card.
+ * @param channel the name of the channel, or NULL for the first one.
+ * @param stream whether we control the playback or the capture volume.
+ * @param normalize whether we use normalized volume or not.
+ * @return a newly allocated card, or NULL on failure.
+ */
+BackendCard *
+backend_card_new(const Backend *backend, const char *card_name,
+                 const char *channel, BackendStream stream, gboolean normalize)
+{
+	BackendCard *card;
+
+	card = backend->card_new(card_name, channel, stream, normalize);
+	if (card)
+		g_assert(card->backend == backend);
+
+	return card;
+}
+
+/**
+ * Free a card. Does nothing if the card is NULL.
+ *
+ * @param card a BackendCard instance.
+ */
+void
+backend_card_free(BackendCard *card)
+{
+	if (card == NULL)
+		return;
+
+	card->backend->card_free(card);
+}
+
+/**
+ * Link another channel of the card to the one in use,
+ * so that they're controlled together.
+ *
+ * @param card a BackendCard instance.
+ * @param channel the name of the channel to link.
+ * @param weight the volume ratio to apply, between 0 and 1.
+ * @return TRUE on success, FALSE otherwise.
+ */
+gboolean
+backend_card_link_channel(BackendCard *card, const char *channel, gdouble weight)
+{
+	return card->backend->card_link_channel(card, channel, weight);
+}
+
+/**
+ * Set a callback invoked on volume/mute changes.
+ *
+ * @param card a BackendCard instance.
+ * @param callback the callback to be invoked.
+ * @param data the user data passed to the callback.
+ */
+void
+backend_card_install_callback(BackendCard *card, BackendCb callback, gpointer data)
+{
+	card->backend->card_install_callback(card, callback, data);
+}
+
+/**
+ * Get the name of the card.
+ *
+ * @param card a BackendCard instance.
+ * @return the name of the card.
+ */
+const char *
+backend_card_get_name(BackendCard *card)
+{
+	return card->backend->card_get_name(card);
+}
+
+/**
+ * Get the name of the channel in use.
+ *
+ * @param card a BackendCard instance.
+ * @return the name of the channel.
+ */
+const char *
+backend_card_get_channel(BackendCard *card)
+{
+	return card->backend->card_get_channel(card);
+}
+
+/**
+ * Whether the channel has mute capabilities.
+ *
+ * @param card a BackendCard instance.
+ * @return TRUE if the channel can be muted, FALSE otherwise.
+ */
+gboolean
+backend_card_has_mute(BackendCard *card)
+{
+	return card->backend->card_has_mute(card);
+}
+
+/**
+ * Get the mute state.
+ *
+ * @param card a BackendCard instance.
+ * @return TRUE if the channel is muted, FALSE otherwise.
+ */
+gboolean
+backend_card_is_muted(BackendCard *card)
+{
+	return card->backend->card_is_muted(card);
+}
+
+/**
+ * Toggle the mute state.
+ *
+ * @param card a BackendCard instance.
+ */
+void
+backend_card_toggle_mute(BackendCard *card)
+{
+	card->backend->card_toggle_mute(card);
+}
+
+/**
+ * Get the volume in percent.
+ *
+ * @param card a BackendCard instance.
+ * @return the volume in percent.
+ */
+gdouble
+backend_card_get_volume(BackendCard *card)
+{
+	return card->backend->card_get_volume(card);
+}
+
+/**
+ * Set the volume in percent.
+ *
+ * @param card a BackendCard instance.
+ * @param value the volume in percent.
+ * @param dir the direction for rounding
+ *        (-1: lowering, +1: raising, 0: setting).
+ */
+void
+backend_card_set_volume(BackendCard *card, gdouble value, int dir)
+{
+	card->backend->card_set_volume(card, value, dir);
+}
+
+/**
+ * Get the volume of each channel, along with the balance.
+ *
+ * @param card a BackendCard instance.
+ * @param volumes the structure to fill.
+ */
+void
+backend_card_get_volumes(BackendCard *card, BackendVolumes *volumes)
+{
+	card->backend->card_get_volumes(card, volumes);
+}
+
+/**
+ * Set the volume of each channel.
+ *
+ * @param card a BackendCard instance.
+ * @param volumes the volumes to set, in percent.
+ * @param dir the direction for rounding, see backend_card_set_volume().
+ */
+void
+backend_card_set_volumes(BackendCard *card, const BackendVolumes *volumes, int dir)
+{
+	card->backend->card_set_volumes(card, volumes, dir);
+}
+
+/**
+ * Get the volume as a step index. Steps are the smallest changes the
+ * card can make, so that stepping the volume by one index is never lost.
+ * Backends that don't know better have 100 steps of 1 percent.
+ *
+ * @param card a BackendCard instance.
+ * @param step where to store the step index.
+ * @param n_steps where to store the number of steps.
+ */
+void
+backend_card_get_steps(BackendCard *card, guint *step, guint *n_steps)
+{
+	if (card->backend->card_get_steps) {
+		card->backend->card_get_steps(card, step, n_steps);
+		return;
+	}
+
+	*step = lrint(backend_card_get_volume(card));
+	*n_steps = 100;
+}
+
+/**
+ * Apply a transaction, that is a few operations in one go.
+ * Backends that can't do better get the operations one by one.
+ *
+ * @param card a BackendCard instance.
+ * @param trans the transaction to apply.
+ * @return TRUE if the volume or the mute state changed, FALSE otherwise.
+ */
+gboolean
+backend_card_apply(BackendCard *card, const BackendTransaction *trans)
+{
+	BackendOutcome outcome;
+	BackendVolumes volumes;
+	gdouble volume;
+	gboolean muted, volumes_changed = FALSE;
+	guint step, n_steps, i;
+
+	if (card->backend->card_apply)
+		return card->backend->card_apply(card, trans);
+
+	/* Without card_get_steps(), steps are percents */
+	volume = backend_card_get_volume(card);
+	muted = backend_card_is_muted(card);
+	backend_card_get_steps(card, &step, &n_steps);
+	backend_transaction_resolve(trans, volume, muted, n_steps, &outcome);
+
+	/* Mute before the volume changes, unmute after */
+	if (outcome.set_mute && outcome.muted && !muted)
+		backend_card_toggle_mute(card);
+
+	if (outcome.set_volumes) {
+		backend_card_get_volumes(card, &volumes);
+		backend_card_set_volumes(card, &outcome.volumes, outcome.dir);
+		volumes_changed = TRUE;
+	} else if (outcome.set_volume && outcome.volume != volume) {
+		backend_card_set_volume(card, outcome.volume, outcome.dir);
+	}
+
+	/* A volume step the backend rounded away would be lost,
+	 * so move by one step at least.
+	 */
+	if (outcome.stepped && backend_card_get_volume(card) == volume &&
+	    n_steps > 0) {
+		if (outcome.dir > 0 && step < n_steps)
+			backend_card_set_volume(card, (step + 1) * 100.0 / n_steps, +1);
+		else if (outcome.dir < 0 && step > 0)
+			backend_card_set_volume(card, (step - 1) * 100.0 / n_steps, -1);
+	}
+
+	if (outcome.set_mute && !outcome.muted && muted)
+		backend_card_toggle_mute(card);
+
+	/* The balance may change while the volume stays */
+	if (volumes_changed) {
+		BackendVolumes now;
+
+		backend_card_get_volumes(card, &now);
+		volumes_changed = now.n_channels != volumes.n_channels ||
+		                  now.balance != volumes.balance;
+		for (i = 0; i < now.n_channels && !volumes_changed; i++)
+			volumes_changed = now.volume[i] != volumes.volume[i];
+	}
+
+	return volumes_changed || backend_card_get_volume(card) != volume ||
+	       backend_card_is_muted(card) != muted;
+}
+
+/**
+ * Merge the operations of a transaction, starting from a given state.
+ * Operations are applied in order, the last one wins. Volume steps
+ * are relative to the volume set so far, and clamped to 0-100.
+ * Step indexes are converted to percents linearly, backends that do
+ * better should use the step index of the outcome. Channel volumes
+ * make the volume of the loudest channel, and are kept in 'volumes'.
+ *
+ * @param trans the transaction to resolve.
+ * @param volume the current volume, in percent.
+ * @param muted the current mute state.
+ * @param n_steps the number of steps of the volume.
+ * @param outcome the structure to fill.
+ */
+void
+backend_transaction_resolve(const BackendTransaction *trans, gdouble volume,
+                            gboolean muted, guint n_steps, BackendOutcome *outcome)
+{
+	guint i, j;
+
+	memset(outcome, 0, sizeof *outcome);
+	outcome->volume = volume;
+	outcome->step = -1;
+	outcome->muted = muted;
+
+	for (i = 0; i < trans->n_ops && i < BACKEND_MAX_OPS; i++) {
+		const BackendOp *op = &trans->ops[i];
+
+		switch (op->type) {
+		case BACKEND_OP_SET_VOLUME:
+			outcome->set_volume = TRUE;
+			outcome->volume = CLAMP(op->value, 0, 100);
+			outcome->dir = op->dir;
+			outcome->step = -1;
+			outcome->stepped = FALSE;
+			outcome->set_volumes = FALSE;
+			break;
+		case BACKEND_OP_STEP_VOLUME:
+			outcome->set_volume = TRUE;
+			outcome->volume = CLAMP(outcome->volume + op->value, 0, 100);
+			outcome->dir = op->value < 0 ? -1 : +1;
+			outcome->step = -1;
+			outcome->stepped = TRUE;
+			outcome->set_volumes = FALSE;
+			break;
+		case BACKEND_OP_SET_STEP:
+			if (n_steps == 0)
+				break;
+			outcome->set_volume = TRUE;
+			outcome->step = CLAMP(lrint(op->value), 0, (long) n_steps);
+			outcome->volume = outcome->step * 100.0 / n_steps;
+			outcome->dir = 0;
+			outcome->stepped = FALSE;
+			outcome->set_volumes = FALSE;
+			break;
+		case BACKEND_OP_SET_VOLUMES:
+			if (op->volumes.n_channels == 0)
+				break;
+			outcome->set_volume = TRUE;
+			outcome->set_volumes = TRUE;
+			outcome->volumes = op->volumes;
+			outcome->volumes.n_channels = MIN(op->volumes.n_channels,
+			                                  BACKEND_MAX_CHANNELS);
+			/* The volume is the one of the loudest channel */
+			outcome->volume = 0;
+			for (j = 0; j < outcome->volumes.n_channels; j++) {
+				outcome->volumes.volume[j] = CLAMP(outcome->volumes.volume[j], 0, 100);
+				outcome->volume = MAX(outcome->volume, outcome->volumes.volume[j]);
+			}
+			outcome->dir = op->dir;
+			outcome->step = -1;
+			outcome->stepped = FALSE;
+			break;
+		case BACKEND_OP_SET_MUTE:
+			outcome->set_mute = TRUE;
+			outcome->muted = op->muted;
+			break;
+		}
+	}
+}
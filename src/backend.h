@@ -0,0 +1,191 @@
+/* backend.h
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file backend.h
+ * Header for backend.c.
+ * @brief Header for backend.c.
+ */
+
+#ifndef _BACKEND_H_
+#define _BACKEND_H_
+
+#include <glib.h>
+
+/* Types shared by every backend */
+
+enum backend_stream {
+	BACKEND_STREAM_PLAYBACK,
+	BACKEND_STREAM_CAPTURE
+};
+
+typedef enum backend_stream BackendStream;
+
+/* Name of the card that follows the system default, every backend has one */
+#define BACKEND_DEFAULT_CARD "(default)"
+
+#define BACKEND_MAX_CHANNELS 8
+
+struct backend_volumes {
+	guint n_channels;
+	gdouble volume[BACKEND_MAX_CHANNELS]; /* In percent */
+	gdouble balance; /* From -1 (left) to +1 (right) */
+};
+
+typedef struct backend_volumes BackendVolumes;
+
+/* Transactions: a few operations applied to a card in one go */
+
+enum backend_op_type {
+	BACKEND_OP_SET_VOLUME,  /* Set the volume to 'value' percent */
+	BACKEND_OP_STEP_VOLUME, /* Add 'value' percent to the volume, moving
+	                         * by one hardware step at least */
+	BACKEND_OP_SET_STEP,    /* Set the volume to the step index 'value' */
+	BACKEND_OP_SET_VOLUMES, /* Set the volume of each channel to 'volumes' */
+	BACKEND_OP_SET_MUTE     /* Set the mute state to 'muted' */
+};
+
+struct backend_op {
+	enum backend_op_type type;
+	gdouble value;
+	int dir;
+	gboolean muted;
+	BackendVolumes volumes;
+};
+
+typedef struct backend_op BackendOp;
+
+#define BACKEND_MAX_OPS 4
+
+struct backend_transaction {
+	guint n_ops;
+	BackendOp ops[BACKEND_MAX_OPS];
+};
+
+typedef struct backend_transaction BackendTransaction;
+
+/* What a transaction comes down to, once its operations are merged */
+struct backend_outcome {
+	gboolean set_volume;
+	gdouble volume;
+	int dir;
+	gint step;        /* Step index to set, -1 if the volume is in percent */
+	gboolean stepped; /* Whether the volume was stepped, and must move */
+	gboolean set_volumes; /* Whether 'volumes' holds the volume to set */
+	BackendVolumes volumes;
+	gboolean set_mute;
+	gboolean muted;
+};
+
+typedef struct backend_outcome BackendOutcome;
+
+enum backend_event {
+	BACKEND_CARD_ERROR,
+	BACKEND_CARD_DISCONNECTED,
+	BACKEND_CARD_VALUES_CHANGED
+};
+
+enum backend_change {
+	BACKEND_CHANGE_VOLUME = 1 << 0,
+	BACKEND_CHANGE_SWITCH = 1 << 1,
+	BACKEND_CHANGE_INFO   = 1 << 2,
+	BACKEND_CHANGE_REMOVE = 1 << 3
+};
+
+typedef void (*BackendCb) (enum backend_event event, guint changes, gpointer data);
+
+typedef void (*BackendCardsCb) (gpointer data);
+
+/* Backend operations.
+ * A backend is a table of functions. Cards created by a backend must
+ * start with a BackendCard struct, so that we can find the functions
+ * to use from the card itself.
+ */
+
+typedef struct backend Backend;
+typedef struct backend_card BackendCard;
+
+struct backend {
+	const char *name;
+	/* Listing, no card needed */
+	GSList *(*list_cards) (void);
+	GSList *(*list_channels) (const char *card_name, BackendStream stream);
+	/* Hotplug, to be notified when the list of cards changes */
+	void (*set_cards_callback) (BackendCardsCb callback, gpointer data);
+	/* Optional, release what is kept between calls (registry, watches) */
+	void (*cleanup) (void);
+	/* Card life cycle */
+	BackendCard *(*card_new) (const char *card_name, const char *channel,
+	                          BackendStream stream, gboolean normalize);
+	void (*card_free) (BackendCard *card);
+	gboolean (*card_link_channel) (BackendCard *card, const char *channel,
+	                               gdouble weight);
+	void (*card_install_callback) (BackendCard *card, BackendCb callback,
+	                               gpointer data);
+	/* Card state */
+	const char *(*card_get_name) (BackendCard *card);
+	const char *(*card_get_channel) (BackendCard *card);
+	gboolean (*card_has_mute) (BackendCard *card);
+	gboolean (*card_is_muted) (BackendCard *card);
+	void (*card_toggle_mute) (BackendCard *card);
+	gdouble (*card_get_volume) (BackendCard *card);
+	void (*card_set_volume) (BackendCard *card, gdouble value, int dir);
+	void (*card_get_volumes) (BackendCard *card, BackendVolumes *volumes);
+	void (*card_set_volumes) (BackendCard *card, const BackendVolumes *volumes,
+	                          int dir);
+	/* Optional, the volume has 100 steps of 1 percent otherwise */
+	void (*card_get_steps) (BackendCard *card, guint *step, guint *n_steps);
+	/* Optional, operations are applied one by one otherwise */
+	gboolean (*card_apply) (BackendCard *card, const BackendTransaction *trans);
+};
+
+struct backend_card {
+	const Backend *backend;
+};
+
+const Backend *backend_get(const char *name);
+
+guint backend_attach_source(GSource *source, GSourceFunc func, gpointer data);
+void backend_remove_source(guint id);
+
+GSList *backend_list_cards(const Backend *backend);
+GSList *backend_list_channels(const Backend *backend, const char *card_name,
+                              BackendStream stream);
+void backend_set_cards_callback(const Backend *backend, BackendCardsCb callback,
+                                gpointer data);
+void backend_cleanup(const Backend *backend);
+
+BackendCard *backend_card_new(const Backend *backend, const char *card_name,
+                              const char *channel, BackendStream stream,
+                              gboolean normalize);
+void backend_card_free(BackendCard *card);
+gboolean backend_card_link_channel(BackendCard *card, const char *channel,
+                                   gdouble weight);
+void backend_card_install_callback(BackendCard *card, BackendCb callback,
+                                   gpointer data);
+
+const char *backend_card_get_name(BackendCard *card);
+const char *backend_card_get_channel(BackendCard *card);
+gboolean backend_card_has_mute(BackendCard *card);
+gboolean backend_card_is_muted(BackendCard *card);
+void backend_card_toggle_mute(BackendCard *card);
+gdouble backend_card_get_volume(BackendCard *card);
+void backend_card_set_volume(BackendCard *card, gdouble value, int dir);
+void backend_card_get_volumes(BackendCard *card, BackendVolumes *volumes);
+void backend_card_set_volumes(BackendCard *card, const BackendVolumes *volumes,
+                              int dir);
+void backend_card_get_steps(BackendCard *card, guint *step, guint *n_steps);
+gboolean backend_card_apply(BackendCard *card, const BackendTransaction *trans);
+
+void backend_transaction_resolve(const BackendTransaction *trans, gdouble volume,
+                                 gboolean muted, guint n_steps,
+                                 BackendOutcome *outcome);
+
+#endif				// _BACKEND_H_
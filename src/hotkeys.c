@@ -67,10 +67,12 @@ hotkeys_add_filter(GdkFilterFunc filter, gpointer data)
 struct hotkeys {
 	/* Audio system */
 	Audio  *audio;
+	gchar  *card; /* Card to control, NULL for the active one */
 	/* Hotkeys */
 	Hotkey *mute_hotkey;
 	Hotkey *up_hotkey;
 	Hotkey *down_hotkey;
+	Hotkey *mic_mute_hotkey;
 };
 
 /**
@@ -90,6 +92,7 @@ key_filter(GdkXEvent *gdk_xevent, G_GNUC_UNUSED GdkEvent *event, gpointer data)
 	Hotkey *mute_hotkey = hotkeys->mute_hotkey;
 	Hotkey *up_hotkey   = hotkeys->up_hotkey;
 	Hotkey *down_hotkey = hotkeys->down_hotkey;
+	Hotkey *mic_mute_hotkey = hotkeys->mic_mute_hotkey;
 	Audio *audio = hotkeys->audio;
 	gint type;
 	guint key, state;
@@ -98,6 +101,14 @@ key_filter(GdkXEvent *gdk_xevent, G_GNUC_UNUSED GdkEvent *event, gpointer data)
 	if (type != KeyPress)
 		return GDK_FILTER_CONTINUE;
 
+	/* Hotkeys may control a specific card, rather than the active one */
+	if (hotkeys->card) {
+		Audio *instance = audio_get_card_instance(audio, hotkeys->card);
+
+		if (instance)
+			audio = instance;
+	}
+
 	key = xevent->keycode;
 	state = xevent->state;
 
@@ -107,6 +118,8 @@ key_filter(GdkXEvent *gdk_xevent, G_GNUC_UNUSED GdkEvent *event, gpointer data)
 		audio_raise_volume(audio, AUDIO_USER_HOTKEYS);
 	else if (down_hotkey && hotkey_matches(down_hotkey, key, state))
 		audio_lower_volume(audio, AUDIO_USER_HOTKEYS);
+	else if (mic_mute_hotkey && hotkey_matches(mic_mute_hotkey, key, state))
+		audio_toggle_capture_mute(audio, AUDIO_USER_HOTKEYS);
 
 	return GDK_FILTER_CONTINUE;
 }
@@ -122,7 +135,7 @@ hotkeys_reload(Hotkeys *hotkeys)
 {
 	gboolean enabled;
 	gint key, mods;
-	gboolean mute_err, up_err, down_err;
+	gboolean mute_err, up_err, down_err, mic_mute_err;
 
 	/* Free any hotkey that may be currently assigned */
 	hotkey_free(hotkeys->mute_hotkey);
@@ -134,6 +147,17 @@ hotkeys_reload(Hotkeys *hotkeys)
 	hotkey_free(hotkeys->down_hotkey);
 	hotkeys->down_hotkey = NULL;
 
+	hotkey_free(hotkeys->mic_mute_hotkey);
+	hotkeys->mic_mute_hotkey = NULL;
+
+	/* Get the card to control, empty means the active one */
+	g_free(hotkeys->card);
+	hotkeys->card = prefs_get_string("HotkeysCard", NULL);
+	if (hotkeys->card && hotkeys->card[0] == '\0') {
+		g_free(hotkeys->card);
+		hotkeys->card = NULL;
+	}
+
 	/* Return if hotkeys are disabled */
 	enabled = prefs_get_boolean("EnableHotKeys", FALSE);
 	if (enabled == FALSE)
@@ -169,16 +193,28 @@ hotkeys_reload(Hotkeys *hotkeys)
 			down_err = TRUE;
 	}
 
+	/* Setup microphone mute hotkey */
+	mic_mute_err = FALSE;
+	key = prefs_get_integer("MicMuteKey", -1);
+	mods = prefs_get_integer("MicMuteMods", 0);
+	if (key != -1) {
+		hotkeys->mic_mute_hotkey = hotkey_new(key, mods);
+		if (hotkeys->mic_mute_hotkey == NULL)
+			mic_mute_err = TRUE;
+	}
+
 	/* Display error message if needed */
-	if (mute_err || up_err || down_err) {
-		run_error_dialog("%s:\n%s%s%s%s%s%s",
+	if (mute_err || up_err || down_err || mic_mute_err) {
+		run_error_dialog("%s:\n%s%s%s%s%s%s%s%s",
 		                 _("Could not grab the following HotKeys"),
 		                 mute_err ? _("Mute/Unmute") : "",
 		                 mute_err ? "\n" : "",
 		                 up_err ? _("Volume Up") : "",
 		                 up_err ? "\n" : "",
 		                 down_err ? _("Volume Down") : "",
-		                 down_err ? "\n" : ""
+		                 down_err ? "\n" : "",
+		                 mic_mute_err ? _("Microphone Mute/Unmute") : "",
+		                 mic_mute_err ? "\n" : ""
 		                );
 	}
 }
@@ -199,6 +235,8 @@ hotkeys_unbind(Hotkeys *hotkeys)
 		hotkey_ungrab(hotkeys->up_hotkey);
 	if (hotkeys->down_hotkey)
 		hotkey_ungrab(hotkeys->down_hotkey);
+	if (hotkeys->mic_mute_hotkey)
+		hotkey_ungrab(hotkeys->mic_mute_hotkey);
 }
 
 /**
@@ -215,6 +253,8 @@ hotkeys_bind(Hotkeys *hotkeys)
 		hotkey_grab(hotkeys->up_hotkey);
 	if (hotkeys->down_hotkey)
 		hotkey_grab(hotkeys->down_hotkey);
+	if (hotkeys->mic_mute_hotkey)
+		hotkey_grab(hotkeys->mic_mute_hotkey);
 
 	hotkeys_add_filter(key_filter, hotkeys);
 }
@@ -237,6 +277,8 @@ hotkeys_free(Hotkeys *hotkeys)
 	hotkey_free(hotkeys->mute_hotkey);
 	hotkey_free(hotkeys->up_hotkey);
 	hotkey_free(hotkeys->down_hotkey);
+	hotkey_free(hotkeys->mic_mute_hotkey);
+	g_free(hotkeys->card);
 	g_free(hotkeys);
 }
 
@@ -38,9 +38,11 @@
 
 /* Life-long instances */
 static Audio *audio;
+static guint audio_handler;
 static PopupMenu *popup_menu;
 static PopupWindow *popup_window;
 static TrayIcon *tray_icon;
+static GSList *card_tray_icons; /* One per card, if enabled */
 static Hotkeys *hotkeys;
 static Notif *notif;
 
@@ -117,6 +119,8 @@ run_custom_command(void)
 static void
 prefs_dialog_response_cb(PrefsDialog *this_dialog, gint response_id)
 {
+	GSList *item;
+
 	g_assert(this_dialog == prefs_dialog);
 
 	/* Get values from the prefs dialog */
@@ -138,6 +142,8 @@ prefs_dialog_response_cb(PrefsDialog *this_dialog, gint response_id)
 		/* Ask every instance to reload its preferences */
 		popup_window_reload(popup_window);
 		tray_icon_reload(tray_icon);
+		for (item = card_tray_icons; item; item = item->next)
+			tray_icon_reload(item->data);
 		hotkeys_reload(hotkeys);
 		notif_reload(notif);
 		audio_reload(audio);
@@ -280,6 +286,34 @@ do_show_popup_menu(GtkMenuPositionFunc func, gpointer data, guint button, guint
 	popup_menu_show(popup_menu, func, data, button, activate_time);
 }
 
+/**
+ * Create a tray icon for each card, or destroy them all, according
+ * to the preferences. Card instances are never removed, and new ones are
+ * appended to the list, so the icons are in the same order as the card
+ * instances, and we only have to create icons for the new ones.
+ */
+static void
+update_card_tray_icons(void)
+{
+	GSList *item;
+	guint n_icons;
+
+	if (!prefs_get_boolean("TrayIconPerCard", FALSE)) {
+		g_slist_free_full(card_tray_icons, (GDestroyNotify) tray_icon_destroy);
+		card_tray_icons = NULL;
+		return;
+	}
+
+	n_icons = g_slist_length(card_tray_icons);
+	item = g_slist_nth(audio_get_card_instances(audio), n_icons);
+	for (; item; item = item->next) {
+		Audio *instance = item->data;
+
+		card_tray_icons = g_slist_append(card_tray_icons,
+		                                 tray_icon_create(instance));
+	}
+}
+
 /**
  * Handle signals from the audio subsystem.
  *
@@ -288,9 +322,13 @@ do_show_popup_menu(GtkMenuPositionFunc func, gpointer data, guint button, guint
  * @param data user supplied data.
  */
 static void
-on_audio_changed(Audio *audio, AudioEvent *event, G_GNUC_UNUSED gpointer data)
+on_audio_changed(Audio *audio, const AudioEvent *event, G_GNUC_UNUSED gpointer data)
 {
 	switch (event->signal) {
+	case AUDIO_NO_CARD:
+	case AUDIO_CARD_INITIALIZED:
+		update_card_tray_icons();
+		break;
 	case AUDIO_CARD_DISCONNECTED:
 		audio_reload(audio);
 		break;
@@ -368,7 +406,13 @@ main(int argc, char *argv[])
 	notif = notif_new(audio);
 
 	/* Get the audio system ready */
-	audio_signals_connect(audio, on_audio_changed, NULL);
+	audio_handler = audio_signals_connect_full
+	                (audio, on_audio_changed, NULL,
+	                 AUDIO_SIGNAL_MASK(AUDIO_NO_CARD) |
+	                 AUDIO_SIGNAL_MASK(AUDIO_CARD_INITIALIZED) |
+	                 AUDIO_SIGNAL_MASK(AUDIO_CARD_DISCONNECTED) |
+	                 AUDIO_SIGNAL_MASK(AUDIO_CARD_ERROR),
+	                 AUDIO_ALL_USERS, NULL);
 	audio_reload(audio);
 
 	/* Run */
@@ -377,9 +421,10 @@ main(int argc, char *argv[])
 	DEBUG("---- Exiting main loop ----");
 
 	/* Cleanup */
-	audio_signals_disconnect(audio, on_audio_changed, NULL);
+	audio_signals_disconnect(audio, audio_handler);
 	notif_free(notif);
 	hotkeys_free(hotkeys);
+	g_slist_free_full(card_tray_icons, (GDestroyNotify) tray_icon_destroy);
 	tray_icon_destroy(tray_icon);
 	popup_window_destroy(popup_window);
 	popup_menu_destroy(popup_menu);
@@ -0,0 +1,1071 @@
+/* mock.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file mock.c
+ * This file holds an in-memory audio backend, that simulates sound
+ * cards without talking to any hardware. It's there to exercise
+ * everything above the backend layer, on a machine with no sound card,
+ * and to reproduce nasty situations on demand: slow writes, weird step
+ * counts, external changes in bursts, cards coming and going.
+ *
+ * The mock is configured through the PNMIXER_MOCK environment variable,
+ * a comma-separated list of key=value pairs:
+ *  - cards: number of simulated cards (default 1).
+ *  - steps: number of volume steps of each mixer elem (default 64).
+ *  - dB-min, dB-max: dB range of the mixer elems, in 0.01 dB
+ *    (default -6400 and 0).
+ *  - curve: 'dB' if the mixer elems report a dB range, 'none' otherwise,
+ *    in which case the volume can't be normalized (default 'dB').
+ *  - latency: time spent in each write, in microseconds (default 0).
+ *  - storm-interval, storm-size: every storm-interval milliseconds,
+ *    apply storm-size random external changes (default 0, disabled).
+ *  - hotplug-interval: every hotplug-interval milliseconds, unplug
+ *    or plug back a random card (default 0, disabled).
+ *  - seed: seed of the random generator, so that runs are
+ *    reproducible (default 0).
+ *
+ * Like Alsa, the mock notifies a card about the changes made by
+ * someone else, asynchronously, from the main loop.
+ * @brief In-memory audio backend.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "backend.h"
+#include "mock.h"
+#include "support-log.h"
+
+#define MOCK_DEFAULT_CARD BACKEND_DEFAULT_CARD
+#define MOCK_N_CHANNELS 2
+
+/*
+ * Configuration.
+ */
+
+struct mock_config {
+	guint n_cards;
+	long steps;
+	long dB_min;
+	long dB_max;
+	gboolean dB_ok;
+	gulong latency;
+	guint storm_interval;
+	guint storm_size;
+	guint hotplug_interval;
+	guint32 seed;
+};
+
+typedef struct mock_config MockConfig;
+
+/* Parse the PNMIXER_MOCK environment variable */
+static void
+mock_config_load(MockConfig *config)
+{
+	const gchar *env;
+	gchar **items, **item;
+
+	config->n_cards = 1;
+	config->steps = 64;
+	config->dB_min = -6400;
+	config->dB_max = 0;
+	config->dB_ok = TRUE;
+	config->latency = 0;
+	config->storm_interval = 0;
+	config->storm_size = 0;
+	config->hotplug_interval = 0;
+	config->seed = 0;
+
+	env = g_getenv("PNMIXER_MOCK");
+	if (env == NULL)
+		return;
+
+	items = g_strsplit(env, ",", -1);
+	for (item = items; *item; item++) {
+		gchar **kv = g_strsplit(*item, "=", 2);
+		const gchar *key = kv[0];
+		const gchar *value = kv[1];
+
+		if (value == NULL)
+			WARN("Mock: ignoring '%s', no value", key);
+		else if (!g_strcmp0(key, "cards"))
+			config->n_cards = strtoul(value, NULL, 10);
+		else if (!g_strcmp0(key, "steps"))
+			config->steps = MAX(strtol(value, NULL, 10), 1);
+		else if (!g_strcmp0(key, "dB-min"))
+			config->dB_min = strtol(value, NULL, 10);
+		else if (!g_strcmp0(key, "dB-max"))
+			config->dB_max = strtol(value, NULL, 10);
+		else if (!g_strcmp0(key, "curve"))
+			config->dB_ok = g_strcmp0(value, "none") != 0;
+		else if (!g_strcmp0(key, "latency"))
+			config->latency = strtoul(value, NULL, 10);
+		else if (!g_strcmp0(key, "storm-interval"))
+			config->storm_interval = strtoul(value, NULL, 10);
+		else if (!g_strcmp0(key, "storm-size"))
+			config->storm_size = strtoul(value, NULL, 10);
+		else if (!g_strcmp0(key, "hotplug-interval"))
+			config->hotplug_interval = strtoul(value, NULL, 10);
+		else if (!g_strcmp0(key, "seed"))
+			config->seed = strtoul(value, NULL, 10);
+		else
+			WARN("Mock: unknown setting '%s'", key);
+
+		g_strfreev(kv);
+	}
+	g_strfreev(items);
+
+	if (config->dB_min >= config->dB_max)
+		config->dB_ok = FALSE;
+}
+
+/*
+ * Simulated hardware.
+ * A device is a sound card, with a few mixer elems. Devices live as long
+ * as the program, unplugging a device just marks it as absent.
+ */
+
+struct mock_elem {
+	char *name;
+	BackendStream stream;
+	long raw[MOCK_N_CHANNELS];
+	gboolean muted;
+};
+
+typedef struct mock_elem MockElem;
+
+struct mock_device {
+	char *name;
+	gboolean present;
+	MockElem *elems;
+	guint n_elems;
+};
+
+typedef struct mock_device MockDevice;
+
+typedef struct mock_card MockCard;
+
+static struct {
+	gboolean initialized;
+	MockConfig config;
+	GRand *rand;
+	MockDevice *devices;
+	guint n_devices;
+	GSList *cards; /* Every card handle, list of MockCard */
+	BackendCardsCb cards_cb_func;
+	gpointer cards_cb_data;
+	guint n_writes;
+	guint n_list_cards;
+	guint storm_id;
+	guint hotplug_id;
+} mock;
+
+static const struct {
+	const char *name;
+	BackendStream stream;
+} mock_elem_templates[] = {
+	{ "Master", BACKEND_STREAM_PLAYBACK },
+	{ "PCM", BACKEND_STREAM_PLAYBACK },
+	{ "Headphone", BACKEND_STREAM_PLAYBACK },
+	{ "Capture", BACKEND_STREAM_CAPTURE },
+};
+
+/* Simulate the time a write takes on real hardware */
+static void
+mock_write_delay(void)
+{
+	mock.n_writes++;
+
+	if (mock.config.latency)
+		g_usleep(mock.config.latency);
+}
+
+/* Look for a device by name, absent devices are ignored */
+static MockDevice *
+mock_device_lookup(const char *card_name)
+{
+	guint i;
+
+	for (i = 0; i < mock.n_devices; i++) {
+		MockDevice *device = &mock.devices[i];
+
+		if (!device->present)
+			continue;
+
+		if (card_name == NULL || !g_strcmp0(card_name, MOCK_DEFAULT_CARD))
+			return device;
+
+		if (!g_strcmp0(device->name, card_name))
+			return device;
+	}
+
+	return NULL;
+}
+
+/* Look for an elem of a device, NULL channel means the first one */
+static MockElem *
+mock_device_get_elem(MockDevice *device, const char *channel,
+                     BackendStream stream)
+{
+	guint i;
+
+	for (i = 0; i < device->n_elems; i++) {
+		MockElem *elem = &device->elems[i];
+
+		if (elem->stream != stream)
+			continue;
+
+		if (channel == NULL || !g_strcmp0(elem->name, channel))
+			return elem;
+	}
+
+	return NULL;
+}
+
+/*
+ * Volume conversion.
+ * Same maths as the Alsa backend, so that the mock behaves like
+ * a real card with a linear dB scale.
+ */
+
+static long
+mock_round(double value, int dir)
+{
+	if (dir > 0)
+		return (long) ceil(value);
+	else if (dir < 0)
+		return (long) floor(value);
+	else
+		return lrint(value);
+}
+
+/* Convert a raw value to a volume between 0 and 1 */
+static gdouble
+mock_raw_to_volume(long raw, gboolean normalize)
+{
+	const MockConfig *config = &mock.config;
+	double dB, min_norm, volume;
+
+	if (!normalize || !config->dB_ok)
+		return raw / (double) config->steps;
+
+	if (raw == 0)
+		return 0;
+
+	dB = config->dB_min + (config->dB_max - config->dB_min) *
+	     raw / (double) config->steps;
+	min_norm = pow(10, (config->dB_min - config->dB_max) / 6000.0);
+	volume = pow(10, (dB - config->dB_max) / 6000.0);
+
+	return (volume - min_norm) / (1 - min_norm);
+}
+
+/* Convert a volume between 0 and 1 to a raw value */
+static long
+mock_volume_to_raw(gdouble volume, gboolean normalize, int dir)
+{
+	const MockConfig *config = &mock.config;
+	double dB, min_norm;
+	long raw;
+
+	volume = CLAMP(volume, 0, 1);
+
+	if (!normalize || !config->dB_ok) {
+		raw = mock_round(volume * config->steps, dir);
+	} else if (volume == 0) {
+		raw = 0;
+	} else {
+		min_norm = pow(10, (config->dB_min - config->dB_max) / 6000.0);
+		dB = 6000.0 * log10(volume * (1 - min_norm) + min_norm) +
+		     config->dB_max;
+		raw = mock_round((dB - config->dB_min) * config->steps /
+		                 (config->dB_max - config->dB_min), dir);
+	}
+
+	return CLAMP(raw, 0, config->steps);
+}
+
+/*
+ * Card handles.
+ */
+
+/* A mixer elem that follows the main mixer elem of a card */
+struct mock_link {
+	MockElem *elem;
+	gdouble weight;
+	gboolean synced; /* Whether we wrote it already */
+	gboolean moved; /* Whether someone else changed it since */
+};
+
+typedef struct mock_link MockLink;
+
+struct mock_card {
+	BackendCard parent; /* Must come first */
+	gboolean normalize;
+	BackendStream stream;
+	char *name;
+	char *channel;
+	/* Simulated hardware */
+	MockDevice *device;
+	MockElem *elem;
+	GSList *linked; /* List of MockLink */
+	gdouble balance; /* From -1 (left) to +1 (right) */
+	/* Events not delivered yet */
+	guint pending;
+	gboolean disconnected;
+	guint idle_id;
+	/* User callback, to notify when something happens */
+	BackendCb cb_func;
+	gpointer cb_data;
+};
+
+#define MOCK_CARD(card) ((MockCard *) (card))
+
+static void mock_card_restore_linked(MockCard *card);
+
+/* Deliver the pending events to the user callback */
+static gboolean
+mock_card_dispatch(MockCard *card)
+{
+	guint changes = card->pending;
+
+	card->idle_id = 0;
+	card->pending = 0;
+
+	if (!card->disconnected)
+		mock_card_restore_linked(card);
+
+	if (card->cb_func == NULL)
+		return G_SOURCE_REMOVE;
+
+	if (card->disconnected)
+		card->cb_func(BACKEND_CARD_DISCONNECTED, BACKEND_CHANGE_REMOVE,
+		              card->cb_data);
+	else if (changes)
+		card->cb_func(BACKEND_CARD_VALUES_CHANGED, changes, card->cb_data);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Queue some changes, they're delivered from the main loop */
+static void
+mock_card_queue(MockCard *card, guint changes)
+{
+	card->pending |= changes;
+
+	if (card->idle_id == 0)
+		card->idle_id = backend_attach_source(g_idle_source_new(),
+		                                      (GSourceFunc) mock_card_dispatch, card);
+}
+
+/* Tell every card using an elem that it changed, except the one that
+ * made the change, if any.
+ */
+static void
+mock_notify_elem(MockElem *elem, MockCard *origin, guint changes)
+{
+	GSList *item;
+
+	for (item = mock.cards; item; item = item->next) {
+		MockCard *card = item->data;
+		GSList *link;
+
+		if (card == origin)
+			continue;
+
+		if (card->elem == elem) {
+			mock_card_queue(card, changes);
+			continue;
+		}
+
+		for (link = card->linked; link; link = link->next) {
+			MockLink *linked = link->data;
+
+			/* Nothing to report, but the card has to look at it */
+			if (linked->elem == elem) {
+				linked->moved = TRUE;
+				mock_card_queue(card, 0);
+				break;
+			}
+		}
+	}
+}
+
+/* Tell every card of a device that it's gone */
+static void
+mock_notify_unplug(MockDevice *device)
+{
+	GSList *item;
+
+	for (item = mock.cards; item; item = item->next) {
+		MockCard *card = item->data;
+
+		if (card->device != device)
+			continue;
+
+		card->disconnected = TRUE;
+		mock_card_queue(card, BACKEND_CHANGE_REMOVE);
+	}
+}
+
+/* Volume of a channel, according to the balance */
+static gdouble
+mock_balanced(gdouble volume, gdouble balance, guint channel)
+{
+	if (channel == 0 && balance > 0)
+		return volume * (1 - balance);
+	if (channel == 1 && balance < 0)
+		return volume * (1 + balance);
+	return volume;
+}
+
+/* Write the volume of an elem, volume being between 0 and 1 */
+static void
+mock_elem_write(MockElem *elem, gdouble volume, gdouble balance,
+                gboolean normalize, int dir)
+{
+	guint i;
+
+	for (i = 0; i < MOCK_N_CHANNELS; i++)
+		elem->raw[i] = mock_volume_to_raw(mock_balanced(volume, balance, i),
+		                                  normalize, dir);
+
+	mock_write_delay();
+}
+
+/* Get the volume of the loudest channel of an elem, between 0 and 1 */
+static gdouble
+mock_elem_read(MockElem *elem, gboolean normalize)
+{
+	gdouble volume = 0;
+	guint i;
+
+	for (i = 0; i < MOCK_N_CHANNELS; i++)
+		volume = MAX(volume, mock_raw_to_volume(elem->raw[i], normalize));
+
+	return volume;
+}
+
+/* Update the balance from the current volumes, unless everything
+ * is at zero, in which case the balance is lost and we keep the old one.
+ */
+static void
+mock_card_update_balance(MockCard *card)
+{
+	gdouble left, right, loudest;
+
+	left = mock_raw_to_volume(card->elem->raw[0], card->normalize);
+	right = mock_raw_to_volume(card->elem->raw[1], card->normalize);
+	loudest = MAX(left, right);
+
+	if (loudest > 0)
+		card->balance = (right - left) / loudest;
+}
+
+/* Write the linked elems, after the main one changed */
+static void
+mock_card_sync_linked(MockCard *card, int dir)
+{
+	gdouble volume = mock_elem_read(card->elem, card->normalize);
+	GSList *item;
+
+	for (item = card->linked; item; item = item->next) {
+		MockLink *linked = item->data;
+
+		mock_elem_write(linked->elem, volume * linked->weight, card->balance,
+		                card->normalize, dir);
+		linked->elem->muted = card->elem->muted;
+		linked->synced = TRUE;
+		mock_notify_elem(linked->elem, card, BACKEND_CHANGE_VOLUME |
+		                 BACKEND_CHANGE_SWITCH);
+	}
+}
+
+/* Whether a linked elem matches the main one, with the given rounding */
+static gboolean
+mock_link_matches(MockCard *card, MockLink *linked, gdouble volume, int dir)
+{
+	guint i;
+
+	for (i = 0; i < MOCK_N_CHANNELS; i++) {
+		gdouble chan_volume = mock_balanced(volume * linked->weight,
+		                                    card->balance, i);
+
+		if (linked->elem->raw[i] != mock_volume_to_raw(chan_volume,
+		                                               card->normalize, dir))
+			return FALSE;
+	}
+
+	return linked->elem->muted == card->elem->muted;
+}
+
+/* Put back the linked elems that someone else changed, like the Alsa
+ * backend does. Any rounding is fine, so that two cards linking the same
+ * elem never fight over it.
+ */
+static void
+mock_card_restore_linked(MockCard *card)
+{
+	gdouble volume = mock_elem_read(card->elem, card->normalize);
+	GSList *item;
+
+	for (item = card->linked; item; item = item->next) {
+		MockLink *linked = item->data;
+		int dir;
+
+		if (!linked->moved)
+			continue;
+
+		linked->moved = FALSE;
+
+		if (!linked->synced)
+			continue;
+
+		for (dir = -1; dir <= 1; dir++) {
+			if (mock_link_matches(card, linked, volume, dir))
+				break;
+		}
+
+		if (dir <= 1)
+			continue;
+
+		mock_elem_write(linked->elem, volume * linked->weight, card->balance,
+		                card->normalize, 0);
+		linked->elem->muted = card->elem->muted;
+		mock_notify_elem(linked->elem, card, BACKEND_CHANGE_VOLUME |
+		                 BACKEND_CHANGE_SWITCH);
+	}
+}
+
+static const char *
+mock_card_get_name(BackendCard *base)
+{
+	return MOCK_CARD(base)->name;
+}
+
+static const char *
+mock_card_get_channel(BackendCard *base)
+{
+	return MOCK_CARD(base)->channel;
+}
+
+static gboolean
+mock_card_has_mute(G_GNUC_UNUSED BackendCard *base)
+{
+	return TRUE;
+}
+
+static gboolean
+mock_card_is_muted(BackendCard *base)
+{
+	MockCard *card = MOCK_CARD(base);
+
+	return card->elem->muted;
+}
+
+static void
+mock_card_toggle_mute(BackendCard *base)
+{
+	MockCard *card = MOCK_CARD(base);
+
+	if (card->disconnected)
+		return;
+
+	card->elem->muted = !card->elem->muted;
+	mock_write_delay();
+	mock_notify_elem(card->elem, card, BACKEND_CHANGE_SWITCH);
+	mock_card_sync_linked(card, 0);
+}
+
+static gdouble
+mock_card_get_volume(BackendCard *base)
+{
+	MockCard *card = MOCK_CARD(base);
+
+	return mock_elem_read(card->elem, card->normalize) * 100;
+}
+
+static void
+mock_card_set_volume(BackendCard *base, gdouble value, int dir)
+{
+	MockCard *card = MOCK_CARD(base);
+
+	if (card->disconnected)
+		return;
+
+	mock_elem_write(card->elem, value / 100, card->balance,
+	                card->normalize, dir);
+	mock_notify_elem(card->elem, card, BACKEND_CHANGE_VOLUME);
+	mock_card_sync_linked(card, dir);
+}
+
+static void
+mock_card_get_volumes(BackendCard *base, BackendVolumes *volumes)
+{
+	MockCard *card = MOCK_CARD(base);
+	guint i;
+
+	memset(volumes, 0, sizeof *volumes);
+	volumes->n_channels = MOCK_N_CHANNELS;
+	for (i = 0; i < MOCK_N_CHANNELS; i++)
+		volumes->volume[i] = mock_raw_to_volume(card->elem->raw[i],
+		                                        card->normalize) * 100;
+	volumes->balance = card->balance;
+}
+
+static void
+mock_card_set_volumes(BackendCard *base, const BackendVolumes *volumes, int dir)
+{
+	MockCard *card = MOCK_CARD(base);
+	guint i;
+
+	if (card->disconnected)
+		return;
+
+	for (i = 0; i < MOCK_N_CHANNELS && i < volumes->n_channels; i++)
+		card->elem->raw[i] = mock_volume_to_raw(volumes->volume[i] / 100,
+		                                        card->normalize, dir);
+	mock_write_delay();
+
+	mock_card_update_balance(card);
+	mock_notify_elem(card->elem, card, BACKEND_CHANGE_VOLUME);
+	mock_card_sync_linked(card, dir);
+}
+
+static gboolean
+mock_card_link_channel(BackendCard *base, const char *channel, gdouble weight)
+{
+	MockCard *card = MOCK_CARD(base);
+	MockElem *elem;
+	MockLink *linked;
+
+	elem = mock_device_get_elem(card->device, channel, card->stream);
+	if (elem == NULL || elem == card->elem) {
+		WARN("Mock: can't link channel '%s'", channel);
+		return FALSE;
+	}
+
+	linked = g_new0(MockLink, 1);
+	linked->elem = elem;
+	linked->weight = CLAMP(weight, 0, 1);
+	card->linked = g_slist_append(card->linked, linked);
+
+	return TRUE;
+}
+
+static void
+mock_card_install_callback(BackendCard *base, BackendCb callback,
+                           gpointer user_data)
+{
+	MockCard *card = MOCK_CARD(base);
+
+	card->cb_func = callback;
+	card->cb_data = user_data;
+}
+
+static void
+mock_card_free(BackendCard *base)
+{
+	MockCard *card = MOCK_CARD(base);
+
+	if (card == NULL)
+		return;
+
+	if (card->idle_id)
+		backend_remove_source(card->idle_id);
+
+	mock.cards = g_slist_remove(mock.cards, card);
+
+	g_slist_free_full(card->linked, g_free);
+	g_free(card->channel);
+	g_free(card->name);
+	g_free(card);
+}
+
+/*
+ * Simulated events.
+ */
+
+/* Apply a bunch of random changes, as if someone else was playing
+ * with the mixer.
+ */
+static gboolean
+mock_storm_cb(G_GNUC_UNUSED gpointer data)
+{
+	guint i, j;
+
+	for (i = 0; i < mock.config.storm_size; i++) {
+		MockDevice *device;
+		MockElem *elem;
+
+		device = &mock.devices[g_rand_int_range(mock.rand, 0, mock.n_devices)];
+		if (!device->present)
+			continue;
+
+		elem = &device->elems[g_rand_int_range(mock.rand, 0, device->n_elems)];
+		for (j = 0; j < MOCK_N_CHANNELS; j++)
+			elem->raw[j] = g_rand_int_range(mock.rand, 0, mock.config.steps + 1);
+		if (g_rand_int_range(mock.rand, 0, 8) == 0)
+			elem->muted = !elem->muted;
+
+		mock_notify_elem(elem, NULL, BACKEND_CHANGE_VOLUME | BACKEND_CHANGE_SWITCH);
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+/* Unplug a random card, or plug it back */
+static gboolean
+mock_hotplug_cb(G_GNUC_UNUSED gpointer data)
+{
+	MockDevice *device;
+
+	device = &mock.devices[g_rand_int_range(mock.rand, 0, mock.n_devices)];
+	mock_hotplug(device->name, !device->present);
+
+	return G_SOURCE_CONTINUE;
+}
+
+/* Create the simulated devices, the first time the mock is used */
+static void
+mock_ensure(void)
+{
+	guint i, j;
+
+	if (mock.initialized)
+		goto sources;
+
+	mock_config_load(&mock.config);
+	mock.rand = g_rand_new_with_seed(mock.config.seed);
+
+	mock.n_devices = mock.config.n_cards;
+	mock.devices = g_new0(MockDevice, mock.n_devices);
+	for (i = 0; i < mock.n_devices; i++) {
+		MockDevice *device = &mock.devices[i];
+
+		device->name = g_strdup_printf("Mock Card %u", i);
+		device->present = TRUE;
+		device->n_elems = G_N_ELEMENTS(mock_elem_templates);
+		device->elems = g_new0(MockElem, device->n_elems);
+		for (j = 0; j < device->n_elems; j++) {
+			MockElem *elem = &device->elems[j];
+
+			elem->name = g_strdup(mock_elem_templates[j].name);
+			elem->stream = mock_elem_templates[j].stream;
+			elem->raw[0] = elem->raw[1] = mock.config.steps / 2;
+		}
+	}
+
+	DEBUG("Mock: %u card(s), %ld steps, dB range [%ld - %ld]%s, latency %lu us",
+	      mock.n_devices, mock.config.steps, mock.config.dB_min,
+	      mock.config.dB_max, mock.config.dB_ok ? "" : " (unused)",
+	      mock.config.latency);
+
+	mock.initialized = TRUE;
+
+sources:
+	/* The simulated hardware stays, the sources go with mock_cleanup() */
+	if (mock.storm_id == 0 && mock.config.storm_interval && mock.config.storm_size)
+		mock.storm_id = backend_attach_source(g_timeout_source_new(mock.config.storm_interval),
+		                                      mock_storm_cb, NULL);
+
+	if (mock.hotplug_id == 0 && mock.config.hotplug_interval && mock.n_devices)
+		mock.hotplug_id = backend_attach_source(g_timeout_source_new(mock.config.hotplug_interval),
+		                                        mock_hotplug_cb, NULL);
+}
+
+static BackendCard *
+mock_card_new(const char *card_name, const char *channel, BackendStream stream,
+              gboolean normalize)
+{
+	MockDevice *device;
+	MockElem *elem;
+	MockCard *card;
+
+	mock_ensure();
+
+	if (card_name == NULL)
+		card_name = MOCK_DEFAULT_CARD;
+
+	device = mock_device_lookup(card_name);
+	if (device == NULL)
+		return NULL;
+
+	elem = mock_device_get_elem(device, channel, stream);
+	if (elem == NULL)
+		elem = mock_device_get_elem(device, NULL, stream);
+	if (elem == NULL)
+		return NULL;
+
+	card = g_new0(MockCard, 1);
+	card->parent.backend = &mock_backend;
+	card->normalize = normalize;
+	card->stream = stream;
+	card->name = g_strdup(card_name);
+	card->channel = g_strdup(elem->name);
+	card->device = device;
+	card->elem = elem;
+	mock_card_update_balance(card);
+
+	mock.cards = g_slist_prepend(mock.cards, card);
+
+	DEBUG("Mock: card '%s' with channel '%s' initialized !",
+	      card->name, card->channel);
+
+	return &card->parent;
+}
+
+static GSList *
+mock_list_cards(void)
+{
+	GSList *list = NULL;
+	guint i;
+
+	mock_ensure();
+
+	mock.n_list_cards++;
+
+	for (i = 0; i < mock.n_devices; i++) {
+		if (mock.devices[i].present)
+			list = g_slist_prepend(list, g_strdup(mock.devices[i].name));
+	}
+
+	if (list)
+		list = g_slist_prepend(list, g_strdup(MOCK_DEFAULT_CARD));
+
+	return g_slist_reverse(list);
+}
+
+static void
+mock_set_cards_callback(BackendCardsCb callback, gpointer data)
+{
+	mock.cards_cb_func = callback;
+	mock.cards_cb_data = data;
+}
+
+/* Remove the sources of the simulated events, they belong to the main
+ * context of the thread that used the mock. The devices are kept, like
+ * real hardware would be.
+ */
+static void
+mock_cleanup(void)
+{
+	if (mock.storm_id)
+		backend_remove_source(mock.storm_id);
+	if (mock.hotplug_id)
+		backend_remove_source(mock.hotplug_id);
+
+	mock.storm_id = 0;
+	mock.hotplug_id = 0;
+	mock.cards_cb_func = NULL;
+	mock.cards_cb_data = NULL;
+}
+
+static GSList *
+mock_list_channels(const char *card_name, BackendStream stream)
+{
+	MockDevice *device;
+	GSList *list = NULL;
+	guint i;
+
+	mock_ensure();
+
+	device = mock_device_lookup(card_name);
+	if (device == NULL)
+		return NULL;
+
+	for (i = 0; i < device->n_elems; i++) {
+		if (device->elems[i].stream == stream)
+			list = g_slist_prepend(list, g_strdup(device->elems[i].name));
+	}
+
+	return g_slist_reverse(list);
+}
+
+/*
+ * Public functions.
+ */
+
+/* Look for a mixer elem by card and channel name, on either side */
+static MockElem *
+mock_elem_lookup(const char *card_name, const char *channel)
+{
+	MockDevice *device;
+	MockElem *elem = NULL;
+
+	mock_ensure();
+
+	device = mock_device_lookup(card_name);
+	if (device)
+		elem = mock_device_get_elem(device, channel, BACKEND_STREAM_PLAYBACK);
+	if (device && elem == NULL)
+		elem = mock_device_get_elem(device, channel, BACKEND_STREAM_CAPTURE);
+	if (elem == NULL)
+		WARN("Mock: no channel '%s' on card '%s'", channel, card_name);
+
+	return elem;
+}
+
+/**
+ * Simulate a change made by someone else on a mixer elem.
+ * Every card using this mixer elem is notified.
+ *
+ * @param card_name the name of the card.
+ * @param channel the name of the mixer elem.
+ * @param volume the new volume, in percent, for every channel.
+ * @param muted the new mute state.
+ */
+void
+mock_external_change(const char *card_name, const char *channel,
+                     gdouble volume, gboolean muted)
+{
+	MockElem *elem;
+
+	elem = mock_elem_lookup(card_name, channel);
+	if (elem == NULL)
+		return;
+
+	elem->raw[0] = elem->raw[1] = mock_volume_to_raw(volume / 100, FALSE, 0);
+	elem->muted = muted;
+
+	mock_notify_elem(elem, NULL, BACKEND_CHANGE_VOLUME | BACKEND_CHANGE_SWITCH);
+}
+
+/**
+ * Simulate an event on a mixer elem that didn't change, like the one
+ * Alsa sends back after each write. Every card using this mixer elem is
+ * notified, including the one that made the last write.
+ *
+ * @param card_name the name of the card.
+ * @param channel the name of the mixer elem.
+ */
+void
+mock_echo(const char *card_name, const char *channel)
+{
+	MockElem *elem;
+
+	elem = mock_elem_lookup(card_name, channel);
+	if (elem == NULL)
+		return;
+
+	mock_notify_elem(elem, NULL, BACKEND_CHANGE_VOLUME | BACKEND_CHANGE_SWITCH);
+}
+
+/**
+ * Get the volume of a mixer elem, as the simulated hardware has it,
+ * regardless of what the cards using it know.
+ *
+ * @param card_name the name of the card.
+ * @param channel the name of the mixer elem.
+ * @param normalize whether to read the volume normalized, the way
+ *        a card handle with normalization does.
+ * @return the volume of the first channel, in percent, or -1 if there's
+ *         no such mixer elem.
+ */
+gdouble
+mock_get_volume(const char *card_name, const char *channel, gboolean normalize)
+{
+	MockElem *elem;
+
+	elem = mock_elem_lookup(card_name, channel);
+	if (elem == NULL)
+		return -1;
+
+	return mock_raw_to_volume(elem->raw[0], normalize) * 100;
+}
+
+/**
+ * Simulate a card being unplugged, or plugged back.
+ * The cards using an unplugged device are disconnected.
+ *
+ * @param card_name the name of the card.
+ * @param present whether the card is plugged or not.
+ */
+void
+mock_hotplug(const char *card_name, gboolean present)
+{
+	guint i;
+
+	mock_ensure();
+
+	for (i = 0; i < mock.n_devices; i++) {
+		MockDevice *device = &mock.devices[i];
+
+		if (g_strcmp0(device->name, card_name))
+			continue;
+
+		if (device->present == present)
+			return;
+
+		DEBUG("Mock: card '%s' %s", card_name, present ? "plugged" : "unplugged");
+
+		device->present = present;
+		if (!present)
+			mock_notify_unplug(device);
+
+		if (mock.cards_cb_func)
+			mock.cards_cb_func(mock.cards_cb_data);
+
+		return;
+	}
+
+	WARN("Mock: no card '%s'", card_name);
+}
+
+/**
+ * Get the number of writes made to the simulated hardware so far.
+ *
+ * @return the number of writes.
+ */
+guint
+mock_get_n_writes(void)
+{
+	return mock.n_writes;
+}
+
+/**
+ * Get the number of times the cards were listed so far.
+ *
+ * @return the number of listings.
+ */
+guint
+mock_get_n_list_cards(void)
+{
+	return mock.n_list_cards;
+}
+
+/** The in-memory backend. */
+const Backend mock_backend = {
+	.name = "mock",
+	.list_cards = mock_list_cards,
+	.list_channels = mock_list_channels,
+	.set_cards_callback = mock_set_cards_callback,
+	.cleanup = mock_cleanup,
+	.card_new = mock_card_new,
+	.card_free = mock_card_free,
+	.card_link_channel = mock_card_link_channel,
+	.card_install_callback = mock_card_install_callback,
+	.card_get_name = mock_card_get_name,
+	.card_get_channel = mock_card_get_channel,
+	.card_has_mute = mock_card_has_mute,
+	.card_is_muted = mock_card_is_muted,
+	.card_toggle_mute = mock_card_toggle_mute,
+	.card_get_volume = mock_card_get_volume,
+	.card_set_volume = mock_card_set_volume,
+	.card_get_volumes = mock_card_get_volumes,
+	.card_set_volumes = mock_card_set_volumes,
+};
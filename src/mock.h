@@ -0,0 +1,35 @@
+/* mock.h
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file mock.h
+ * Header for mock.c.
+ * @brief Header for mock.c.
+ */
+
+#ifndef _MOCK_H_
+#define _MOCK_H_
+
+#include <glib.h>
+
+#include "backend.h"
+
+extern const Backend mock_backend;
+
+void mock_external_change(const char *card_name, const char *channel,
+                          gdouble volume, gboolean muted);
+void mock_echo(const char *card_name, const char *channel);
+gdouble mock_get_volume(const char *card_name, const char *channel,
+                        gboolean normalize);
+void mock_hotplug(const char *card_name, gboolean present);
+guint mock_get_n_writes(void);
+guint mock_get_n_list_cards(void);
+
+#endif				// _MOCK_H_
@@ -111,25 +111,54 @@ show_text_notif(NotifyNotification *notification,
 struct notif {
 	/* Audio system */
 	Audio *audio;
+	guint audio_handler;
 	/* Preferences */
 	gboolean enabled;
 	gboolean popup;
 	gboolean tray;
 	gboolean hotkey;
 	gboolean external;
+	/* Last capture mute state, to tell what changed */
+	gboolean capture_muted;
 	/* Notifications */
 	NotifyNotification *volume_notif;
 	NotifyNotification *text_notif;
 
 };
 
+/* Whether the user wants to be notified of changes made by someone */
+static gboolean
+notif_wanted(Notif *notif, AudioUser user)
+{
+	if (!notif->enabled)
+		return FALSE;
+
+	switch (user) {
+	case AUDIO_USER_UNKNOWN:
+		return notif->external;
+	case AUDIO_USER_POPUP:
+		return notif->popup;
+	case AUDIO_USER_TRAY_ICON:
+		return notif->tray;
+	case AUDIO_USER_HOTKEYS:
+		return notif->hotkey;
+	default:
+		WARN("Unhandled audio user");
+		return FALSE;
+	}
+}
+
 /* Handle signals coming from the audio subsystem. */
 static void
-on_audio_changed(G_GNUC_UNUSED Audio *audio, AudioEvent *event, gpointer data)
+on_audio_changed(G_GNUC_UNUSED Audio *audio, const AudioEvent *event, gpointer data)
 {
 	Notif *notif = (Notif *) data;
 
 	switch (event->signal) {
+	case AUDIO_CARD_INITIALIZED:
+		notif->capture_muted = event->state->capture_muted;
+		break;
+
 	case AUDIO_NO_CARD:
 		show_text_notif(notif->text_notif,
 		                _("No sound card"),
@@ -143,35 +172,44 @@ on_audio_changed(G_GNUC_UNUSED Audio *audio, AudioEvent *event, gpointer data)
 		break;
 
 	case AUDIO_VALUES_CHANGED:
-		if (!notif->enabled)
+		if (!notif_wanted(notif, event->user))
+			return;
+
+		show_volume_notif(notif->volume_notif,
+		                  event->state->card, event->state->channel,
+		                  event->state->muted, event->state->volume);
+		break;
+
+	case AUDIO_CAPTURE_VALUES_CHANGED: {
+		gboolean mute_changed;
+		gchar *summary;
+
+		if (!event->state->has_capture)
 			return;
 
-		switch (event->user) {
-		case AUDIO_USER_UNKNOWN:
-			if (!notif->external)
-				return;
-			break;
-		case AUDIO_USER_POPUP:
-			if (!notif->popup)
-				return;
-			break;
-		case AUDIO_USER_TRAY_ICON:
-			if (!notif->tray)
-				return;
-			break;
-		case AUDIO_USER_HOTKEYS:
-			if (!notif->hotkey)
-				return;
-			break;
-		default:
-			WARN("Unhandled audio user");
+		/* Whoever muted the microphone, the user wants to know.
+		 * The capture volume though is often moved by applications
+		 * on their own, so only our own changes are notified.
+		 */
+		mute_changed = event->state->capture_muted != notif->capture_muted;
+		notif->capture_muted = event->state->capture_muted;
+
+		if (!notif_wanted(notif, event->user))
 			return;
-		}
 
-		show_volume_notif(notif->volume_notif,
-		                  event->card, event->channel,
-		                  event->muted, event->volume);
+		if (mute_changed) {
+			show_text_notif(notif->text_notif,
+			                event->state->capture_muted ?
+			                _("Microphone muted") : _("Microphone unmuted"),
+			                NULL);
+		} else if (event->user != AUDIO_USER_UNKNOWN) {
+			summary = g_strdup_printf("%s: %ld%%", _("Microphone"),
+			                          lround(event->state->capture_volume));
+			show_text_notif(notif->text_notif, summary, NULL);
+			g_free(summary);
+		}
 		break;
+	}
 
 	default:
 		break;
@@ -234,7 +272,7 @@ notif_free(Notif *notif)
 		g_object_unref(notif->text_notif);
 
 	/* Disconnect audio signal handlers */
-	audio_signals_disconnect(notif->audio, on_audio_changed, notif);
+	audio_signals_disconnect(notif->audio, notif->audio_handler);
 
 	/* Uninit libnotify. This should be done only once */
 	g_assert(notify_is_initted() == TRUE);
@@ -265,7 +303,14 @@ notif_new(Audio *audio)
 
 	/* Connect audio signals handlers */
 	notif->audio = audio;
-	audio_signals_connect(audio, on_audio_changed, notif);
+	notif->audio_handler = audio_signals_connect_full
+	                       (audio, on_audio_changed, notif,
+	                        AUDIO_SIGNAL_MASK(AUDIO_NO_CARD) |
+	                        AUDIO_SIGNAL_MASK(AUDIO_CARD_INITIALIZED) |
+	                        AUDIO_SIGNAL_MASK(AUDIO_CARD_DISCONNECTED) |
+	                        AUDIO_SIGNAL_MASK(AUDIO_VALUES_CHANGED) |
+	                        AUDIO_SIGNAL_MASK(AUDIO_CAPTURE_VALUES_CHANGED),
+	                        AUDIO_ALL_USERS, NULL);
 
 	/* Load preferences */
 	notif_reload(notif);
@@ -262,6 +262,67 @@ prefs_get_channel(const gchar *card)
 	return g_key_file_get_string(keyFile, card, "Channel", NULL);
 }
 
+/**
+ * Gets the channels linked to the selected channel of the specified
+ * Alsa Card. Each entry is a channel name, optionally followed by
+ * a colon and a volume weight, like 'Headphone:0.8'.
+ *
+ * @param card the Alsa Card to get the linked channels of
+ * @return a NULL-terminated array of newly allocated strings, to be freed
+ * with g_strfreev(), NULL if there's no linked channels
+ */
+gchar **
+prefs_get_linked_channels(const gchar *card)
+{
+	if (!card)
+		return NULL;
+	return g_key_file_get_string_list(keyFile, card, "LinkedChannels", NULL, NULL);
+}
+
+/**
+ * Gets the capture channel of the specified Alsa Card
+ * from the global keyFile and returns the result.
+ *
+ * @param card the Alsa Card to get the capture channel of
+ * @return the capture channel as newly allocated string,
+ * NULL on failure
+ */
+gchar *
+prefs_get_capture_channel(const gchar *card)
+{
+	if (!card)
+		return NULL;
+	return g_key_file_get_string(keyFile, card, "CaptureChannel", NULL);
+}
+
+/**
+ * Gets an int value for the specified Alsa Card. If the card
+ * doesn't have its own value, the global one is used.
+ * On error, returns def as default value.
+ *
+ * @param card the Alsa Card to get the value of
+ * @param key the specific settings key
+ * @param def the default value to return on error
+ * @return the preference value or def on error
+ */
+gint
+prefs_get_card_integer(const gchar *card, const gchar *key, gint def)
+{
+	gint ret;
+	GError *error = NULL;
+
+	if (!card)
+		return prefs_get_integer(key, def);
+
+	ret = g_key_file_get_integer(keyFile, card, key, &error);
+	if (error) {
+		g_error_free(error);
+		return prefs_get_integer(key, def);
+	}
+
+	return ret;
+}
+
 /**
  * Sets a boolean value to preferences.
  *
@@ -335,6 +396,24 @@ prefs_set_channel(const gchar *card, const gchar *channel)
 	g_key_file_set_string(keyFile, card, "Channel", channel);
 }
 
+/**
+ * Sets the channels linked to the selected channel for a given card
+ * in preferences. See prefs_get_linked_channels() for the format.
+ * An empty array removes the setting.
+ *
+ * @param card the Alsa Card associated with the channels
+ * @param channels the array of channels to save in the preferences.
+ * @param n the array length
+ */
+void
+prefs_set_linked_channels(const gchar *card, const gchar * const *channels, gsize n)
+{
+	if (n == 0)
+		g_key_file_remove_key(keyFile, card, "LinkedChannels", NULL);
+	else
+		g_key_file_set_string_list(keyFile, card, "LinkedChannels", channels, n);
+}
+
 /**
  * Loads the preferences from the config file to the keyFile object (GKeyFile type).
  * Creates the keyFile object if it doesn't exist.
@@ -29,6 +29,9 @@ gdouble  prefs_get_double(const gchar *key, gdouble def);
 gchar   *prefs_get_string(const gchar *key, const gchar *def);
 gdouble *prefs_get_double_list(const gchar *key, gsize *n);
 gchar   *prefs_get_channel(const gchar *card);
+gchar  **prefs_get_linked_channels(const gchar *card);
+gchar   *prefs_get_capture_channel(const gchar *card);
+gint     prefs_get_card_integer(const gchar *card, const gchar *key, gint def);
 
 void prefs_set_boolean(const gchar *key, gboolean value);
 void prefs_set_integer(const gchar *key, gint value);
@@ -36,5 +39,6 @@ void prefs_set_double(const gchar *key, gdouble value);
 void prefs_set_string(const gchar *key, const gchar *value);
 void prefs_set_double_list(const gchar *key, gdouble *list, gsize n);
 void prefs_set_channel(const gchar *card, const gchar *channel);
+void prefs_set_linked_channels(const gchar *card, const gchar * const *channels, gsize n);
 
 #endif				// _PREFS_H_
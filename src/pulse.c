@@ -0,0 +1,1057 @@
+/* pulse.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file pulse.c
+ * PulseAudio audio backend, that also works with PipeWire's pulse server.
+ * It talks to the server directly, instead of going through the Alsa
+ * pulse plugin, which turns every read into a round trip to the server.
+ *
+ * Cards are the sinks of the server, named after their description, and
+ * each sink has a single channel. The capture side of a card is the source
+ * that belongs to the same card as the sink. The default card follows the
+ * default sink and source of the server.
+ *
+ * The libpulse main loop runs in a thread of its own. Each card keeps a
+ * copy of the state of its device, that's updated by the subscription
+ * events of the server, so reading the volume never waits for the server.
+ * Writes are sent without waiting for an answer. Events are delivered
+ * from the main context in use when the card was created.
+ * @brief PulseAudio audio backend.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <string.h>
+#include <glib.h>
+#include <pulse/pulseaudio.h>
+
+#include "backend.h"
+#include "pulse.h"
+#include "support-log.h"
+
+#define PULSE_DEFAULT_CARD BACKEND_DEFAULT_CARD
+#define PULSE_PLAYBACK_CHANNEL "Master"
+#define PULSE_CAPTURE_CHANNEL "Capture"
+
+/*
+ * Devices, that is sinks and sources, as seen by the server.
+ */
+
+struct pulse_device {
+	BackendStream stream;
+	uint32_t index;
+	uint32_t card; /* PA_INVALID_INDEX if not part of a card */
+	char *name;
+	char *description;
+	pa_channel_map map;
+	pa_cvolume volume;
+	gboolean muted;
+};
+
+typedef struct pulse_device PulseDevice;
+
+static PulseDevice *
+pulse_device_new_sink(const pa_sink_info *info)
+{
+	PulseDevice *device;
+
+	device = g_new0(PulseDevice, 1);
+	device->stream = BACKEND_STREAM_PLAYBACK;
+	device->index = info->index;
+	device->card = info->card;
+	device->name = g_strdup(info->name);
+	device->description = g_strdup(info->description);
+	device->map = info->channel_map;
+	device->volume = info->volume;
+	device->muted = info->mute;
+
+	return device;
+}
+
+static PulseDevice *
+pulse_device_new_source(const pa_source_info *info)
+{
+	PulseDevice *device;
+
+	device = g_new0(PulseDevice, 1);
+	device->stream = BACKEND_STREAM_CAPTURE;
+	device->index = info->index;
+	device->card = info->card;
+	device->name = g_strdup(info->name);
+	device->description = g_strdup(info->description);
+	device->map = info->channel_map;
+	device->volume = info->volume;
+	device->muted = info->mute;
+
+	return device;
+}
+
+static void
+pulse_device_free(PulseDevice *device)
+{
+	if (device == NULL)
+		return;
+
+	g_free(device->description);
+	g_free(device->name);
+	g_free(device);
+}
+
+/* Convert a volume in percent to a pulse volume */
+static pa_volume_t
+pulse_volume_from_percent(gdouble value, gboolean normalize, int dir)
+{
+	gdouble volume = MAX(value / 100, 0);
+
+	/* Pulse volumes are already on a cubic scale */
+	if (!normalize)
+		return pa_sw_volume_from_linear(volume);
+
+	volume *= PA_VOLUME_NORM;
+	if (dir > 0)
+		volume = ceil(volume);
+	else if (dir < 0)
+		volume = floor(volume);
+	else
+		volume = round(volume);
+
+	return CLAMP(volume, PA_VOLUME_MUTED, PA_VOLUME_MAX);
+}
+
+/* Convert a pulse volume to a volume in percent */
+static gdouble
+pulse_volume_to_percent(pa_volume_t volume, gboolean normalize)
+{
+	if (!normalize)
+		return pa_sw_volume_to_linear(volume) * 100;
+
+	return (gdouble) volume * 100 / PA_VOLUME_NORM;
+}
+
+static const char *
+pulse_channel_name(BackendStream stream)
+{
+	return stream == BACKEND_STREAM_PLAYBACK ?
+	       PULSE_PLAYBACK_CHANNEL : PULSE_CAPTURE_CHANNEL;
+}
+
+/*
+ * Connection to the server.
+ * Everything that touches the pulse context must be done with the main
+ * loop locked, callbacks are invoked in the main loop thread with the
+ * lock held.
+ */
+
+typedef struct pulse_card PulseCard;
+
+struct pulse {
+	pa_threaded_mainloop *mainloop;
+	pa_context *context;
+	/* Names of the default devices */
+	char *default_sink;
+	char *default_source;
+	/* Cards in use */
+	GSList *cards;
+	/* Cards callback, and the context to invoke it from */
+	BackendCardsCb cards_cb_func;
+	gpointer cards_cb_data;
+	GMainContext *cards_context;
+};
+
+static struct pulse pulse;
+
+/* Invoke a function from a given main context */
+static void
+pulse_invoke(GMainContext *context, GSourceFunc func, gpointer data)
+{
+	GSource *source;
+
+	source = g_idle_source_new();
+	g_source_set_callback(source, func, data, NULL);
+	g_source_attach(source, context);
+	g_source_unref(source);
+}
+
+/* Wait for an operation to complete, with the lock held.
+ * If the context fails meanwhile, the state callback wakes us up,
+ * and we give up on the operation: its callback may never come.
+ */
+static void
+pulse_wait(pa_operation *op)
+{
+	if (op == NULL)
+		return;
+
+	while (pa_operation_get_state(op) == PA_OPERATION_RUNNING) {
+		if (!PA_CONTEXT_IS_GOOD(pa_context_get_state(pulse.context))) {
+			pa_operation_cancel(op);
+			break;
+		}
+		pa_threaded_mainloop_wait(pulse.mainloop);
+	}
+
+	pa_operation_unref(op);
+}
+
+/*
+ * Card handles.
+ */
+
+struct pulse_card {
+	BackendCard parent; /* Must come first */
+	gboolean normalize;
+	BackendStream stream;
+	char *name;
+	char *channel;
+	gboolean follow_default;
+	/* State of the device, protected by the main loop lock */
+	PulseDevice *device;
+	gboolean disconnected;
+	/* Events are delivered from the context the card was created in */
+	GMainContext *context;
+	gint refcount;
+	gboolean freed;
+	/* User callback, to notify when something happens */
+	BackendCb cb_func;
+	gpointer cb_data;
+};
+
+#define PULSE_CARD(card) ((PulseCard *) (card))
+
+static PulseCard *
+pulse_card_ref(PulseCard *card)
+{
+	g_atomic_int_inc(&card->refcount);
+
+	return card;
+}
+
+static void
+pulse_card_unref(PulseCard *card)
+{
+	if (!g_atomic_int_dec_and_test(&card->refcount))
+		return;
+
+	pulse_device_free(card->device);
+	g_main_context_unref(card->context);
+	g_free(card->channel);
+	g_free(card->name);
+	g_free(card);
+}
+
+struct pulse_event {
+	PulseCard *card;
+	enum backend_event event;
+	guint changes;
+};
+
+typedef struct pulse_event PulseEvent;
+
+/* Deliver an event to the user callback. It's dropped if the card
+ * was freed in the meantime.
+ */
+static gboolean
+pulse_event_dispatch(gpointer data)
+{
+	PulseEvent *ev = data;
+	PulseCard *card = ev->card;
+
+	if (!card->freed && card->cb_func)
+		card->cb_func(ev->event, ev->changes, card->cb_data);
+
+	pulse_card_unref(card);
+	g_free(ev);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Send an event to a card, from the main loop thread */
+static void
+pulse_event_post(PulseCard *card, enum backend_event event, guint changes)
+{
+	PulseEvent *ev;
+
+	ev = g_new0(PulseEvent, 1);
+	ev->card = pulse_card_ref(card);
+	ev->event = event;
+	ev->changes = changes;
+
+	pulse_invoke(card->context, pulse_event_dispatch, ev);
+}
+
+/* Tell a card that it's gone for good */
+static void
+pulse_card_disconnect(PulseCard *card, enum backend_event event)
+{
+	if (card->disconnected)
+		return;
+
+	card->disconnected = TRUE;
+	pulse_event_post(card, event, BACKEND_CHANGE_REMOVE);
+}
+
+/*
+ * Server events.
+ */
+
+static gboolean
+pulse_cards_dispatch(G_GNUC_UNUSED gpointer data)
+{
+	if (pulse.cards_cb_func)
+		pulse.cards_cb_func(pulse.cards_cb_data);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* The list of cards changed */
+static void
+pulse_cards_changed(void)
+{
+	if (pulse.cards_cb_func)
+		pulse_invoke(pulse.cards_context, pulse_cards_dispatch, NULL);
+}
+
+/* A device changed, update the cards using it */
+static void
+pulse_device_changed(const PulseDevice *device)
+{
+	GSList *item;
+
+	for (item = pulse.cards; item; item = item->next) {
+		PulseCard *card = item->data;
+		guint changes = 0;
+
+		if (card->disconnected || card->stream != device->stream ||
+		    card->device->index != device->index)
+			continue;
+
+		if (!pa_cvolume_equal(&card->device->volume, &device->volume))
+			changes |= BACKEND_CHANGE_VOLUME;
+		if (card->device->muted != device->muted)
+			changes |= BACKEND_CHANGE_SWITCH;
+
+		card->device->map = device->map;
+		card->device->volume = device->volume;
+		card->device->muted = device->muted;
+
+		if (changes)
+			pulse_event_post(card, BACKEND_CARD_VALUES_CHANGED, changes);
+	}
+}
+
+/* A device was removed, disconnect the cards using it */
+static void
+pulse_device_removed(BackendStream stream, uint32_t index)
+{
+	GSList *item;
+
+	for (item = pulse.cards; item; item = item->next) {
+		PulseCard *card = item->data;
+
+		if (card->stream == stream && card->device->index == index)
+			pulse_card_disconnect(card, BACKEND_CARD_DISCONNECTED);
+	}
+}
+
+static void
+pulse_sink_changed_cb(G_GNUC_UNUSED pa_context *context, const pa_sink_info *info,
+                      int eol, G_GNUC_UNUSED void *data)
+{
+	PulseDevice *device;
+
+	if (eol)
+		return;
+
+	device = pulse_device_new_sink(info);
+	pulse_device_changed(device);
+	pulse_device_free(device);
+}
+
+static void
+pulse_source_changed_cb(G_GNUC_UNUSED pa_context *context, const pa_source_info *info,
+                        int eol, G_GNUC_UNUSED void *data)
+{
+	PulseDevice *device;
+
+	if (eol)
+		return;
+
+	device = pulse_device_new_source(info);
+	pulse_device_changed(device);
+	pulse_device_free(device);
+}
+
+/* Remember the name of a default device. Return TRUE if it changed,
+ * not counting the first time we learn about it.
+ */
+static gboolean
+pulse_set_default(char **current, const char *name)
+{
+	gboolean changed;
+
+	if (!g_strcmp0(*current, name))
+		return FALSE;
+
+	changed = *current != NULL;
+	g_free(*current);
+	*current = g_strdup(name);
+
+	return changed;
+}
+
+/* The server changed, maybe the default devices changed */
+static void
+pulse_server_changed_cb(G_GNUC_UNUSED pa_context *context, const pa_server_info *info,
+                        G_GNUC_UNUSED void *data)
+{
+	gboolean changed = FALSE;
+	GSList *item;
+
+	pa_threaded_mainloop_signal(pulse.mainloop, 0);
+
+	changed |= pulse_set_default(&pulse.default_sink, info->default_sink_name);
+	changed |= pulse_set_default(&pulse.default_source, info->default_source_name);
+	if (!changed)
+		return;
+
+	/* Default cards must be reopened */
+	for (item = pulse.cards; item; item = item->next) {
+		PulseCard *card = item->data;
+		const char *name;
+
+		if (!card->follow_default)
+			continue;
+
+		name = card->stream == BACKEND_STREAM_PLAYBACK ?
+		       pulse.default_sink : pulse.default_source;
+		if (g_strcmp0(card->device->name, name))
+			pulse_card_disconnect(card, BACKEND_CARD_DISCONNECTED);
+	}
+
+	pulse_cards_changed();
+}
+
+static void
+pulse_subscribe_cb(pa_context *context, pa_subscription_event_type_t type,
+                   uint32_t index, G_GNUC_UNUSED void *data)
+{
+	pa_subscription_event_type_t facility, kind;
+	BackendStream stream;
+	pa_operation *op = NULL;
+
+	facility = type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+	kind = type & PA_SUBSCRIPTION_EVENT_TYPE_MASK;
+
+	switch (facility) {
+	case PA_SUBSCRIPTION_EVENT_SINK:
+	case PA_SUBSCRIPTION_EVENT_SOURCE:
+		stream = facility == PA_SUBSCRIPTION_EVENT_SINK ?
+		         BACKEND_STREAM_PLAYBACK : BACKEND_STREAM_CAPTURE;
+
+		if (kind == PA_SUBSCRIPTION_EVENT_CHANGE) {
+			if (stream == BACKEND_STREAM_PLAYBACK)
+				op = pa_context_get_sink_info_by_index
+				     (context, index, pulse_sink_changed_cb, NULL);
+			else
+				op = pa_context_get_source_info_by_index
+				     (context, index, pulse_source_changed_cb, NULL);
+			break;
+		}
+
+		if (kind == PA_SUBSCRIPTION_EVENT_REMOVE)
+			pulse_device_removed(stream, index);
+
+		pulse_cards_changed();
+		break;
+	case PA_SUBSCRIPTION_EVENT_SERVER:
+		op = pa_context_get_server_info(context, pulse_server_changed_cb, NULL);
+		break;
+	default:
+		break;
+	}
+
+	if (op)
+		pa_operation_unref(op);
+}
+
+static void
+pulse_context_state_cb(pa_context *context, G_GNUC_UNUSED void *data)
+{
+	GSList *item;
+
+	switch (pa_context_get_state(context)) {
+	case PA_CONTEXT_READY:
+		pa_threaded_mainloop_signal(pulse.mainloop, 0);
+		break;
+	case PA_CONTEXT_FAILED:
+	case PA_CONTEXT_TERMINATED:
+		/* Every card is lost, they'll be reopened on the next reload */
+		for (item = pulse.cards; item; item = item->next)
+			pulse_card_disconnect(item->data, BACKEND_CARD_ERROR);
+		pa_threaded_mainloop_signal(pulse.mainloop, 0);
+		break;
+	default:
+		break;
+	}
+}
+
+static void
+pulse_success_cb(G_GNUC_UNUSED pa_context *context, G_GNUC_UNUSED int success,
+                 G_GNUC_UNUSED void *data)
+{
+	pa_threaded_mainloop_signal(pulse.mainloop, 0);
+}
+
+/* Connect to the server, if not connected yet. Lock must be held. */
+static gboolean
+pulse_connect(void)
+{
+	pa_context_state_t state;
+	pa_subscription_mask_t mask;
+
+	if (pulse.context) {
+		if (pa_context_get_state(pulse.context) == PA_CONTEXT_READY)
+			return TRUE;
+
+		pa_context_disconnect(pulse.context);
+		pa_context_unref(pulse.context);
+		pulse.context = NULL;
+	}
+
+	pulse.context = pa_context_new(pa_threaded_mainloop_get_api(pulse.mainloop),
+	                               PACKAGE);
+	if (pulse.context == NULL) {
+		WARN("Can't create a PulseAudio context");
+		return FALSE;
+	}
+	pa_context_set_state_callback(pulse.context, pulse_context_state_cb, NULL);
+
+	if (pa_context_connect(pulse.context, NULL, PA_CONTEXT_NOFLAGS, NULL) < 0)
+		goto failure;
+
+	for (;;) {
+		state = pa_context_get_state(pulse.context);
+		if (state == PA_CONTEXT_READY)
+			break;
+		if (!PA_CONTEXT_IS_GOOD(state))
+			goto failure;
+		pa_threaded_mainloop_wait(pulse.mainloop);
+	}
+
+	pa_context_set_subscribe_callback(pulse.context, pulse_subscribe_cb, NULL);
+	mask = PA_SUBSCRIPTION_MASK_SINK | PA_SUBSCRIPTION_MASK_SOURCE |
+	       PA_SUBSCRIPTION_MASK_SERVER;
+	pulse_wait(pa_context_subscribe(pulse.context, mask, pulse_success_cb, NULL));
+	pulse_wait(pa_context_get_server_info(pulse.context, pulse_server_changed_cb, NULL));
+
+	/* The server may have gone away while we were waiting */
+	if (pa_context_get_state(pulse.context) != PA_CONTEXT_READY)
+		goto failure;
+
+	DEBUG("PulseAudio: connected to '%s'", pa_context_get_server(pulse.context));
+
+	return TRUE;
+
+failure:
+	WARN("Can't connect to PulseAudio: %s",
+	     pa_strerror(pa_context_errno(pulse.context)));
+	pa_context_set_state_callback(pulse.context, NULL, NULL);
+	pa_context_disconnect(pulse.context);
+	pa_context_unref(pulse.context);
+	pulse.context = NULL;
+	return FALSE;
+}
+
+/* Lock the main loop, starting it if needed, and make sure we're
+ * connected. The lock must be released with pulse_unlock(), whatever
+ * the result.
+ */
+static gboolean
+pulse_lock(void)
+{
+	if (pulse.mainloop == NULL) {
+		pulse.mainloop = pa_threaded_mainloop_new();
+		pa_threaded_mainloop_start(pulse.mainloop);
+	}
+
+	pa_threaded_mainloop_lock(pulse.mainloop);
+
+	return pulse_connect();
+}
+
+static void
+pulse_unlock(void)
+{
+	pa_threaded_mainloop_unlock(pulse.mainloop);
+}
+
+/*
+ * Device lookup. Lock must be held.
+ */
+
+static void
+pulse_sink_list_cb(G_GNUC_UNUSED pa_context *context, const pa_sink_info *info,
+                   int eol, void *data)
+{
+	GSList **list = data;
+
+	if (eol) {
+		pa_threaded_mainloop_signal(pulse.mainloop, 0);
+		return;
+	}
+
+	*list = g_slist_append(*list, pulse_device_new_sink(info));
+}
+
+static void
+pulse_source_list_cb(G_GNUC_UNUSED pa_context *context, const pa_source_info *info,
+                     int eol, void *data)
+{
+	GSList **list = data;
+
+	if (eol) {
+		pa_threaded_mainloop_signal(pulse.mainloop, 0);
+		return;
+	}
+
+	/* Monitors are not microphones */
+	if (info->monitor_of_sink != PA_INVALID_INDEX)
+		return;
+
+	*list = g_slist_append(*list, pulse_device_new_source(info));
+}
+
+/* List the sinks or sources of the server, as a list of PulseDevice */
+static GSList *
+pulse_list_devices(BackendStream stream)
+{
+	GSList *list = NULL;
+
+	if (stream == BACKEND_STREAM_PLAYBACK)
+		pulse_wait(pa_context_get_sink_info_list(pulse.context,
+		                                         pulse_sink_list_cb, &list));
+	else
+		pulse_wait(pa_context_get_source_info_list(pulse.context,
+		                                           pulse_source_list_cb, &list));
+
+	return list;
+}
+
+/* Get the default sink or source of the server */
+static PulseDevice *
+pulse_get_default(BackendStream stream)
+{
+	GSList *list = NULL;
+	PulseDevice *device;
+
+	if (stream == BACKEND_STREAM_PLAYBACK)
+		pulse_wait(pa_context_get_sink_info_by_name(pulse.context, "@DEFAULT_SINK@",
+		                                            pulse_sink_list_cb, &list));
+	else
+		pulse_wait(pa_context_get_source_info_by_name(pulse.context, "@DEFAULT_SOURCE@",
+		                                              pulse_source_list_cb, &list));
+
+	if (list == NULL)
+		return NULL;
+
+	device = list->data;
+	list = g_slist_delete_link(list, list);
+	g_slist_free_full(list, (GDestroyNotify) pulse_device_free);
+
+	return device;
+}
+
+/* Find the device of a card, for playback or capture. */
+static PulseDevice *
+pulse_lookup(const char *card_name, BackendStream stream)
+{
+	PulseDevice *sink = NULL, *found = NULL;
+	GSList *list, *item;
+
+	if (card_name == NULL || !g_strcmp0(card_name, PULSE_DEFAULT_CARD))
+		return pulse_get_default(stream);
+
+	list = pulse_list_devices(BACKEND_STREAM_PLAYBACK);
+	for (item = list; item; item = item->next) {
+		PulseDevice *device = item->data;
+
+		if (!g_strcmp0(device->description, card_name)) {
+			sink = device;
+			break;
+		}
+	}
+
+	if (sink == NULL || stream == BACKEND_STREAM_PLAYBACK) {
+		if (sink)
+			list = g_slist_remove(list, sink);
+		g_slist_free_full(list, (GDestroyNotify) pulse_device_free);
+		return sink;
+	}
+
+	/* The capture side is the source that belongs to the same card */
+	if (sink->card != PA_INVALID_INDEX) {
+		GSList *sources;
+
+		sources = pulse_list_devices(BACKEND_STREAM_CAPTURE);
+		for (item = sources; item; item = item->next) {
+			PulseDevice *device = item->data;
+
+			if (device->card == sink->card) {
+				found = device;
+				break;
+			}
+		}
+
+		if (found)
+			sources = g_slist_remove(sources, found);
+		g_slist_free_full(sources, (GDestroyNotify) pulse_device_free);
+	}
+
+	g_slist_free_full(list, (GDestroyNotify) pulse_device_free);
+
+	return found;
+}
+
+/*
+ * Card operations.
+ */
+
+static const char *
+pulse_card_get_name(BackendCard *base)
+{
+	return PULSE_CARD(base)->name;
+}
+
+static const char *
+pulse_card_get_channel(BackendCard *base)
+{
+	return PULSE_CARD(base)->channel;
+}
+
+static gboolean
+pulse_card_has_mute(G_GNUC_UNUSED BackendCard *base)
+{
+	return TRUE;
+}
+
+static gboolean
+pulse_card_is_muted(BackendCard *base)
+{
+	PulseCard *card = PULSE_CARD(base);
+	gboolean muted;
+
+	pa_threaded_mainloop_lock(pulse.mainloop);
+	muted = card->device->muted;
+	pa_threaded_mainloop_unlock(pulse.mainloop);
+
+	return muted;
+}
+
+static void
+pulse_card_toggle_mute(BackendCard *base)
+{
+	PulseCard *card = PULSE_CARD(base);
+	PulseDevice *device = card->device;
+	pa_operation *op;
+
+	pa_threaded_mainloop_lock(pulse.mainloop);
+
+	if (card->disconnected)
+		goto out;
+
+	device->muted = !device->muted;
+	if (card->stream == BACKEND_STREAM_PLAYBACK)
+		op = pa_context_set_sink_mute_by_index(pulse.context, device->index,
+		                                       device->muted, NULL, NULL);
+	else
+		op = pa_context_set_source_mute_by_index(pulse.context, device->index,
+		                                         device->muted, NULL, NULL);
+	if (op)
+		pa_operation_unref(op);
+
+out:
+	pa_threaded_mainloop_unlock(pulse.mainloop);
+}
+
+/* Send the volume of a card to the server, without waiting */
+static void
+pulse_card_write_volume(PulseCard *card)
+{
+	PulseDevice *device = card->device;
+	pa_operation *op;
+
+	if (card->stream == BACKEND_STREAM_PLAYBACK)
+		op = pa_context_set_sink_volume_by_index(pulse.context, device->index,
+		                                         &device->volume, NULL, NULL);
+	else
+		op = pa_context_set_source_volume_by_index(pulse.context, device->index,
+		                                           &device->volume, NULL, NULL);
+	if (op)
+		pa_operation_unref(op);
+}
+
+static gdouble
+pulse_card_get_volume(BackendCard *base)
+{
+	PulseCard *card = PULSE_CARD(base);
+	gdouble volume;
+
+	pa_threaded_mainloop_lock(pulse.mainloop);
+	volume = pulse_volume_to_percent(pa_cvolume_max(&card->device->volume),
+	                                 card->normalize);
+	pa_threaded_mainloop_unlock(pulse.mainloop);
+
+	return volume;
+}
+
+static void
+pulse_card_set_volume(BackendCard *base, gdouble value, int dir)
+{
+	PulseCard *card = PULSE_CARD(base);
+
+	pa_threaded_mainloop_lock(pulse.mainloop);
+
+	if (!card->disconnected) {
+		/* Scaling keeps the balance */
+		pa_cvolume_scale(&card->device->volume,
+		                 pulse_volume_from_percent(value, card->normalize, dir));
+		pulse_card_write_volume(card);
+	}
+
+	pa_threaded_mainloop_unlock(pulse.mainloop);
+}
+
+static void
+pulse_card_get_volumes(BackendCard *base, BackendVolumes *volumes)
+{
+	PulseCard *card = PULSE_CARD(base);
+	PulseDevice *device = card->device;
+	guint i;
+
+	memset(volumes, 0, sizeof *volumes);
+
+	pa_threaded_mainloop_lock(pulse.mainloop);
+
+	volumes->n_channels = MIN(device->volume.channels, BACKEND_MAX_CHANNELS);
+	for (i = 0; i < volumes->n_channels; i++)
+		volumes->volume[i] = pulse_volume_to_percent(device->volume.values[i],
+		                                             card->normalize);
+	volumes->balance = pa_cvolume_get_balance(&device->volume, &device->map);
+
+	pa_threaded_mainloop_unlock(pulse.mainloop);
+}
+
+static void
+pulse_card_set_volumes(BackendCard *base, const BackendVolumes *volumes, int dir)
+{
+	PulseCard *card = PULSE_CARD(base);
+	PulseDevice *device = card->device;
+	guint i;
+
+	pa_threaded_mainloop_lock(pulse.mainloop);
+
+	if (!card->disconnected) {
+		for (i = 0; i < device->volume.channels && i < volumes->n_channels; i++)
+			device->volume.values[i] =
+				pulse_volume_from_percent(volumes->volume[i],
+				                          card->normalize, dir);
+		pulse_card_write_volume(card);
+	}
+
+	pa_threaded_mainloop_unlock(pulse.mainloop);
+}
+
+static gboolean
+pulse_card_link_channel(G_GNUC_UNUSED BackendCard *base, const char *channel,
+                        G_GNUC_UNUSED gdouble weight)
+{
+	WARN("PulseAudio: can't link channel '%s', devices have a single channel",
+	     channel);
+
+	return FALSE;
+}
+
+static void
+pulse_card_install_callback(BackendCard *base, BackendCb callback,
+                            gpointer user_data)
+{
+	PulseCard *card = PULSE_CARD(base);
+
+	card->cb_func = callback;
+	card->cb_data = user_data;
+}
+
+static void
+pulse_card_free(BackendCard *base)
+{
+	PulseCard *card = PULSE_CARD(base);
+
+	if (card == NULL)
+		return;
+
+	pa_threaded_mainloop_lock(pulse.mainloop);
+	pulse.cards = g_slist_remove(pulse.cards, card);
+	pa_threaded_mainloop_unlock(pulse.mainloop);
+
+	/* Pending events are dropped from now on */
+	card->freed = TRUE;
+	pulse_card_unref(card);
+}
+
+static BackendCard *
+pulse_card_new(const char *card_name, const char *channel, BackendStream stream,
+               gboolean normalize)
+{
+	PulseDevice *device = NULL;
+	PulseCard *card;
+
+	if (card_name == NULL)
+		card_name = PULSE_DEFAULT_CARD;
+
+	if (pulse_lock())
+		device = pulse_lookup(card_name, stream);
+
+	if (device == NULL) {
+		pulse_unlock();
+		return NULL;
+	}
+
+	card = g_new0(PulseCard, 1);
+	card->parent.backend = &pulse_backend;
+	card->normalize = normalize;
+	card->stream = stream;
+	card->name = g_strdup(card_name);
+	card->channel = g_strdup(pulse_channel_name(stream));
+	card->follow_default = !g_strcmp0(card_name, PULSE_DEFAULT_CARD);
+	card->device = device;
+	card->context = g_main_context_ref_thread_default();
+	card->refcount = 1;
+
+	pulse.cards = g_slist_prepend(pulse.cards, card);
+
+	pulse_unlock();
+
+	if (channel && g_strcmp0(channel, card->channel))
+		DEBUG("PulseAudio: no channel '%s', using '%s'", channel, card->channel);
+
+	DEBUG("PulseAudio: card '%s' with device '%s' initialized !",
+	      card->name, device->name);
+
+	return &card->parent;
+}
+
+/*
+ * Listing and hotplug.
+ */
+
+static GSList *
+pulse_list_cards(void)
+{
+	GSList *devices, *item, *list = NULL;
+
+	if (!pulse_lock()) {
+		pulse_unlock();
+		return NULL;
+	}
+
+	devices = pulse_list_devices(BACKEND_STREAM_PLAYBACK);
+
+	pulse_unlock();
+
+	for (item = devices; item; item = item->next) {
+		PulseDevice *device = item->data;
+
+		list = g_slist_prepend(list, g_strdup(device->description));
+	}
+
+	if (list)
+		list = g_slist_prepend(list, g_strdup(PULSE_DEFAULT_CARD));
+
+	g_slist_free_full(devices, (GDestroyNotify) pulse_device_free);
+
+	return g_slist_reverse(list);
+}
+
+static GSList *
+pulse_list_channels(const char *card_name, BackendStream stream)
+{
+	PulseDevice *device = NULL;
+
+	if (pulse_lock())
+		device = pulse_lookup(card_name, stream);
+
+	pulse_unlock();
+
+	if (device == NULL)
+		return NULL;
+
+	pulse_device_free(device);
+
+	return g_slist_append(NULL, g_strdup(pulse_channel_name(stream)));
+}
+
+static void
+pulse_set_cards_callback(BackendCardsCb callback, gpointer data)
+{
+	pulse_lock();
+
+	pulse.cards_cb_func = callback;
+	pulse.cards_cb_data = data;
+	if (pulse.cards_context)
+		g_main_context_unref(pulse.cards_context);
+	pulse.cards_context = g_main_context_ref_thread_default();
+
+	pulse_unlock();
+}
+
+/* Forget about the cards callback, and the main context it was invoked
+ * from. The connection to the server lives in its own thread, it stays.
+ */
+static void
+pulse_cleanup(void)
+{
+	if (pulse.mainloop == NULL)
+		return;
+
+	pa_threaded_mainloop_lock(pulse.mainloop);
+
+	pulse.cards_cb_func = NULL;
+	pulse.cards_cb_data = NULL;
+	if (pulse.cards_context)
+		g_main_context_unref(pulse.cards_context);
+	pulse.cards_context = NULL;
+
+	pulse_unlock();
+}
+
+const Backend pulse_backend = {
+	.name = "pulse",
+	.list_cards = pulse_list_cards,
+	.list_channels = pulse_list_channels,
+	.set_cards_callback = pulse_set_cards_callback,
+	.cleanup = pulse_cleanup,
+	.card_new = pulse_card_new,
+	.card_free = pulse_card_free,
+	.card_link_channel = pulse_card_link_channel,
+	.card_install_callback = pulse_card_install_callback,
+	.card_get_name = pulse_card_get_name,
+	.card_get_channel = pulse_card_get_channel,
+	.card_has_mute = pulse_card_has_mute,
+	.card_is_muted = pulse_card_is_muted,
+	.card_toggle_mute = pulse_card_toggle_mute,
+	.card_get_volume = pulse_card_get_volume,
+	.card_set_volume = pulse_card_set_volume,
+	.card_get_volumes = pulse_card_get_volumes,
+	.card_set_volumes = pulse_card_set_volumes
+};
@@ -0,0 +1,26 @@
+/* pulse.h
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file pulse.h
+ * Header for pulse.c.
+ * @brief Header for pulse.c.
+ */
+
+#ifndef _PULSE_H_
+#define _PULSE_H_
+
+#include <glib.h>
+
+#include "backend.h"
+
+extern const Backend pulse_backend;
+
+#endif				// _PULSE_H_
@@ -0,0 +1,193 @@
+/* throttle.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file throttle.c
+ * This file holds a little helper to apply a value that changes too often,
+ * like the volume set with a slider that's being dragged. Only the latest
+ * value is kept, and it's applied at most once per frame, or once per
+ * interval. The last value is always applied, at the latest when the
+ * throttle is flushed.
+ *
+ * It doesn't know about Gtk: the frame clock is given by the caller, as
+ * a pair of functions. Without a frame clock, a timeout is used.
+ * @brief Apply a changing value at a bounded pace.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+
+#include "throttle.h"
+
+/* Without a frame clock, values are applied every 16 ms,
+ * that's about once per frame.
+ */
+#define THROTTLE_FRAME_INTERVAL 16
+
+struct throttle {
+	/* What to do with the value */
+	ThrottleFunc func;
+	gpointer data;
+	/* Value not applied yet */
+	gboolean pending;
+	gdouble value;
+	/* In ms, 0 means once per frame */
+	guint interval;
+	/* Frame clock, if any */
+	ThrottleFrameAddFunc frame_add;
+	ThrottleFrameRemoveFunc frame_remove;
+	gpointer frame_data;
+	/* Frame callback or timeout waiting to apply the value */
+	guint source_id;
+	gboolean source_is_frame;
+};
+
+/* Apply the pending value, if any */
+static void
+throttle_apply(Throttle *throttle)
+{
+	if (!throttle->pending)
+		return;
+
+	throttle->pending = FALSE;
+	throttle->func(throttle->value, throttle->data);
+}
+
+static gboolean
+on_throttle_source(gpointer data)
+{
+	Throttle *throttle = (Throttle *) data;
+
+	throttle->source_id = 0;
+	throttle_apply(throttle);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Make sure the pending value is applied soon */
+static void
+throttle_schedule(Throttle *throttle)
+{
+	if (throttle->source_id)
+		return;
+
+	throttle->source_is_frame = throttle->interval == 0 && throttle->frame_add;
+	if (throttle->source_is_frame)
+		throttle->source_id = throttle->frame_add(on_throttle_source, throttle,
+		                                          throttle->frame_data);
+	else
+		throttle->source_id = g_timeout_add(throttle->interval ?
+		                                    throttle->interval :
+		                                    THROTTLE_FRAME_INTERVAL,
+		                                    on_throttle_source, throttle);
+}
+
+/* Cancel the frame callback or timeout, if any */
+static void
+throttle_unschedule(Throttle *throttle)
+{
+	if (throttle->source_id == 0)
+		return;
+
+	if (throttle->source_is_frame)
+		throttle->frame_remove(throttle->source_id, throttle->frame_data);
+	else
+		g_source_remove(throttle->source_id);
+	throttle->source_id = 0;
+}
+
+/**
+ * Give a new value. It replaces the one that's still pending, if any,
+ * and it's applied on the next frame, or once the interval has elapsed.
+ *
+ * @param throttle a Throttle instance.
+ * @param value the new value.
+ */
+void
+throttle_push(Throttle *throttle, gdouble value)
+{
+	throttle->value = value;
+	throttle->pending = TRUE;
+	throttle_schedule(throttle);
+}
+
+/**
+ * Apply the pending value right now, if any.
+ *
+ * @param throttle a Throttle instance.
+ */
+void
+throttle_flush(Throttle *throttle)
+{
+	throttle_unschedule(throttle);
+	throttle_apply(throttle);
+}
+
+/**
+ * Use a frame clock, to apply the values once per frame when there's no
+ * interval. The functions are used the way gtk_widget_add_tick_callback()
+ * and gtk_widget_remove_tick_callback() are.
+ * It must be set before any value is pushed.
+ *
+ * @param throttle a Throttle instance.
+ * @param add_func asks for a callback on the next frame, returns its id.
+ * @param remove_func cancels a callback, by id.
+ * @param data user data passed to both functions.
+ */
+void
+throttle_set_frame_clock(Throttle *throttle, ThrottleFrameAddFunc add_func,
+                         ThrottleFrameRemoveFunc remove_func, gpointer data)
+{
+	g_assert(throttle->source_id == 0);
+
+	throttle->frame_add = add_func;
+	throttle->frame_remove = remove_func;
+	throttle->frame_data = data;
+}
+
+/**
+ * Free a throttle. The pending value, if any, is applied beforehand.
+ *
+ * @param throttle a Throttle instance.
+ */
+void
+throttle_free(Throttle *throttle)
+{
+	if (throttle == NULL)
+		return;
+
+	throttle_flush(throttle);
+	g_free(throttle);
+}
+
+/**
+ * Create a throttle.
+ *
+ * @param interval the minimum time between two values applied, in ms.
+ *        0 means once per frame.
+ * @param func the function applying a value.
+ * @param data user data passed to the function.
+ * @return the newly created Throttle instance.
+ */
+Throttle *
+throttle_new(guint interval, ThrottleFunc func, gpointer data)
+{
+	Throttle *throttle;
+
+	throttle = g_new0(Throttle, 1);
+	throttle->interval = interval;
+	throttle->func = func;
+	throttle->data = data;
+
+	return throttle;
+}
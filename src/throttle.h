@@ -0,0 +1,38 @@
+/* throttle.h
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file throttle.h
+ * Header for throttle.c.
+ * @brief Header for throttle.c.
+ */
+
+#ifndef _THROTTLE_H_
+#define _THROTTLE_H_
+
+#include <glib.h>
+
+typedef struct throttle Throttle;
+
+typedef void (*ThrottleFunc) (gdouble value, gpointer data);
+
+/* A frame clock: ask for a callback on the next frame, or cancel it */
+typedef guint (*ThrottleFrameAddFunc) (GSourceFunc func, gpointer func_data,
+                                       gpointer data);
+typedef void (*ThrottleFrameRemoveFunc) (guint id, gpointer data);
+
+Throttle *throttle_new(guint interval, ThrottleFunc func, gpointer data);
+void throttle_free(Throttle *throttle);
+void throttle_set_frame_clock(Throttle *throttle, ThrottleFrameAddFunc add_func,
+                              ThrottleFrameRemoveFunc remove_func, gpointer data);
+void throttle_push(Throttle *throttle, gdouble value);
+void throttle_flush(Throttle *throttle);
+
+#endif				// _THROTTLE_H_
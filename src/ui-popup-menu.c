@@ -98,6 +98,7 @@ update_mute_item(GtkCheckMenuItem *mute_item, GCallback handler_func,
 struct popup_menu {
 	/* Audio system */
 	Audio *audio;
+	guint audio_handler;
 	/* Widgets */
 	GtkWidget *menu_window;
 	GtkWidget *menu;
@@ -177,6 +178,28 @@ on_about_item_activate(G_GNUC_UNUSED GtkMenuItem *item,
 	run_about_dialog();
 }
 
+/* Updates the mute entry of the menu */
+static void
+update_mute(PopupMenu *menu, gboolean has_mute, gboolean muted)
+{
+#ifdef WITH_GTK3
+	update_mute_check(GTK_TOGGLE_BUTTON(menu->mute_check), has_mute, muted);
+#else
+	update_mute_item(GTK_CHECK_MENU_ITEM(menu->mute_item),
+	                 G_CALLBACK(on_mute_item_activate),
+	                 menu, has_mute, muted);
+#endif
+}
+
+/* Tell if the menu is popped up, and therefore needs to be updated */
+static gboolean
+is_menu_visible(gpointer data)
+{
+	PopupMenu *menu = (PopupMenu *) data;
+
+	return gtk_widget_get_visible(menu->menu);
+}
+
 /**
  * Handle signals from the audio subsystem.
  *
@@ -185,18 +208,11 @@ on_about_item_activate(G_GNUC_UNUSED GtkMenuItem *item,
  * @param data user supplied data.
  */
 static void
-on_audio_changed(G_GNUC_UNUSED Audio *audio, AudioEvent *event, gpointer data)
+on_audio_changed(G_GNUC_UNUSED Audio *audio, const AudioEvent *event, gpointer data)
 {
 	PopupMenu *menu = (PopupMenu *) data;
 
-#ifdef WITH_GTK3
-	update_mute_check(GTK_TOGGLE_BUTTON(menu->mute_check),
-	                  event->has_mute, event->muted);
-#else
-	update_mute_item(GTK_CHECK_MENU_ITEM(menu->mute_item),
-	                 G_CALLBACK(on_mute_item_activate),
-	                 menu, event->has_mute, event->muted);
-#endif
+	update_mute(menu, event->state->has_mute, event->state->muted);
 }
 
 /**
@@ -228,6 +244,9 @@ popup_menu_show(PopupMenu *menu,
                 GTK_3_22_UNUSED guint button,
                 GTK_3_22_UNUSED guint activate_time)
 {
+	/* The menu is not updated while hidden, so do it now */
+	update_mute(menu, audio_has_mute(menu->audio), audio_is_muted(menu->audio));
+
 #if GTK_CHECK_VERSION(3,22,0)
 	gtk_menu_popup_at_pointer(GTK_MENU(menu->menu), NULL);
 #else
@@ -246,7 +265,7 @@ popup_menu_destroy(PopupMenu *menu)
 {
 	DEBUG("Destroying");
 
-	audio_signals_disconnect(menu->audio, on_audio_changed, menu);
+	audio_signals_disconnect(menu->audio, menu->audio_handler);
 	gtk_widget_destroy(menu->menu_window);
 	g_free(menu);
 }
@@ -334,7 +353,10 @@ popup_menu_create(Audio *audio)
 
 	/* Connect audio signal handlers */
 	menu->audio = audio;
-	audio_signals_connect(audio, on_audio_changed, menu);
+	menu->audio_handler = audio_signals_connect_full
+	                      (audio, on_audio_changed, menu,
+	                       AUDIO_ALL_SIGNALS & ~AUDIO_SIGNAL_MASK(AUDIO_CAPTURE_VALUES_CHANGED),
+	                       AUDIO_ALL_USERS, is_menu_visible);
 
 	/* Cleanup */
 	g_object_unref(builder);
@@ -54,6 +54,7 @@
 #include "support-intl.h"
 #include "support-log.h"
 #include "support-ui.h"
+#include "throttle.h"
 #include "ui-popup-window.h"
 
 #include "main.h"
@@ -226,13 +227,70 @@ grab_devices(GtkWidget *window)
 struct popup_window {
 	/* Audio system */
 	Audio *audio;
+	guint audio_handler;
 	/* Widgets */
 	GtkWidget *popup_window;
 	GtkWidget *vol_scale;
 	GtkAdjustment *vol_scale_adj;
 	GtkWidget *mute_check;
+	/* Volume set with the slider, applied at a bounded pace */
+	Throttle *vol_throttle;
+#ifdef WITH_GTK3
+	GSourceFunc vol_tick_func;
+	gpointer vol_tick_data;
+#endif
 };
 
+/*
+ * Slider updates.
+ * Dragging the slider changes its value many times per frame, and setting
+ * the volume is not cheap: the card is written, and every audio handler
+ * around is invoked. So the volume goes through a throttle: only the
+ * latest value is kept, and it's applied at most once per frame, or once
+ * per interval if 'SliderUpdateInterval' is set. The last value is always
+ * applied, at the latest when the window is hidden.
+ */
+
+static void
+vol_scale_apply(gdouble value, gpointer data)
+{
+	PopupWindow *window = (PopupWindow *) data;
+
+	audio_set_volume(window->audio, AUDIO_USER_POPUP, value, 0);
+}
+
+#ifdef WITH_GTK3
+/* The slider's frame clock, for the throttle */
+static gboolean
+on_vol_scale_tick(G_GNUC_UNUSED GtkWidget *widget,
+                  G_GNUC_UNUSED GdkFrameClock *frame_clock, gpointer data)
+{
+	PopupWindow *window = (PopupWindow *) data;
+
+	return window->vol_tick_func(window->vol_tick_data);
+}
+
+static guint
+vol_scale_tick_add(GSourceFunc func, gpointer func_data, gpointer data)
+{
+	PopupWindow *window = (PopupWindow *) data;
+
+	window->vol_tick_func = func;
+	window->vol_tick_data = func_data;
+
+	return gtk_widget_add_tick_callback(window->vol_scale, on_vol_scale_tick,
+	                                    window, NULL);
+}
+
+static void
+vol_scale_tick_remove(guint id, gpointer data)
+{
+	PopupWindow *window = (PopupWindow *) data;
+
+	gtk_widget_remove_tick_callback(window->vol_scale, id);
+}
+#endif
+
 /**
  * Handles 'button-press-event', 'key-press-event' and 'grab-broken-event' signals,
  * on the GtkWindow. Used to hide the volume popup window.
@@ -302,10 +360,7 @@ on_popup_window_event(G_GNUC_UNUSED GtkWidget *widget, GdkEvent *event,
 void
 on_vol_scale_value_changed(GtkRange *range, PopupWindow *window)
 {
-	gdouble value;
-
-	value = gtk_range_get_value(range);
-	audio_set_volume(window->audio, AUDIO_USER_POPUP, value, 0);
+	throttle_push(window->vol_throttle, gtk_range_get_value(range));
 }
 
 /**
@@ -335,6 +390,17 @@ on_mixer_button_clicked(G_GNUC_UNUSED GtkButton *button, PopupWindow *window)
 	run_mixer_command();
 }
 
+/* Nothing to do if the window is hidden.
+ * The window will be updated anyway when shown.
+ */
+static gboolean
+is_window_visible(gpointer data)
+{
+	PopupWindow *window = (PopupWindow *) data;
+
+	return gtk_widget_get_visible(window->popup_window);
+}
+
 /**
  * Handle signals from the audio subsystem.
  *
@@ -343,21 +409,14 @@ on_mixer_button_clicked(G_GNUC_UNUSED GtkButton *button, PopupWindow *window)
  * @param data user supplied data.
  */
 static void
-on_audio_changed(G_GNUC_UNUSED Audio *audio, AudioEvent *event, gpointer data)
+on_audio_changed(G_GNUC_UNUSED Audio *audio, const AudioEvent *event, gpointer data)
 {
 	PopupWindow *window = (PopupWindow *) data;
-	GtkWidget *popup_window = window->popup_window;
-
-	/* Nothing to do if the window is hidden.
-	 * The window will be updated anyway when shown.
-	 */
-	if (!gtk_widget_get_visible(popup_window))
-		return;
 
 	/* Update mute checkbox */
 	update_mute_check(GTK_TOGGLE_BUTTON(window->mute_check),
 	                  G_CALLBACK(on_mute_check_toggled), window,
-	                  event->has_mute, event->muted);
+	                  event->state->has_mute, event->state->muted);
 
 	/* Update volume slider
 	 * If the user changes the volume through the popup window,
@@ -367,7 +426,7 @@ on_audio_changed(G_GNUC_UNUSED Audio *audio, AudioEvent *event, gpointer data)
 	 * and not the real value reported by the audio system.
 	 */
 	if (event->user != AUDIO_USER_POPUP)
-		update_volume_slider(window->vol_scale_adj, event->volume);
+		update_volume_slider(window->vol_scale_adj, event->state->volume);
 }
 
 /**
@@ -407,6 +466,7 @@ popup_window_show(PopupWindow *window)
 void
 popup_window_hide(PopupWindow *window)
 {
+	throttle_flush(window->vol_throttle);
 	gtk_widget_hide(window->popup_window);
 }
 
@@ -434,8 +494,11 @@ popup_window_cleanup(PopupWindow *window)
 {
 	DEBUG("Destroying");
 
+	/* Don't lose the last volume set */
+	throttle_free(window->vol_throttle);
+
 	/* Disconnect audio signals */
-	audio_signals_disconnect(window->audio, on_audio_changed, window);
+	audio_signals_disconnect(window->audio, window->audio_handler);
 
 	/* Destroy the Gtk window, freeing any resources */
 	gtk_widget_destroy(window->popup_window);
@@ -475,12 +538,24 @@ popup_window_init(PopupWindow *window, Audio *audio)
 	configure_vol_text(GTK_SCALE(window->vol_scale));
 	configure_vol_increment(GTK_ADJUSTMENT(window->vol_scale_adj));
 
+	/* Pace of the slider updates */
+	window->vol_throttle = throttle_new
+	                       (MAX(prefs_get_integer("SliderUpdateInterval", 0), 0),
+	                        vol_scale_apply, window);
+#ifdef WITH_GTK3
+	throttle_set_frame_clock(window->vol_throttle, vol_scale_tick_add,
+	                         vol_scale_tick_remove, window);
+#endif
+
 	/* Connect ui signal handlers */
 	gtk_builder_connect_signals(builder, window);
 
 	/* Connect audio signal handlers */
 	window->audio = audio;
-	audio_signals_connect(audio, on_audio_changed, window);
+	window->audio_handler = audio_signals_connect_full
+	                        (audio, on_audio_changed, window,
+	                         AUDIO_ALL_SIGNALS & ~AUDIO_SIGNAL_MASK(AUDIO_CAPTURE_VALUES_CHANGED),
+	                         AUDIO_ALL_USERS, is_window_visible);
 
 	/* Cleanup */
 	g_object_unref(builder);
@@ -117,6 +117,29 @@ fill_chan_combo(GtkComboBoxText *combo, const gchar *card_name)
 	g_free(selected_channel);
 }
 
+/**
+ * Fills the GtkEntry 'linked_chan_entry' with the channels linked to the
+ * SELECTED channel of a card, found in preferences. They're separated
+ * by commas.
+ *
+ * @param entry the GtkEntry widget for the linked channels.
+ * @param card_name the card to get the linked channels of.
+ */
+static void
+fill_linked_chan_entry(GtkEntry *entry, const gchar *card_name)
+{
+	gchar **channels;
+	gchar *text;
+
+	channels = prefs_get_linked_channels(card_name);
+	text = channels ? g_strjoinv(", ", channels) : NULL;
+
+	gtk_entry_set_text(entry, text ? text : "");
+
+	g_free(text);
+	g_strfreev(channels);
+}
+
 /**
  * Fills the GtkComboBoxText 'card_combo' with the currently available cards.
  * The active card in the combo box is set to the currently ACTIVE card,
@@ -167,6 +190,7 @@ struct prefs_dialog {
 	 * if something interesting happens (card disappearing, for example).
 	 */
 	Audio *audio;
+	guint audio_handler;
 	/* Hotkeys system
 	 * When assigning hotkeys, we must unbind the hotkeys first.
 	 * Otherwise the currently assigned keys are intercepted
@@ -194,6 +218,7 @@ struct prefs_dialog {
 	/* Device panel */
 	GtkWidget *card_combo;
 	GtkWidget *chan_combo;
+	GtkWidget *linked_chan_entry;
 	GtkWidget *normalize_vol_check;
 	/* Behavior panel */
 	GtkWidget *vol_control_entry;
@@ -211,6 +236,8 @@ struct prefs_dialog {
 	GtkWidget *hotkeys_up_label;
 	GtkWidget *hotkeys_down_eventbox;
 	GtkWidget *hotkeys_down_label;
+	GtkWidget *hotkeys_mic_mute_eventbox;
+	GtkWidget *hotkeys_mic_mute_label;
 	/* Notifications panel */
 #ifdef WITH_LIBNOTIFY
 	GtkWidget *noti_vbox_enabled;
@@ -272,6 +299,7 @@ on_card_combo_changed(GtkComboBoxText *box, PrefsDialog *dialog)
 
 	card_name = gtk_combo_box_text_get_active_text(box);
 	fill_chan_combo(GTK_COMBO_BOX_TEXT(dialog->chan_combo), card_name);
+	fill_linked_chan_entry(GTK_ENTRY(dialog->linked_chan_entry), card_name);
 	g_free(card_name);
 }
 
@@ -306,7 +334,7 @@ on_hotkeys_enable_check_toggled(GtkToggleButton *button, PrefsDialog *dialog)
 
 /**
  * Handles 'button-press-event' signal on one of the GtkEventBoxes used to
- * define a hotkey: 'hotkeys_mute/up/down_eventbox'.
+ * define a hotkey: 'hotkeys_mute/up/down/mic_mute_eventbox'.
  * Runs a dialog dialog where user can define a new hotkey.
  * User should double-click on the event box to define a new hotkey.
  *
@@ -343,6 +371,9 @@ on_hotkey_event_box_button_press_event(GtkWidget *widget, GdkEventButton *event,
 	} else if (widget == dialog->hotkeys_down_eventbox) {
 		hotkey_label = GTK_LABEL(dialog->hotkeys_down_label);
 		hotkey = _("Volume Down");
+	} else if (widget == dialog->hotkeys_mic_mute_eventbox) {
+		hotkey_label = GTK_LABEL(dialog->hotkeys_mic_mute_label);
+		hotkey = _("Microphone Mute/Unmute");
 	}
 	g_assert(hotkey);
 
@@ -430,7 +461,7 @@ on_prefs_dialog_response(G_GNUC_UNUSED GtkDialog *widget,
  * @param data user supplied data.
  */
 static void
-on_audio_changed(Audio *audio, AudioEvent *event, gpointer data)
+on_audio_changed(Audio *audio, const AudioEvent *event, gpointer data)
 {
 	PrefsDialog *dialog = (PrefsDialog *) data;
 	GtkComboBoxText *card_combo = GTK_COMBO_BOX_TEXT(dialog->card_combo);
@@ -522,9 +553,25 @@ prefs_dialog_retrieve(PrefsDialog *dialog)
 	GtkWidget *ccc = dialog->chan_combo;
 	gchar *chan = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(ccc));
 	prefs_set_channel(card, chan);
-	g_free(card);
 	g_free(chan);
 
+	// linked channels, the empty ones are dropped
+	GtkWidget *lce = dialog->linked_chan_entry;
+	gchar **linked = g_strsplit(gtk_entry_get_text(GTK_ENTRY(lce)), ",", -1);
+	guint i, n_linked = 0;
+	for (i = 0; linked[i]; i++) {
+		g_strstrip(linked[i]);
+		if (*linked[i] == '\0') {
+			g_free(linked[i]);
+			continue;
+		}
+		linked[n_linked++] = linked[i];
+	}
+	linked[n_linked] = NULL;
+	prefs_set_linked_channels(card, (const gchar * const *) linked, n_linked);
+	g_strfreev(linked);
+	g_free(card);
+
 	// normalize volume
 	GtkWidget *vnorm = dialog->normalize_vol_check;
 	gboolean is_pressed;
@@ -580,6 +627,11 @@ prefs_dialog_retrieve(PrefsDialog *dialog)
 	prefs_set_integer("VolDownKey", keycode);
 	prefs_set_integer("VolDownMods", mods);
 
+	kl = dialog->hotkeys_mic_mute_label;
+	get_keycode_for_label(GTK_LABEL(kl), &keycode, &mods);
+	prefs_set_integer("MicMuteKey", keycode);
+	prefs_set_integer("MicMuteMods", mods);
+
 	// notifications
 #ifdef WITH_LIBNOTIFY
 	GtkWidget *nc = dialog->noti_enable_check;
@@ -699,6 +751,8 @@ prefs_dialog_populate(PrefsDialog *dialog)
 	 */
 	fill_chan_combo(GTK_COMBO_BOX_TEXT(dialog->chan_combo),
 	                audio_get_card(dialog->audio));
+	fill_linked_chan_entry(GTK_ENTRY(dialog->linked_chan_entry),
+	                       audio_get_card(dialog->audio));
 #endif
 
 	// normalize volume
@@ -757,6 +811,10 @@ prefs_dialog_populate(PrefsDialog *dialog)
 	                      prefs_get_integer("VolDownKey", -1),
 	                      prefs_get_integer("VolDownMods", 0));
 
+	set_label_for_keycode(GTK_LABEL(dialog->hotkeys_mic_mute_label),
+	                      prefs_get_integer("MicMuteKey", -1),
+	                      prefs_get_integer("MicMuteMods", 0));
+
 	on_hotkeys_enable_check_toggled
 	(GTK_TOGGLE_BUTTON(dialog->hotkeys_enable_check), dialog);
 
@@ -818,7 +876,7 @@ prefs_dialog_destroy(PrefsDialog *dialog)
 	g_signal_handler_disconnect(GTK_WINDOW(dialog->prefs_dialog),
 	                            dialog->response_handler);
 
-	audio_signals_disconnect(dialog->audio, on_audio_changed, dialog);
+	audio_signals_disconnect(dialog->audio, dialog->audio_handler);
 
 	if (dialog->hotkey_dialog)
 		hotkey_dialog_destroy(dialog->hotkey_dialog);
@@ -887,6 +945,7 @@ prefs_dialog_create(GtkWindow *parent, Audio *audio, Hotkeys *hotkeys,
 	// Device panel
 	assign_gtk_widget(builder, dialog, card_combo);
 	assign_gtk_widget(builder, dialog, chan_combo);
+	assign_gtk_widget(builder, dialog, linked_chan_entry);
 	assign_gtk_widget(builder, dialog, normalize_vol_check);
 	// Behavior panel
 	assign_gtk_widget(builder, dialog, vol_control_entry);
@@ -904,6 +963,8 @@ prefs_dialog_create(GtkWindow *parent, Audio *audio, Hotkeys *hotkeys,
 	assign_gtk_widget(builder, dialog, hotkeys_up_label);
 	assign_gtk_widget(builder, dialog, hotkeys_down_eventbox);
 	assign_gtk_widget(builder, dialog, hotkeys_down_label);
+	assign_gtk_widget(builder, dialog, hotkeys_mic_mute_eventbox);
+	assign_gtk_widget(builder, dialog, hotkeys_mic_mute_label);
 	// Notifications panel
 #ifdef WITH_LIBNOTIFY
 	assign_gtk_widget(builder, dialog, noti_vbox_enabled);
@@ -929,7 +990,11 @@ prefs_dialog_create(GtkWindow *parent, Audio *audio, Hotkeys *hotkeys,
 	dialog->audio = audio;
 
 	/* Connect audio signal handlers */
-	audio_signals_connect(audio, on_audio_changed, dialog);
+	dialog->audio_handler = audio_signals_connect_full
+	                        (audio, on_audio_changed, dialog,
+	                         AUDIO_SIGNAL_MASK(AUDIO_CARD_INITIALIZED) |
+	                         AUDIO_SIGNAL_MASK(AUDIO_CARD_CLEANED_UP),
+	                         AUDIO_ALL_USERS, NULL);
 
 	/* Setup user callback */
 	dialog->response_user_cb = cb;
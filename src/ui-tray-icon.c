@@ -34,6 +34,7 @@
 #include "main.h"
 
 #define ICON_MIN_SIZE 16
+#define BALANCE_STEP 0.1
 
 enum {
 	VOLUME_MUTED,
@@ -207,19 +208,40 @@ pixbuf_array_new(int size)
 	return pixbufs;
 }
 
+/* Tray icon drawing */
+
+/* Fills a rectangle of an RGBA pixbuf with a color. The first row is filled
+ * pixel by pixel, the others are copies of the first one.
+ */
+static void
+pixbuf_fill_rect(GdkPixbuf *pixbuf, int x, int y, int width, int height,
+                 const guchar color[4])
+{
+	int rowstride, i;
+	guchar *first;
+
+	if (width <= 0 || height <= 0)
+		return;
+
+	rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+	first = gdk_pixbuf_get_pixels(pixbuf) + (y * rowstride) + (x * 4);
+
+	for (i = 0; i < width; i++)
+		memcpy(first + i * 4, color, 4);
+
+	for (i = 1; i < height; i++)
+		memcpy(first + i * rowstride, first, width * 4);
+}
+
 /* Tray icon volume meter */
 
 struct vol_meter {
 	/* Configuration */
-	guchar red;
-	guchar green;
-	guchar blue;
+	guchar color[4];
 	gint x_offset_pct;
 	gint y_offset_pct;
 	/* Dynamic stuff */
 	GdkPixbuf *pixbuf;
-	gint width;
-	guchar *row;
 };
 
 typedef struct vol_meter VolMeter;
@@ -234,7 +256,6 @@ vol_meter_free(VolMeter *vol_meter)
 	if (vol_meter->pixbuf)
 		g_object_unref(vol_meter->pixbuf);
 
-	g_free(vol_meter->row);
 	g_free(vol_meter);
 }
 
@@ -256,9 +277,10 @@ vol_meter_new(void)
 	vol_meter->y_offset_pct = 10;
 
 	vol_meter_clrs = prefs_get_double_list("VolMeterColor", NULL);
-	vol_meter->red = vol_meter_clrs[0] * 255;
-	vol_meter->green = vol_meter_clrs[1] * 255;
-	vol_meter->blue = vol_meter_clrs[2] * 255;
+	vol_meter->color[0] = vol_meter_clrs[0] * 255;
+	vol_meter->color[1] = vol_meter_clrs[1] * 255;
+	vol_meter->color[2] = vol_meter_clrs[2] * 255;
+	vol_meter->color[3] = 255;
 	g_free(vol_meter_clrs);
 
 	return vol_meter;
@@ -274,8 +296,6 @@ vol_meter_draw(VolMeter *vol_meter, GdkPixbuf *pixbuf, int volume)
 	int icon_width, icon_height;
 	int vm_width, vm_height;
 	int x, y;
-	int rowstride, i;
-	guchar *pixels;
 
 	/* Ensure the pixbuf is as expected */
 	g_assert(gdk_pixbuf_get_colorspace(pixbuf) == GDK_COLORSPACE_RGB);
@@ -300,43 +320,42 @@ vol_meter_draw(VolMeter *vol_meter, GdkPixbuf *pixbuf, int volume)
 	vm_height = (icon_height - (y * 2)) * (volume / 100.0);
 	g_assert(y >= 0 && y + vm_height <= icon_height);
 
-	/* Let's check if the icon width changed, in which case we
-	 * must reinit our internal row of pixels.
-	 */
-	if (vm_width != vol_meter->width) {
-		vol_meter->width = vm_width;
-		g_free(vol_meter->row);
-		vol_meter->row = NULL;
-	}
+	/* Draw the volume meter, from the bottom up */
+	y = icon_height - y;
+	pixbuf_fill_rect(pixbuf, x, y - vm_height + 1, vm_width, vm_height,
+	                 vol_meter->color);
 
-	if (vol_meter->row == NULL) {
-		DEBUG("Allocating vol meter row (width %d)", vm_width);
-		vol_meter->row = g_malloc(vm_width * sizeof(guchar) * 4);
-		for (i = 0; i < vm_width; i++) {
-			vol_meter->row[i * 4 + 0] = vol_meter->red;
-			vol_meter->row[i * 4 + 1] = vol_meter->green;
-			vol_meter->row[i * 4 + 2] = vol_meter->blue;
-			vol_meter->row[i * 4 + 3] = 255;
-		}
-	}
+	return pixbuf;
+}
 
-	/* Draw the volume meter.
-	 * Rows in the image are stored top to bottom.
-	 */
-	y = icon_height - y;
-	rowstride = gdk_pixbuf_get_rowstride(pixbuf);
-	pixels = gdk_pixbuf_get_pixels(pixbuf);
+/* Tray icon microphone badge */
 
-	for (i = 0; i < vm_height; i++) {
-		guchar *p;
-		guint row_offset, col_offset;
+/* Draws a red square in the bottom right corner of the icon, telling that
+ * the microphone is muted. Like vol_meter_draw(), it works on a copy, that
+ * is cached in 'cache' and returned. There's no need to unref it.
+ */
+static GdkPixbuf *
+capture_badge_draw(GdkPixbuf **cache, GdkPixbuf *pixbuf)
+{
+	static const guchar red[4] = { 255, 0, 0, 255 };
+	int icon_width, icon_height;
+	int size;
 
-		row_offset = y - i;
-		col_offset = x * 4;
-		p = pixels + (row_offset * rowstride) + col_offset;
+	/* We only know how to draw on RGBA pixbufs */
+	if (gdk_pixbuf_get_colorspace(pixbuf) != GDK_COLORSPACE_RGB ||
+	    gdk_pixbuf_get_bits_per_sample(pixbuf) != 8 ||
+	    gdk_pixbuf_get_n_channels(pixbuf) != 4)
+		return pixbuf;
 
-		memcpy(p, vol_meter->row, vm_width * 4);
-	}
+	if (*cache)
+		g_object_unref(*cache);
+	*cache = pixbuf = gdk_pixbuf_copy(pixbuf);
+
+	icon_width = gdk_pixbuf_get_width(pixbuf);
+	icon_height = gdk_pixbuf_get_height(pixbuf);
+	size = MAX(MIN(icon_width, icon_height) / 4, 2);
+	pixbuf_fill_rect(pixbuf, icon_width - size, icon_height - size,
+	                 size, size, red);
 
 	return pixbuf;
 }
@@ -347,7 +366,9 @@ vol_meter_draw(VolMeter *vol_meter, GdkPixbuf *pixbuf, int volume)
 static void
 update_status_icon_pixbuf(GtkStatusIcon *status_icon,
                           GdkPixbuf **pixbufs, VolMeter *vol_meter,
-                          gdouble volume, gboolean muted)
+                          GdkPixbuf **capture_badge,
+                          gdouble volume, gboolean muted,
+                          gboolean capture_muted)
 {
 	GdkPixbuf *pixbuf;
 
@@ -367,6 +388,9 @@ update_status_icon_pixbuf(GtkStatusIcon *status_icon,
 	if (vol_meter && muted == FALSE)
 		pixbuf = vol_meter_draw(vol_meter, pixbuf, volume);
 
+	if (capture_badge && capture_muted && pixbuf)
+		pixbuf = capture_badge_draw(capture_badge, pixbuf);
+
 	gtk_status_icon_set_from_pixbuf(status_icon, pixbuf);
 }
 
@@ -374,37 +398,50 @@ update_status_icon_pixbuf(GtkStatusIcon *status_icon,
 static void
 update_status_icon_tooltip(GtkStatusIcon *status_icon,
                            const gchar *card, const gchar *channel,
-                           gdouble volume, gboolean has_mute, gboolean muted)
+                           gdouble volume, gdouble balance,
+                           gboolean has_mute, gboolean muted,
+                           const gchar *capture_channel, gboolean capture_muted,
+                           gdouble capture_volume)
 {
-	gchar *card_info;
-	gchar *volume_info;
-	gchar *mute_info;
+	gchar *lines[6];
 	gchar *info;
-
-	card_info = g_strdup_printf("%s (%s)", card, channel);
-	volume_info = g_strdup_printf("%s: %ld %%", _("Volume"), lround(volume));
+	guint n = 0;
+
+	lines[n++] = g_strdup_printf("%s (%s)", card, channel);
+	lines[n++] = g_strdup_printf("%s: %ld %%", _("Volume"), lround(volume));
+	if (lround(balance * 100) != 0)
+		lines[n++] = g_strdup_printf("%s: %s %ld %%", _("Balance"),
+		                             balance < 0 ? _("left") : _("right"),
+		                             lround(fabs(balance) * 100));
 	if (has_mute == FALSE)
-		mute_info = g_strdup_printf(_("No mute switch"));
+		lines[n++] = g_strdup_printf(_("No mute switch"));
 	else if (muted)
-		mute_info = g_strdup_printf(_("Muted"));
-	else
-		mute_info = NULL;
+		lines[n++] = g_strdup_printf(_("Muted"));
+	if (capture_channel && capture_muted)
+		lines[n++] = g_strdup_printf("%s (%s): %s", _("Microphone"),
+		                             capture_channel, _("muted"));
+	else if (capture_channel)
+		lines[n++] = g_strdup_printf("%s (%s): %ld %%", _("Microphone"),
+		                             capture_channel, lround(capture_volume));
+	lines[n] = NULL;
 
-	info = g_strjoin("\n", card_info, volume_info, mute_info, NULL);
+	info = g_strjoinv("\n", lines);
 
 	gtk_status_icon_set_tooltip_text(status_icon, info);
 
 	g_free(info);
-	g_free(mute_info);
-	g_free(volume_info);
-	g_free(card_info);
+	while (n > 0)
+		g_free(lines[--n]);
 }
 
 /* Public functions & signal handlers */
 
 struct tray_icon {
 	Audio *audio;
+	guint audio_handler;
 	VolMeter *vol_meter;
+	gboolean draw_capture_muted;
+	GdkPixbuf *capture_badge;
 	GdkPixbuf **pixbufs;
 	GtkStatusIcon *status_icon;
 	gint status_icon_size;
@@ -413,14 +450,15 @@ struct tray_icon {
 /**
  * Handles the 'activate' signal on the GtkStatusIcon, bringing up or hiding
  * the volume popup window. Usually triggered by left-click.
+ * If the icon belongs to a card, this card becomes the active one first.
  *
  * @param status_icon the object which received the signal.
  * @param icon TrayIcon instance set when the signal handler was connected.
  */
 static void
-on_activate(G_GNUC_UNUSED GtkStatusIcon *status_icon,
-            G_GNUC_UNUSED TrayIcon *icon)
+on_activate(G_GNUC_UNUSED GtkStatusIcon *status_icon, TrayIcon *icon)
 {
+	audio_activate(icon->audio);
 	do_toggle_popup_window();
 }
 
@@ -483,9 +521,37 @@ on_button_release_event(G_GNUC_UNUSED GtkStatusIcon *status_icon,
 	return FALSE;
 }
 
+/* Move the balance to the left (negative delta) or to the right.
+ * The loudest channel keeps its volume, the other one is scaled down.
+ */
+static void
+shift_balance(Audio *audio, gdouble delta)
+{
+	AudioVolumes volumes;
+	gdouble volume, balance;
+
+	/* The balance only makes sense with a left and a right channel,
+	 * and it can't be told when everything is at zero.
+	 */
+	audio_get_volumes(audio, &volumes);
+	volume = MAX(volumes.volume[0], volumes.volume[1]);
+	if (volumes.n_channels != 2 || volume <= 0)
+		return;
+
+	balance = CLAMP(volumes.balance + delta, -1, 1);
+	if (fabs(balance) < BALANCE_STEP / 2)
+		balance = 0;
+
+	volumes.volume[0] = balance > 0 ? volume * (1 - balance) : volume;
+	volumes.volume[1] = balance < 0 ? volume * (1 + balance) : volume;
+
+	audio_set_volumes(audio, AUDIO_USER_TRAY_ICON, &volumes);
+}
+
 /**
  * Handles 'scroll-event' signal on the GtkStatusIcon, changing the volume
- * accordingly.
+ * accordingly. Scrolling sideways moves the balance, and scrolling with
+ * Control held down changes the microphone volume.
  *
  * @param status_icon the object which received the signal.
  * @param event the GdkEventScroll which triggered this signal.
@@ -497,10 +563,23 @@ static gboolean
 on_scroll_event(G_GNUC_UNUSED GtkStatusIcon *status_icon, GdkEventScroll *event,
                 TrayIcon *icon)
 {
+	if (event->state & GDK_CONTROL_MASK) {
+		if (event->direction == GDK_SCROLL_UP)
+			audio_raise_capture_volume(icon->audio, AUDIO_USER_TRAY_ICON);
+		else if (event->direction == GDK_SCROLL_DOWN)
+			audio_lower_capture_volume(icon->audio, AUDIO_USER_TRAY_ICON);
+
+		return FALSE;
+	}
+
 	if (event->direction == GDK_SCROLL_UP)
 		audio_raise_volume(icon->audio, AUDIO_USER_TRAY_ICON);
 	else if (event->direction == GDK_SCROLL_DOWN)
 		audio_lower_volume(icon->audio, AUDIO_USER_TRAY_ICON);
+	else if (event->direction == GDK_SCROLL_LEFT)
+		shift_balance(icon->audio, -BALANCE_STEP);
+	else if (event->direction == GDK_SCROLL_RIGHT)
+		shift_balance(icon->audio, +BALANCE_STEP);
 
 	return FALSE;
 }
@@ -546,13 +625,22 @@ on_size_changed(G_GNUC_UNUSED GtkStatusIcon *status_icon, gint size, TrayIcon *i
  * @param data user supplied data.
  */
 static void
-on_audio_changed(G_GNUC_UNUSED Audio *audio, AudioEvent *event, gpointer data)
+on_audio_changed(G_GNUC_UNUSED Audio *audio, const AudioEvent *event, gpointer data)
 {
 	TrayIcon *icon = (TrayIcon *) data;
+	const AudioState *state = event->state;
+	GdkPixbuf **capture_badge;
+
+	capture_badge = icon->draw_capture_muted ? &icon->capture_badge : NULL;
 	update_status_icon_pixbuf(icon->status_icon, icon->pixbufs, icon->vol_meter,
-	                          event->volume, event->muted);
-	update_status_icon_tooltip(icon->status_icon, event->card, event->channel,
-	                           event->volume, event->has_mute, event->muted);
+	                          capture_badge, state->volume, state->muted,
+	                          state->has_capture && state->capture_muted);
+	update_status_icon_tooltip(icon->status_icon, state->card, state->channel,
+	                           state->volume, state->balance,
+	                           state->has_mute, state->muted,
+	                           state->has_capture ?
+	                           audio_get_capture_channel(icon->audio) : NULL,
+	                           state->capture_muted, state->capture_volume);
 }
 
 /**
@@ -569,6 +657,7 @@ tray_icon_reload(TrayIcon *icon)
 	gdouble volume;
 	gboolean has_mute;
 	gboolean muted;
+	gboolean capture_muted;
 
 	pixbuf_array_free(icon->pixbufs);
 	icon->pixbufs = pixbuf_array_new(icon->status_icon_size);
@@ -576,14 +665,23 @@ tray_icon_reload(TrayIcon *icon)
 	vol_meter_free(icon->vol_meter);
 	icon->vol_meter = vol_meter_new();
 
+	icon->draw_capture_muted = prefs_get_boolean("DrawCaptureMuted", TRUE);
+
 	card = audio_get_card(icon->audio);
 	channel = audio_get_channel(icon->audio);
 	volume = audio_get_volume(icon->audio);
 	has_mute = audio_has_mute(icon->audio);
 	muted = audio_is_muted(icon->audio);
+	capture_muted = audio_has_capture(icon->audio) &&
+	                audio_capture_is_muted(icon->audio);
 	update_status_icon_pixbuf(icon->status_icon, icon->pixbufs, icon->vol_meter,
-	                          volume, muted);
-	update_status_icon_tooltip(icon->status_icon, card, channel, volume, has_mute, muted);
+	                          icon->draw_capture_muted ? &icon->capture_badge : NULL,
+	                          volume, muted, capture_muted);
+	update_status_icon_tooltip(icon->status_icon, card, channel, volume,
+	                           audio_get_balance(icon->audio), has_mute, muted,
+	                           audio_get_capture_channel(icon->audio),
+	                           audio_capture_is_muted(icon->audio),
+	                           audio_get_capture_volume(icon->audio));
 }
 
 /**
@@ -596,10 +694,12 @@ tray_icon_destroy(TrayIcon *icon)
 {
 	DEBUG("Destroying");
 
-	audio_signals_disconnect(icon->audio, on_audio_changed, icon);
+	audio_signals_disconnect(icon->audio, icon->audio_handler);
 	g_object_unref(icon->status_icon);
 	pixbuf_array_free(icon->pixbufs);
 	vol_meter_free(icon->vol_meter);
+	if (icon->capture_badge)
+		g_object_unref(icon->capture_badge);
 	g_free(icon);
 }
 
@@ -642,7 +742,7 @@ tray_icon_create(Audio *audio)
 
 	/* Connect audio signals handlers */
 	icon->audio = audio;
-	audio_signals_connect(audio, on_audio_changed, icon);
+	icon->audio_handler = audio_signals_connect(audio, on_audio_changed, icon);
 
 	/* Display icon */
 	gtk_status_icon_set_visible(icon->status_icon, TRUE);
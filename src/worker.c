@@ -0,0 +1,984 @@
+/* worker.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file worker.c
+ * This file holds the audio worker, a backend that wraps another backend
+ * and runs it in a thread of its own. Talking to a sound card can block
+ * for a while (Bluetooth, USB, the Alsa pulse plugin...), and we don't
+ * want the ui to freeze meanwhile.
+ *
+ * The worker thread owns the cards of the inner backend, and runs its
+ * own main loop to get their events. The ui thread only sees a snapshot
+ * of each card: getters read the snapshot, setters update it right away
+ * and leave a request to the worker. Requests don't pile up: a new volume
+ * replaces the one that is still pending, so the worker only ever applies
+ * the latest value. Once done, the worker refreshes the snapshot with what
+ * the card really took, without notifying the ui thread: it already knows
+ * about its own change. Only changes made by someone else are notified.
+ *
+ * Creating a card and listing cards or channels are still synchronous:
+ * the ui thread waits for the worker to be done.
+ * @brief Audio backend running in a thread.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+
+#include "backend.h"
+#include "worker.h"
+#include "support-log.h"
+
+/*
+ * Worker thread.
+ */
+
+struct worker {
+	/* Backend doing the real work, and the number of its cards in use */
+	const Backend *inner;
+	guint n_cards;
+	/* Thread and its main loop */
+	GThread *thread;
+	GMainContext *context;
+	GMainLoop *loop;
+	/* Used to wait for synchronous calls */
+	GMutex lock;
+	GCond cond;
+	/* Cards callback, invoked in the ui thread */
+	BackendCardsCb cards_cb_func;
+	gpointer cards_cb_data;
+};
+
+static struct worker worker;
+
+/* Main function of the worker thread */
+static gpointer
+worker_thread(G_GNUC_UNUSED gpointer data)
+{
+	g_main_context_push_thread_default(worker.context);
+	g_main_loop_run(worker.loop);
+	g_main_context_pop_thread_default(worker.context);
+
+	return NULL;
+}
+
+/* Start the worker thread, if it's not started yet.
+ * It lives until worker_shutdown() is called.
+ */
+static void
+worker_ensure(void)
+{
+	if (worker.thread)
+		return;
+
+	worker.context = g_main_context_new();
+	worker.loop = g_main_loop_new(worker.context, FALSE);
+	worker.thread = g_thread_new("audio-worker", worker_thread, NULL);
+
+	DEBUG("Audio worker started");
+}
+
+/*
+ * Synchronous calls.
+ * The ui thread fills a WorkerCall, asks the worker to run a function,
+ * and waits for it to be done.
+ */
+
+typedef struct worker_card WorkerCard;
+
+struct worker_call {
+	/* Arguments */
+	const char *card_name;
+	const char *channel;
+	BackendStream stream;
+	gboolean normalize;
+	gdouble weight;
+	WorkerCard *card;
+	BackendCardsCb cards_cb;
+	/* Results */
+	GSList *list;
+	gboolean success;
+	/* Set by the worker when it's done */
+	gboolean done;
+};
+
+typedef struct worker_call WorkerCall;
+
+/* Run a function in the worker thread with a given priority, and wait
+ * for it to be done.
+ */
+static void
+worker_call_full(GSourceFunc func, WorkerCall *call, gint priority)
+{
+	worker_ensure();
+
+	call->done = FALSE;
+	g_main_context_invoke_full(worker.context, priority, func, call, NULL);
+
+	g_mutex_lock(&worker.lock);
+	while (!call->done)
+		g_cond_wait(&worker.cond, &worker.lock);
+	g_mutex_unlock(&worker.lock);
+}
+
+/* Run a function in the worker thread, and wait for it to be done */
+static void
+worker_call(GSourceFunc func, WorkerCall *call)
+{
+	worker_call_full(func, call, G_PRIORITY_DEFAULT);
+}
+
+/* Tell the ui thread that a call is done, in the worker thread */
+static gboolean
+worker_call_done(WorkerCall *call)
+{
+	g_mutex_lock(&worker.lock);
+	call->done = TRUE;
+	g_cond_broadcast(&worker.cond);
+	g_mutex_unlock(&worker.lock);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Stop the main loop of the worker thread, in the worker thread.
+ * Requests queued before are run first. The inner backend lets go of
+ * the sources it attached to our main context, that is about to go.
+ */
+static gboolean
+worker_quit_cb(gpointer data)
+{
+	backend_cleanup(worker.inner);
+	g_main_loop_quit(worker.loop);
+
+	return worker_call_done(data);
+}
+
+/*
+ * Cards.
+ */
+
+enum worker_request {
+	WORKER_REQUEST_MUTE    = 1 << 0,
+	WORKER_REQUEST_VOLUME  = 1 << 1,
+	WORKER_REQUEST_VOLUMES = 1 << 2
+};
+
+struct worker_state {
+	gboolean has_mute;
+	gboolean muted;
+	gdouble volume;
+	guint step;
+	guint n_steps;
+	BackendVolumes volumes;
+};
+
+typedef struct worker_state WorkerState;
+
+struct worker_card {
+	BackendCard parent;
+	/* Card of the inner backend, only used in the worker thread */
+	BackendCard *inner;
+	/* Snapshot and pending requests, protected by the lock */
+	GMutex lock;
+	WorkerState state;
+	guint requests;
+	gboolean mute;
+	gdouble volume;
+	gint step; /* Step index to set, -1 if the volume is in percent */
+	gboolean stepped;
+	BackendVolumes volumes;
+	int dir;
+	gboolean scheduled;
+	/* Both threads hold a reference */
+	gint refcount;
+	/* Only used in the ui thread */
+	gchar *name;
+	gchar *channel;
+	gboolean freed;
+	BackendCb cb_func;
+	gpointer cb_data;
+};
+
+#define WORKER_CARD(card) ((WorkerCard *) (card))
+
+static WorkerCard *
+worker_card_ref(WorkerCard *card)
+{
+	g_atomic_int_inc(&card->refcount);
+
+	return card;
+}
+
+static void
+worker_card_unref(WorkerCard *card)
+{
+	if (!g_atomic_int_dec_and_test(&card->refcount))
+		return;
+
+	g_mutex_clear(&card->lock);
+	g_free(card->channel);
+	g_free(card->name);
+	g_free(card);
+}
+
+/* Compare the channel volumes of two snapshots */
+static gboolean
+worker_volumes_equal(const BackendVolumes *a, const BackendVolumes *b)
+{
+	guint i;
+
+	if (a->n_channels != b->n_channels || a->balance != b->balance)
+		return FALSE;
+
+	for (i = 0; i < a->n_channels; i++) {
+		if (a->volume[i] != b->volume[i])
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Read the state of the inner card, in the worker thread */
+static void
+worker_card_read(WorkerCard *card, WorkerState *state)
+{
+	state->has_mute = backend_card_has_mute(card->inner);
+	state->muted = backend_card_is_muted(card->inner);
+	state->volume = backend_card_get_volume(card->inner);
+	backend_card_get_steps(card->inner, &state->step, &state->n_steps);
+	backend_card_get_volumes(card->inner, &state->volumes);
+}
+
+/*
+ * Events, from the worker thread to the ui thread.
+ */
+
+struct worker_event {
+	WorkerCard *card;
+	enum backend_event event;
+	guint changes;
+};
+
+typedef struct worker_event WorkerEvent;
+
+/* Deliver an event in the ui thread. It's dropped if the card
+ * was freed in the meantime.
+ */
+static gboolean
+worker_event_dispatch(gpointer data)
+{
+	WorkerEvent *ev = data;
+	WorkerCard *card = ev->card;
+
+	if (!card->freed && card->cb_func)
+		card->cb_func(ev->event, ev->changes, card->cb_data);
+
+	worker_card_unref(card);
+	g_free(ev);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Send an event to the ui thread */
+static void
+worker_event_post(WorkerCard *card, enum backend_event event, guint changes)
+{
+	WorkerEvent *ev;
+
+	ev = g_new0(WorkerEvent, 1);
+	ev->card = worker_card_ref(card);
+	ev->event = event;
+	ev->changes = changes;
+
+	g_idle_add(worker_event_dispatch, ev);
+}
+
+/* Refresh the snapshot of a card, in the worker thread.
+ * If some requests are pending, the snapshot is left alone, since
+ * it already holds the values the ui asked for.
+ */
+static void
+worker_card_refresh(WorkerCard *card)
+{
+	WorkerState state;
+
+	worker_card_read(card, &state);
+
+	g_mutex_lock(&card->lock);
+	if (card->requests == 0)
+		card->state = state;
+	g_mutex_unlock(&card->lock);
+}
+
+/* Refresh the snapshot of a card after a change made by someone else,
+ * and notify the ui thread, in the worker thread.
+ */
+static void
+worker_card_publish(WorkerCard *card, guint changes)
+{
+	worker_card_refresh(card);
+
+	worker_event_post(card, BACKEND_CARD_VALUES_CHANGED,
+	                  changes ? changes :
+	                  BACKEND_CHANGE_VOLUME | BACKEND_CHANGE_SWITCH);
+}
+
+/* Callback of the inner card, invoked in the worker thread */
+static void
+worker_card_on_event(enum backend_event event, guint changes, gpointer data)
+{
+	WorkerCard *card = data;
+
+	switch (event) {
+	case BACKEND_CARD_VALUES_CHANGED:
+		worker_card_publish(card, changes);
+		break;
+	default:
+		worker_event_post(card, event, changes);
+	}
+}
+
+/* Apply the pending requests of a card, in the worker thread */
+static gboolean
+worker_card_flush(gpointer data)
+{
+	WorkerCard *card = data;
+	BackendTransaction trans = { 0 };
+	BackendVolumes volumes;
+	gboolean mute, stepped;
+	gdouble volume;
+	guint requests;
+	gint step;
+	int dir;
+
+	g_mutex_lock(&card->lock);
+	requests = card->requests;
+	mute = card->mute;
+	volume = card->volume;
+	step = card->step;
+	stepped = card->stepped;
+	volumes = card->volumes;
+	dir = card->dir;
+	card->requests = 0;
+	card->scheduled = FALSE;
+	g_mutex_unlock(&card->lock);
+
+	/* The card may have been freed since */
+	if (card->inner) {
+		/* Volume and mute go to the inner card in one transaction */
+		if (requests & WORKER_REQUEST_VOLUMES) {
+			BackendOp *op = &trans.ops[trans.n_ops++];
+
+			op->type = BACKEND_OP_SET_VOLUMES;
+			op->volumes = volumes;
+			op->dir = dir;
+		} else if (requests & WORKER_REQUEST_VOLUME) {
+			BackendOp *op = &trans.ops[trans.n_ops++];
+			gdouble delta = volume - backend_card_get_volume(card->inner);
+
+			/* Steps were merged into a target volume, send them
+			 * back as a step, so that the volume moves for sure.
+			 */
+			if (step >= 0) {
+				op->type = BACKEND_OP_SET_STEP;
+				op->value = step;
+			} else if (stepped && delta * dir > 0) {
+				op->type = BACKEND_OP_STEP_VOLUME;
+				op->value = delta;
+			} else {
+				op->type = BACKEND_OP_SET_VOLUME;
+				op->value = volume;
+			}
+			op->dir = dir;
+		}
+
+		if (requests & WORKER_REQUEST_MUTE) {
+			BackendOp *op = &trans.ops[trans.n_ops++];
+
+			op->type = BACKEND_OP_SET_MUTE;
+			op->muted = mute;
+		}
+
+		if (trans.n_ops > 0)
+			backend_card_apply(card->inner, &trans);
+
+		/* The ui thread dispatched this change already, when it made
+		 * the request. What the card really took (rounded to its
+		 * steps, or left alone if the write failed) only goes to the
+		 * snapshot: our own writes are not reported as new changes.
+		 */
+		worker_card_refresh(card);
+	}
+
+	worker_card_unref(card);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Ask the worker to apply the pending requests. Must be called
+ * with the lock held. Requests made before the worker gets to
+ * the card are merged together.
+ */
+static void
+worker_card_schedule(WorkerCard *card)
+{
+	if (card->scheduled)
+		return;
+
+	card->scheduled = TRUE;
+	g_main_context_invoke(worker.context, worker_card_flush,
+	                      worker_card_ref(card));
+}
+
+/*
+ * Card operations, in the ui thread.
+ */
+
+static const char *
+worker_card_get_name(BackendCard *base)
+{
+	return WORKER_CARD(base)->name;
+}
+
+static const char *
+worker_card_get_channel(BackendCard *base)
+{
+	return WORKER_CARD(base)->channel;
+}
+
+static gboolean
+worker_card_has_mute(BackendCard *base)
+{
+	WorkerCard *card = WORKER_CARD(base);
+	gboolean has_mute;
+
+	g_mutex_lock(&card->lock);
+	has_mute = card->state.has_mute;
+	g_mutex_unlock(&card->lock);
+
+	return has_mute;
+}
+
+static gboolean
+worker_card_is_muted(BackendCard *base)
+{
+	WorkerCard *card = WORKER_CARD(base);
+	gboolean muted;
+
+	g_mutex_lock(&card->lock);
+	muted = card->state.muted;
+	g_mutex_unlock(&card->lock);
+
+	return muted;
+}
+
+static void
+worker_card_toggle_mute(BackendCard *base)
+{
+	WorkerCard *card = WORKER_CARD(base);
+
+	g_mutex_lock(&card->lock);
+	if (card->state.has_mute) {
+		card->state.muted = !card->state.muted;
+		card->mute = card->state.muted;
+		card->requests |= WORKER_REQUEST_MUTE;
+		worker_card_schedule(card);
+	}
+	g_mutex_unlock(&card->lock);
+}
+
+static gdouble
+worker_card_get_volume(BackendCard *base)
+{
+	WorkerCard *card = WORKER_CARD(base);
+	gdouble volume;
+
+	g_mutex_lock(&card->lock);
+	volume = card->state.volume;
+	g_mutex_unlock(&card->lock);
+
+	return volume;
+}
+
+static void
+worker_card_set_volume(BackendCard *base, gdouble value, int dir)
+{
+	WorkerCard *card = WORKER_CARD(base);
+
+	g_mutex_lock(&card->lock);
+	card->state.volume = value;
+	card->volume = value;
+	card->step = -1;
+	card->stepped = FALSE;
+	card->dir = dir;
+	card->requests &= ~WORKER_REQUEST_VOLUMES;
+	card->requests |= WORKER_REQUEST_VOLUME;
+	worker_card_schedule(card);
+	g_mutex_unlock(&card->lock);
+}
+
+static void
+worker_card_get_steps(BackendCard *base, guint *step, guint *n_steps)
+{
+	WorkerCard *card = WORKER_CARD(base);
+
+	g_mutex_lock(&card->lock);
+	*step = card->state.step;
+	*n_steps = card->state.n_steps;
+	g_mutex_unlock(&card->lock);
+}
+
+static void
+worker_card_get_volumes(BackendCard *base, BackendVolumes *volumes)
+{
+	WorkerCard *card = WORKER_CARD(base);
+
+	g_mutex_lock(&card->lock);
+	*volumes = card->state.volumes;
+	g_mutex_unlock(&card->lock);
+}
+
+static void
+worker_card_set_volumes(BackendCard *base, const BackendVolumes *volumes, int dir)
+{
+	WorkerCard *card = WORKER_CARD(base);
+
+	g_mutex_lock(&card->lock);
+	card->state.volumes = *volumes;
+	card->volumes = *volumes;
+	card->dir = dir;
+	card->requests &= ~WORKER_REQUEST_VOLUME;
+	card->requests |= WORKER_REQUEST_VOLUMES;
+	worker_card_schedule(card);
+	g_mutex_unlock(&card->lock);
+}
+
+static gboolean
+worker_card_apply(BackendCard *base, const BackendTransaction *trans)
+{
+	WorkerCard *card = WORKER_CARD(base);
+	WorkerState *state = &card->state;
+	BackendOutcome outcome;
+	gboolean changed = FALSE, moves;
+
+	/* The outcome is computed against the snapshot, the worker
+	 * gets the merged result.
+	 */
+	g_mutex_lock(&card->lock);
+	backend_transaction_resolve(trans, state->volume, state->muted,
+	                            state->n_steps, &outcome);
+
+	/* A step moves the volume, unless it's at the end of the range */
+	if (outcome.step >= 0)
+		moves = (guint) outcome.step != state->step;
+	else if (outcome.stepped)
+		moves = outcome.dir > 0 ? state->step < state->n_steps : state->step > 0;
+	else
+		moves = outcome.volume != state->volume;
+
+	if (outcome.set_volumes) {
+		/* The balance is deduced from the volumes by the inner card */
+		outcome.volumes.balance = state->volumes.balance;
+		if (worker_volumes_equal(&outcome.volumes, &state->volumes))
+			outcome.set_volumes = outcome.set_volume = FALSE;
+	}
+
+	if (outcome.set_volumes) {
+		state->volumes = outcome.volumes;
+		state->volume = outcome.volume;
+		card->volumes = outcome.volumes;
+		card->dir = outcome.dir;
+		card->requests &= ~WORKER_REQUEST_VOLUME;
+		card->requests |= WORKER_REQUEST_VOLUMES;
+		changed = TRUE;
+	} else if (outcome.set_volume && moves) {
+		state->volume = outcome.volume;
+		if (outcome.step >= 0)
+			state->step = outcome.step;
+		card->volume = outcome.volume;
+		card->step = outcome.step;
+		card->stepped = outcome.stepped;
+		card->dir = outcome.dir;
+		card->requests &= ~WORKER_REQUEST_VOLUMES;
+		card->requests |= WORKER_REQUEST_VOLUME;
+		changed = TRUE;
+	}
+
+	if (outcome.set_mute && state->has_mute &&
+	    outcome.muted != state->muted) {
+		state->muted = outcome.muted;
+		card->mute = outcome.muted;
+		card->requests |= WORKER_REQUEST_MUTE;
+		changed = TRUE;
+	}
+
+	if (changed)
+		worker_card_schedule(card);
+	g_mutex_unlock(&card->lock);
+
+	return changed;
+}
+
+static gboolean
+worker_card_link_channel_cb(gpointer data)
+{
+	WorkerCall *call = data;
+
+	call->success = backend_card_link_channel(call->card->inner, call->channel,
+	                                          call->weight);
+
+	return worker_call_done(call);
+}
+
+static gboolean
+worker_card_link_channel(BackendCard *base, const char *channel, gdouble weight)
+{
+	WorkerCall call = {
+		.card = WORKER_CARD(base),
+		.channel = channel,
+		.weight = weight
+	};
+
+	worker_call(worker_card_link_channel_cb, &call);
+
+	return call.success;
+}
+
+static void
+worker_card_install_callback(BackendCard *base, BackendCb callback, gpointer data)
+{
+	WorkerCard *card = WORKER_CARD(base);
+
+	card->cb_func = callback;
+	card->cb_data = data;
+}
+
+static gboolean
+worker_card_free_cb(gpointer data)
+{
+	WorkerCall *call = data;
+
+	backend_card_free(call->card->inner);
+	call->card->inner = NULL;
+
+	return worker_call_done(call);
+}
+
+static void
+worker_card_free(BackendCard *base)
+{
+	WorkerCall call = { .card = WORKER_CARD(base) };
+
+	if (call.card == NULL)
+		return;
+
+	/* Pending events are dropped from now on */
+	call.card->freed = TRUE;
+
+	worker_call(worker_card_free_cb, &call);
+	worker_card_unref(call.card);
+	worker.n_cards--;
+}
+
+static gboolean
+worker_card_new_cb(gpointer data)
+{
+	WorkerCall *call = data;
+	WorkerCard *card = call->card;
+
+	card->inner = backend_card_new(worker.inner, call->card_name, call->channel,
+	                               call->stream, call->normalize);
+	if (card->inner) {
+		worker_card_read(card, &card->state);
+		card->name = g_strdup(backend_card_get_name(card->inner));
+		card->channel = g_strdup(backend_card_get_channel(card->inner));
+		backend_card_install_callback(card->inner, worker_card_on_event, card);
+	}
+
+	return worker_call_done(call);
+}
+
+static const Backend worker_backend;
+
+static BackendCard *
+worker_card_new(const char *card_name, const char *channel, BackendStream stream,
+                gboolean normalize)
+{
+	WorkerCall call = {
+		.card_name = card_name,
+		.channel = channel,
+		.stream = stream,
+		.normalize = normalize
+	};
+	WorkerCard *card;
+
+	card = g_new0(WorkerCard, 1);
+	card->parent.backend = &worker_backend;
+	card->refcount = 1;
+	g_mutex_init(&card->lock);
+
+	call.card = card;
+	worker_call(worker_card_new_cb, &call);
+
+	if (card->inner == NULL) {
+		worker_card_unref(card);
+		return NULL;
+	}
+
+	worker.n_cards++;
+
+	return &card->parent;
+}
+
+/*
+ * Listing and hotplug.
+ */
+
+static gboolean
+worker_list_cards_cb(gpointer data)
+{
+	WorkerCall *call = data;
+
+	call->list = backend_list_cards(worker.inner);
+
+	return worker_call_done(call);
+}
+
+static GSList *
+worker_list_cards(void)
+{
+	WorkerCall call = { 0 };
+
+	worker_call(worker_list_cards_cb, &call);
+
+	return call.list;
+}
+
+static gboolean
+worker_list_channels_cb(gpointer data)
+{
+	WorkerCall *call = data;
+
+	call->list = backend_list_channels(worker.inner, call->card_name, call->stream);
+
+	return worker_call_done(call);
+}
+
+static GSList *
+worker_list_channels(const char *card_name, BackendStream stream)
+{
+	WorkerCall call = {
+		.card_name = card_name,
+		.stream = stream
+	};
+
+	worker_call(worker_list_channels_cb, &call);
+
+	return call.list;
+}
+
+/* Deliver a hotplug event in the ui thread */
+static gboolean
+worker_cards_dispatch(G_GNUC_UNUSED gpointer data)
+{
+	if (worker.cards_cb_func)
+		worker.cards_cb_func(worker.cards_cb_data);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Cards callback of the inner backend, invoked in the worker thread */
+static void
+worker_on_cards_changed(G_GNUC_UNUSED gpointer data)
+{
+	g_idle_add(worker_cards_dispatch, NULL);
+}
+
+static gboolean
+worker_set_cards_callback_cb(gpointer data)
+{
+	WorkerCall *call = data;
+
+	backend_set_cards_callback(worker.inner, call->cards_cb, NULL);
+
+	return worker_call_done(call);
+}
+
+static void
+worker_set_cards_callback(BackendCardsCb callback, gpointer data)
+{
+	WorkerCall call = { .cards_cb = callback ? worker_on_cards_changed : NULL };
+
+	worker.cards_cb_func = callback;
+	worker.cards_cb_data = data;
+
+	worker_call(worker_set_cards_callback_cb, &call);
+}
+
+static const Backend worker_backend = {
+	.name = "worker",
+	.list_cards = worker_list_cards,
+	.list_channels = worker_list_channels,
+	.set_cards_callback = worker_set_cards_callback,
+	.cleanup = worker_shutdown,
+	.card_new = worker_card_new,
+	.card_free = worker_card_free,
+	.card_link_channel = worker_card_link_channel,
+	.card_install_callback = worker_card_install_callback,
+	.card_get_name = worker_card_get_name,
+	.card_get_channel = worker_card_get_channel,
+	.card_has_mute = worker_card_has_mute,
+	.card_is_muted = worker_card_is_muted,
+	.card_toggle_mute = worker_card_toggle_mute,
+	.card_get_volume = worker_card_get_volume,
+	.card_set_volume = worker_card_set_volume,
+	.card_get_volumes = worker_card_get_volumes,
+	.card_set_volumes = worker_card_set_volumes,
+	.card_get_steps = worker_card_get_steps,
+	.card_apply = worker_card_apply
+};
+
+/**
+ * Get a backend that runs another backend in the worker thread.
+ * There's only one worker, and it runs one backend at a time. If another
+ * backend is asked, the worker is shut down and starts over with the new
+ * one, unless some cards of the current backend are still in use: they
+ * must be freed first, and NULL is returned meanwhile.
+ *
+ * @param inner the backend doing the real work.
+ * @return the worker backend, or NULL if it's busy with another backend.
+ */
+const Backend *
+worker_get_backend(const Backend *inner)
+{
+	if (worker.inner && worker.inner != inner) {
+		if (worker.n_cards > 0) {
+			ERROR("Audio worker busy with %u card(s) of backend '%s', "
+			      "can't switch to backend '%s'", worker.n_cards,
+			      worker.inner->name, inner->name);
+			return NULL;
+		}
+
+		DEBUG("Audio worker switching from backend '%s' to '%s'",
+		      worker.inner->name, inner->name);
+		worker_shutdown();
+	}
+
+	worker.inner = inner;
+
+	return &worker_backend;
+}
+
+/**
+ * Get the backend run by the worker.
+ *
+ * @return the inner backend, or NULL if the worker doesn't run any.
+ */
+const Backend *
+worker_get_inner(void)
+{
+	return worker.inner;
+}
+
+struct worker_run {
+	WorkerCall call;
+	WorkerFunc func;
+	gpointer data;
+};
+
+static gboolean
+worker_run_cb(gpointer data)
+{
+	struct worker_run *run = data;
+
+	run->func(run->data);
+
+	return worker_call_done(&run->call);
+}
+
+/**
+ * Run a function in the worker thread, and wait for it to be done.
+ * That's the thread to use to talk to the inner backend directly, since
+ * the worker owns it. If the worker is not started, the function runs
+ * right away in the calling thread.
+ *
+ * @param func the function to run.
+ * @param data the user data passed to the function.
+ */
+void
+worker_run(WorkerFunc func, gpointer data)
+{
+	struct worker_run run = { .func = func, .data = data };
+
+	if (worker.thread == NULL) {
+		func(data);
+		return;
+	}
+
+	worker_call(worker_run_cb, &run.call);
+}
+
+static gboolean
+worker_sync_cb(gpointer data)
+{
+	return worker_call_done(data);
+}
+
+/**
+ * Wait for the worker to be done with everything it was asked so far,
+ * and with the idle work of the inner backend, like delivering events.
+ * The events it sent back meanwhile are still to be dispatched, in the
+ * main context of the ui thread.
+ */
+void
+worker_sync(void)
+{
+	WorkerCall call = { 0 };
+
+	if (worker.thread == NULL)
+		return;
+
+	worker_call_full(worker_sync_cb, &call, G_PRIORITY_LOW);
+}
+
+/**
+ * Stop the worker thread and wait for it, once every card is freed.
+ * Requests still pending are applied first, then the inner backend is
+ * cleaned up in the worker thread. The worker can be used again
+ * afterwards, with any backend. That's the cleanup function of the
+ * worker backend.
+ */
+void
+worker_shutdown(void)
+{
+	WorkerCall call = { 0 };
+
+	if (worker.thread == NULL) {
+		worker.inner = NULL;
+		return;
+	}
+
+	worker_call(worker_quit_cb, &call);
+	g_thread_join(worker.thread);
+	g_main_loop_unref(worker.loop);
+	g_main_context_unref(worker.context);
+
+	worker.thread = NULL;
+	worker.loop = NULL;
+	worker.context = NULL;
+	worker.inner = NULL;
+	worker.cards_cb_func = NULL;
+	worker.cards_cb_data = NULL;
+
+	DEBUG("Audio worker stopped");
+}
@@ -0,0 +1,32 @@
+/* worker.h
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file worker.h
+ * Header for worker.c.
+ * @brief Header for worker.c.
+ */
+
+#ifndef _WORKER_H_
+#define _WORKER_H_
+
+#include <glib.h>
+
+#include "backend.h"
+
+typedef void (*WorkerFunc) (gpointer data);
+
+const Backend *worker_get_backend(const Backend *inner);
+const Backend *worker_get_inner(void);
+void worker_run(WorkerFunc func, gpointer data);
+void worker_sync(void);
+void worker_shutdown(void);
+
+#endif				// _WORKER_H_
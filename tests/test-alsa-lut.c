@@ -0,0 +1,318 @@
+/* test-alsa-lut.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file test-alsa-lut.c
+ * Tests for the lookup tables of the Alsa backend, that map raw volume
+ * steps to normalized volumes. They must give the same results as the
+ * dB math they replace. The mixer elem is simulated by a set of fake
+ * ElemOps, so no sound card is needed.
+ * @brief Tests for the Alsa lookup tables.
+ */
+
+/* The functions under test are static */
+#include "alsa.c"
+
+#define TEST_HCTL "test"
+
+/* The simulated mixer elem, its dB value is linear in its raw value */
+static struct {
+	long min;
+	long max;
+	long dB_min;
+	long dB_max;
+} fake;
+
+static int
+fake_get_volume_range(G_GNUC_UNUSED snd_mixer_elem_t *elem, long *min, long *max)
+{
+	*min = fake.min;
+	*max = fake.max;
+
+	return 0;
+}
+
+static int
+fake_get_dB_range(G_GNUC_UNUSED snd_mixer_elem_t *elem, long *min, long *max)
+{
+	*min = fake.dB_min;
+	*max = fake.dB_max;
+
+	return 0;
+}
+
+static int
+fake_ask_vol_dB(G_GNUC_UNUSED snd_mixer_elem_t *elem, long value, long *dB)
+{
+	*dB = fake.dB_min + (value - fake.min) * (fake.dB_max - fake.dB_min) /
+	      (fake.max - fake.min);
+
+	return 0;
+}
+
+/* Rounds like Alsa does: up if dir > 0, down if dir < 0, nearest otherwise */
+static int
+fake_ask_dB_vol(G_GNUC_UNUSED snd_mixer_elem_t *elem, long dB, int dir, long *value)
+{
+	long num, den, steps, rem;
+
+	dB = CLAMP(dB, fake.dB_min, fake.dB_max);
+	num = (dB - fake.dB_min) * (fake.max - fake.min);
+	den = fake.dB_max - fake.dB_min;
+	steps = num / den;
+	rem = num % den;
+
+	if (rem && (dir > 0 || (dir == 0 && 2 * rem >= den)))
+		steps++;
+
+	*value = fake.min + steps;
+
+	return 0;
+}
+
+static const ElemOps fake_ops = {
+	.name = "fake",
+	.get_volume_range = fake_get_volume_range,
+	.get_dB_range = fake_get_dB_range,
+	.ask_vol_dB = fake_ask_vol_dB,
+	.ask_dB_vol = fake_ask_dB_vol,
+};
+
+/* Set up the simulated mixer elem, and get its range */
+static void
+fake_fill(ElemRange *range, long min, long max, long dB_min, long dB_max)
+{
+	fake.min = min;
+	fake.max = max;
+	fake.dB_min = dB_min;
+	fake.dB_max = dB_max;
+
+	memset(range, 0, sizeof *range);
+	elem_range_fill(TEST_HCTL, &fake_ops, NULL, range);
+}
+
+/* Same range, without the lookup table: that's the dB math */
+static void
+range_without_lut(const ElemRange *range, ElemRange *copy)
+{
+	*copy = *range;
+	copy->lut = NULL;
+	copy->lut_size = 0;
+}
+
+static long
+to_raw(const ElemRange *range, double volume, int dir)
+{
+	long value = -1;
+
+	g_assert_true(elem_volume_to_raw(TEST_HCTL, &fake_ops, NULL, range, TRUE,
+	                                 volume, dir, &value));
+
+	return value;
+}
+
+static double
+to_volume(const ElemRange *range, long value)
+{
+	double volume = -1;
+
+	g_assert_true(elem_raw_to_volume(TEST_HCTL, &fake_ops, NULL, range, TRUE,
+	                                 value, &volume));
+
+	return volume;
+}
+
+/* Every step goes through the table and back, and the table gives what
+ * the dB math gives.
+ */
+static void
+check_round_trip(long min, long max, long dB_min, long dB_max)
+{
+	ElemRange range, dB_range;
+	long value;
+	int dir;
+
+	fake_fill(&range, min, max, dB_min, dB_max);
+	g_assert_nonnull(range.lut);
+	g_assert_cmpuint(range.lut_size, ==, max - min + 1);
+	range_without_lut(&range, &dB_range);
+
+	for (value = min; value <= max; value++) {
+		double volume = to_volume(&range, value);
+
+		g_assert_cmpfloat(volume, ==, to_volume(&dB_range, value));
+		if (value > min)
+			g_assert_cmpfloat(volume, >, to_volume(&range, value - 1));
+
+		for (dir = -1; dir <= 1; dir++)
+			g_assert_cmpint(to_raw(&range, volume, dir), ==, value);
+	}
+
+	/* Between two steps, the direction picks the step */
+	for (value = min; value < max; value++) {
+		double lo = to_volume(&range, value);
+		double hi = to_volume(&range, value + 1);
+
+		g_assert_cmpint(to_raw(&range, (lo + hi) / 2, -1), ==, value);
+		g_assert_cmpint(to_raw(&range, (lo + hi) / 2, +1), ==, value + 1);
+		g_assert_cmpint(to_raw(&range, lo + (hi - lo) / 4, 0), ==, value);
+		g_assert_cmpint(to_raw(&range, hi - (hi - lo) / 4, 0), ==, value + 1);
+	}
+
+	/* At the edges, the table and the dB math agree */
+	for (dir = -1; dir <= 1; dir++) {
+		g_assert_cmpint(to_raw(&range, 0, dir), ==, min);
+		g_assert_cmpint(to_raw(&dB_range, 0, dir), ==, min);
+		g_assert_cmpint(to_raw(&range, 1, dir), ==, max);
+		g_assert_cmpint(to_raw(&dB_range, 1, dir), ==, max);
+		g_assert_cmpint(to_raw(&range, -0.5, dir), ==, min);
+		g_assert_cmpint(to_raw(&range, 1.5, dir), ==, max);
+	}
+
+	g_assert_cmpfloat(to_volume(&range, min), ==, 0);
+	g_assert_cmpfloat(to_volume(&range, max), ==, 1);
+
+	elem_range_clear(&range);
+}
+
+static void
+test_lut_logarithmic(void)
+{
+	/* 64 steps of 1 dB, like most onboard cards */
+	check_round_trip(0, 63, -6300, 0);
+}
+
+static void
+test_lut_linear(void)
+{
+	/* A short dB range is mapped linearly */
+	check_round_trip(0, 31, -1550, 0);
+}
+
+static void
+test_lut_offset(void)
+{
+	/* Raw ranges don't always start at 0 */
+	check_round_trip(-40, 23, -3150, 0);
+}
+
+static void
+test_lut_max_steps(void)
+{
+	ElemRange range;
+	int dir;
+
+	/* A table for the largest range allowed... */
+	check_round_trip(0, ELEM_LUT_MAX_STEPS - 1, -(ELEM_LUT_MAX_STEPS - 1) * 25, 0);
+
+	/* ...but not above, where the dB math is used */
+	fake_fill(&range, 0, ELEM_LUT_MAX_STEPS, -ELEM_LUT_MAX_STEPS * 25, 0);
+	g_assert_true(range.vol_ok && range.dB_ok);
+	g_assert_null(range.lut);
+	g_assert_cmpuint(range.lut_size, ==, 0);
+
+	for (dir = -1; dir <= 1; dir++) {
+		g_assert_cmpint(to_raw(&range, 0, dir), ==, 0);
+		g_assert_cmpint(to_raw(&range, 1, dir), ==, ELEM_LUT_MAX_STEPS);
+	}
+
+	elem_range_clear(&range);
+}
+
+static void
+test_lut_no_dB(void)
+{
+	ElemRange range;
+
+	/* Without a dB range, there's nothing to put in a table */
+	fake_fill(&range, 0, 63, 0, 0);
+	g_assert_true(range.vol_ok);
+	g_assert_false(range.dB_ok);
+	g_assert_null(range.lut);
+
+	g_assert_cmpint(to_raw(&range, 0.5, 0), ==, 32);
+	g_assert_cmpfloat(to_volume(&range, 63), ==, 1);
+
+	elem_range_clear(&range);
+}
+
+/* Time the conversions both ways, return the time of one, in ns */
+static double
+time_conversions(const ElemRange *range, guint n_rounds)
+{
+	volatile double volume_sink = 0;
+	volatile long value_sink = 0;
+	guint i;
+	long value;
+	int dir;
+
+	g_test_timer_start();
+	for (i = 0; i < n_rounds; i++) {
+		for (value = range->min; value <= range->max; value++) {
+			double volume;
+
+			elem_raw_to_volume(TEST_HCTL, &fake_ops, NULL, range, TRUE,
+			                   value, &volume);
+			volume_sink += volume;
+
+			for (dir = -1; dir <= 1; dir++) {
+				long raw;
+
+				elem_volume_to_raw(TEST_HCTL, &fake_ops, NULL, range, TRUE,
+				                   volume, dir, &raw);
+				value_sink += raw;
+			}
+		}
+	}
+
+	(void) volume_sink;
+	(void) value_sink;
+
+	return g_test_timer_elapsed() * 1e9 /
+	       (n_rounds * (range->max - range->min + 1) * 4);
+}
+
+/* The table against the dB math. The fake ElemOps are plain integer math,
+ * while Alsa parses the dB info of the elem for each conversion, so the
+ * dB math is even slower on a real card.
+ */
+static void
+test_lut_bench(void)
+{
+	ElemRange range, dB_range;
+	double lut_time, dB_time;
+
+	/* 64 steps of 1 dB, like most onboard cards */
+	fake_fill(&range, 0, 63, -6300, 0);
+	range_without_lut(&range, &dB_range);
+
+	lut_time = time_conversions(&range, 2000);
+	dB_time = time_conversions(&dB_range, 2000);
+
+	g_test_message("Conversion: %.1f ns with the lookup table, %.1f ns with the dB math",
+	               lut_time, dB_time);
+
+	elem_range_clear(&range);
+}
+
+int
+main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/alsa/lut/logarithmic", test_lut_logarithmic);
+	g_test_add_func("/alsa/lut/linear", test_lut_linear);
+	g_test_add_func("/alsa/lut/offset", test_lut_offset);
+	g_test_add_func("/alsa/lut/max-steps", test_lut_max_steps);
+	g_test_add_func("/alsa/lut/no-dB", test_lut_no_dB);
+	g_test_add_func("/alsa/lut/bench", test_lut_bench);
+
+	return g_test_run();
+}
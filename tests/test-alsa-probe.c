@@ -0,0 +1,161 @@
+/* test-alsa-probe.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file test-alsa-probe.c
+ * Benchmark of the card probe of the Alsa backend: walking the control
+ * elements, against loading the whole simple mixer like it used to be
+ * done. It also times the listing of cards, once the registry is built.
+ * It needs real sound cards, and is skipped if none can be opened.
+ * @brief Benchmark of the Alsa card probe.
+ */
+
+/* The functions under test are static */
+#include "alsa.c"
+
+#define TEST_N_ROUNDS 20
+
+/* The former probe, that loads the simple mixer.
+ * Return 1 if the card is playable, 0 if it's not, -1 if it can't be opened.
+ */
+static int
+test_probe_mixer(const char *hctl)
+{
+	snd_mixer_t *mixer;
+	int playable;
+
+	mixer = mixer_open(hctl);
+	if (mixer == NULL)
+		return -1;
+
+	playable = mixer_is_playable(hctl, mixer);
+	mixer_close(hctl, mixer);
+
+	return playable;
+}
+
+/* Both probes agree, and the control interface is quicker */
+static void
+test_probe_cards(void)
+{
+	AlsaCardIter *iter;
+	gdouble ctl_time = 0, mixer_time = 0;
+	guint n_cards = 0;
+	guint i;
+
+	iter = alsa_card_iter_new();
+	while (alsa_card_iter_loop(iter)) {
+		int by_ctl, by_mixer;
+
+		by_mixer = test_probe_mixer(iter->hctl);
+		if (by_mixer < 0)
+			continue;
+
+		by_ctl = ctl_probe_playable(iter->hctl);
+		if (by_ctl >= 0)
+			g_assert_cmpint(by_ctl, ==, by_mixer);
+
+		g_test_timer_start();
+		for (i = 0; i < TEST_N_ROUNDS; i++)
+			test_probe_mixer(iter->hctl);
+		mixer_time += g_test_timer_elapsed();
+
+		g_test_timer_start();
+		for (i = 0; i < TEST_N_ROUNDS; i++)
+			ctl_probe_playable(iter->hctl);
+		ctl_time += g_test_timer_elapsed();
+
+		n_cards++;
+	}
+	alsa_card_iter_free(iter);
+
+	if (n_cards == 0) {
+		g_test_skip("No sound card to probe");
+		return;
+	}
+
+	g_test_message("Probing %u cards: %.3f ms with the simple mixer, "
+	               "%.3f ms with the control interface", n_cards,
+	               mixer_time * 1000 / TEST_N_ROUNDS,
+	               ctl_time * 1000 / TEST_N_ROUNDS);
+}
+
+/* Probe every card like it used to be done, return the number of
+ * playable cards.
+ */
+static guint
+test_probe_all_cards(void)
+{
+	AlsaCardIter *iter;
+	guint n_cards = 0;
+
+	iter = alsa_card_iter_new();
+	while (alsa_card_iter_loop(iter)) {
+		if (test_probe_mixer(iter->hctl) > 0)
+			n_cards++;
+	}
+	alsa_card_iter_free(iter);
+
+	return n_cards;
+}
+
+/* Listing the cards, against probing them all each time */
+static void
+test_probe_list_cards(void)
+{
+	GSList *list;
+	gdouble probe_time, first_time, list_time;
+	guint n_cards;
+	guint i;
+
+	n_cards = test_probe_all_cards();
+	if (n_cards == 0) {
+		g_test_skip("No playable sound card");
+		return;
+	}
+
+	g_test_timer_start();
+	for (i = 0; i < TEST_N_ROUNDS; i++)
+		test_probe_all_cards();
+	probe_time = g_test_timer_elapsed();
+
+	/* The first listing builds the registry */
+	alsa_cleanup();
+	g_test_timer_start();
+	list = alsa_list_cards();
+	first_time = g_test_timer_elapsed();
+	g_assert_cmpuint(g_slist_length(list), ==, n_cards);
+	g_slist_free_full(list, g_free);
+
+	g_test_timer_start();
+	for (i = 0; i < TEST_N_ROUNDS; i++) {
+		list = alsa_list_cards();
+		g_slist_free_full(list, g_free);
+	}
+	list_time = g_test_timer_elapsed();
+
+	alsa_cleanup();
+
+	g_test_message("Listing %u cards: %.3f ms probing with the simple mixer, "
+	               "%.3f ms to build the registry, %.3f ms afterwards", n_cards,
+	               probe_time * 1000 / TEST_N_ROUNDS, first_time * 1000,
+	               list_time * 1000 / TEST_N_ROUNDS);
+}
+
+int
+main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/alsa/probe/cards", test_probe_cards);
+	g_test_add_func("/alsa/probe/list-cards", test_probe_list_cards);
+
+	return g_test_run();
+}
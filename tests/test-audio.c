@@ -0,0 +1,865 @@
+/* test-audio.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file test-audio.c
+ * Tests for the audio subsystem, on top of the mock backend, with or
+ * without the audio worker. They check what the signal handlers get,
+ * and what reaches the simulated hardware.
+ * @brief Tests for the audio subsystem.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <glib.h>
+
+#include "audio.h"
+#include "backend.h"
+#include "mock.h"
+#include "worker.h"
+#include "test-prefs.h"
+
+/* Writes take some time, like on real hardware */
+#define TEST_MOCK "latency=1000"
+
+#define TEST_PREFS "[PNMixer]\nAudioBackend=mock\n"
+#define TEST_PREFS_NO_WORKER TEST_PREFS "AudioWorker=false\n"
+
+/* Tick of the ramp scheduler, see audio.c */
+#define TEST_RAMP_TICK 16 /* ms */
+#define TEST_RAMP_DURATION 400 /* ms */
+
+/* What the signal handler got */
+struct test_events {
+	guint n_events;
+	guint n_disconnected;
+	guint n_values_changed;
+	guint n_capture_changed;
+	AudioUser user;
+	gdouble volume;
+	gboolean hidden; /* Read by the visibility predicate */
+};
+
+typedef struct test_events TestEvents;
+
+static void
+on_audio_changed(G_GNUC_UNUSED Audio *audio, const AudioEvent *event, gpointer data)
+{
+	TestEvents *events = data;
+
+	events->n_events++;
+
+	if (event->signal == AUDIO_CARD_DISCONNECTED)
+		events->n_disconnected++;
+
+	if (event->signal == AUDIO_CAPTURE_VALUES_CHANGED)
+		events->n_capture_changed++;
+
+	if (event->signal != AUDIO_VALUES_CHANGED)
+		return;
+
+	events->n_values_changed++;
+	events->user = event->user;
+	events->volume = event->state->volume;
+}
+
+/* Wait for the worker to be done with everything it was asked, and
+ * dispatch what it sent back to the ui thread.
+ */
+static void
+test_sync(void)
+{
+	worker_sync();
+
+	while (g_main_context_iteration(NULL, FALSE))
+		;
+}
+
+static gboolean
+test_quit_cb(gpointer data)
+{
+	g_main_loop_quit(data);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Run the main loop for a while */
+static void
+test_wait(guint ms)
+{
+	GMainLoop *loop;
+
+	loop = g_main_loop_new(NULL, FALSE);
+	g_timeout_add(ms, test_quit_cb, loop);
+	g_main_loop_run(loop);
+	g_main_loop_unref(loop);
+}
+
+/* Create an audio instance, hooked to the mock */
+static Audio *
+test_audio_new(const gchar *prefs, TestEvents *events)
+{
+	Audio *audio;
+
+	test_prefs_load(prefs);
+
+	audio = audio_new();
+	audio_signals_connect(audio, on_audio_changed, events);
+	audio_reload(audio);
+	test_sync();
+	g_assert_nonnull(audio_get_card_instances(audio));
+
+	memset(events, 0, sizeof *events);
+
+	return audio;
+}
+
+/*
+ * Dispatch: every change reaches the handlers exactly once.
+ */
+
+/* The mock belongs to the worker thread, if there's one */
+static void
+test_echo(G_GNUC_UNUSED gpointer data)
+{
+	mock_echo("Mock Card 0", "Master");
+}
+
+static void
+check_own_writes(const gchar *prefs)
+{
+	TestEvents events;
+	Audio *audio;
+	guint n_writes, n_echoes, n_duplicates;
+	gint i;
+
+	audio = test_audio_new(prefs, &events);
+	n_writes = mock_get_n_writes();
+
+	/* A write is dispatched right away, and its echo is dropped. What
+	 * the card took is rounded to its steps, it's still an echo.
+	 */
+	audio_set_volume(audio, AUDIO_USER_POPUP, 30, 0);
+	g_assert_cmpuint(events.n_values_changed, ==, 1);
+	g_assert_cmpint(events.user, ==, AUDIO_USER_POPUP);
+	test_sync();
+	g_assert_cmpuint(mock_get_n_writes(), >, n_writes);
+
+	worker_run(test_echo, NULL);
+	test_sync();
+	g_assert_cmpuint(events.n_values_changed, ==, 1);
+	audio_get_dispatch_counters(audio, &n_echoes, &n_duplicates);
+	g_assert_cmpuint(n_echoes, ==, 1);
+	g_assert_cmpuint(n_duplicates, ==, 0);
+
+	/* Same for a burst of writes, whatever the worker merged */
+	for (i = 1; i <= 5; i++)
+		audio_set_volume(audio, AUDIO_USER_POPUP, 30 + i * 10, 0);
+	g_assert_cmpuint(events.n_values_changed, ==, 6);
+	test_sync();
+	g_assert_cmpuint(mock_get_n_writes(), <=, n_writes + 6);
+
+	worker_run(test_echo, NULL);
+	test_sync();
+	g_assert_cmpuint(events.n_values_changed, ==, 6);
+	audio_get_dispatch_counters(audio, &n_echoes, &n_duplicates);
+	g_assert_cmpuint(n_echoes, ==, 2);
+	g_assert_cmpuint(n_duplicates, ==, 0);
+
+	/* Once the write is matched, an event without any change gets
+	 * through, as a duplicate.
+	 */
+	worker_run(test_echo, NULL);
+	test_sync();
+	g_assert_cmpuint(events.n_values_changed, ==, 7);
+	g_assert_cmpint(events.user, ==, AUDIO_USER_UNKNOWN);
+	audio_get_dispatch_counters(audio, &n_echoes, &n_duplicates);
+	g_assert_cmpuint(n_echoes, ==, 2);
+	g_assert_cmpuint(n_duplicates, ==, 1);
+
+	audio_free(audio);
+}
+
+static void
+test_dispatch_own_writes(void)
+{
+	check_own_writes(TEST_PREFS);
+}
+
+static void
+test_dispatch_own_writes_no_worker(void)
+{
+	check_own_writes(TEST_PREFS_NO_WORKER);
+}
+
+static void
+test_external_change(G_GNUC_UNUSED gpointer data)
+{
+	mock_external_change("Mock Card 0", "Master", 70, FALSE);
+}
+
+static void
+check_external(const gchar *prefs)
+{
+	TestEvents events;
+	Audio *audio;
+	guint n_echoes, n_duplicates;
+
+	audio = test_audio_new(prefs, &events);
+	audio_set_volume(audio, AUDIO_USER_POPUP, 30, 0);
+	test_sync();
+	memset(&events, 0, sizeof events);
+
+	worker_run(test_external_change, NULL);
+	test_sync();
+
+	g_assert_cmpuint(events.n_values_changed, ==, 1);
+	g_assert_cmpint(events.user, ==, AUDIO_USER_UNKNOWN);
+	g_assert_cmpfloat(events.volume, !=, 30);
+
+	/* A real change, neither an echo nor a duplicate */
+	audio_get_dispatch_counters(audio, &n_echoes, &n_duplicates);
+	g_assert_cmpuint(n_echoes, ==, 0);
+	g_assert_cmpuint(n_duplicates, ==, 0);
+
+	audio_free(audio);
+}
+
+static void
+test_dispatch_external(void)
+{
+	check_external(TEST_PREFS);
+}
+
+static void
+test_dispatch_external_no_worker(void)
+{
+	check_external(TEST_PREFS_NO_WORKER);
+}
+
+/* External changes are batched, but a disconnection is not */
+static void
+test_dispatch_disconnected(void)
+{
+	TestEvents events;
+	Audio *audio;
+
+	audio = test_audio_new(TEST_PREFS_NO_WORKER "ExternalUpdateInterval=10000\n",
+	                       &events);
+
+	mock_external_change("Mock Card 0", "Master", 70, FALSE);
+	test_sync();
+	g_assert_cmpuint(events.n_values_changed, ==, 0);
+
+	mock_hotplug("Mock Card 0", FALSE);
+	test_sync();
+	g_assert_cmpuint(events.n_disconnected, >, 0);
+	g_assert_cmpuint(events.n_values_changed, ==, 0);
+
+	mock_hotplug("Mock Card 0", TRUE);
+	audio_free(audio);
+}
+
+/* Reload on disconnection, like the main program does */
+static void
+on_audio_disconnected(Audio *audio, const AudioEvent *event, gpointer data)
+{
+	gint *n_listed = data;
+	guint n_list_cards;
+
+	if (event->signal != AUDIO_CARD_DISCONNECTED)
+		return;
+
+	n_list_cards = mock_get_n_list_cards();
+	audio_reload(audio);
+	*n_listed += mock_get_n_list_cards() - n_list_cards;
+}
+
+/* A reload from a card event waits until the event is dispatched */
+static void
+test_dispatch_reload_deferred(void)
+{
+	TestEvents events;
+	Audio *audio;
+	gint n_listed = 0;
+	guint n_list_cards;
+
+	audio = test_audio_new(TEST_PREFS_NO_WORKER, &events);
+	audio_signals_connect(audio, on_audio_disconnected, &n_listed);
+	n_list_cards = mock_get_n_list_cards();
+
+	mock_hotplug("Mock Card 0", FALSE);
+	test_sync();
+	g_assert_cmpuint(events.n_disconnected, >, 0);
+	g_assert_cmpint(n_listed, ==, 0);
+
+	/* The reload comes later, from the main loop */
+	while (mock_get_n_list_cards() == n_list_cards)
+		g_main_context_iteration(NULL, TRUE);
+	g_assert_cmpint(n_listed, ==, 0);
+
+	mock_hotplug("Mock Card 0", TRUE);
+	audio_free(audio);
+}
+
+/* Raise the volume, or the capture volume, from 10 % to 60 %, as fast
+ * as possible, and tell how many steps it took.
+ */
+static guint
+count_raises(const gchar *prefs, gboolean capture)
+{
+	TestEvents events;
+	Audio *audio;
+	guint n_raises = 0;
+
+	audio = test_audio_new(prefs, &events);
+	g_assert_true(audio_has_capture(audio));
+	audio_set_volume(audio, AUDIO_USER_POPUP, 10, 0);
+	audio_set_capture_volume(audio, AUDIO_USER_POPUP, 10, 0);
+	test_sync();
+	memset(&events, 0, sizeof events);
+
+	if (capture) {
+		while (audio_get_capture_volume(audio) < 60 && n_raises < 100) {
+			audio_raise_capture_volume(audio, AUDIO_USER_TRAY_ICON);
+			n_raises++;
+		}
+	} else {
+		while (audio_get_volume(audio) < 60 && n_raises < 100) {
+			audio_raise_volume(audio, AUDIO_USER_TRAY_ICON);
+			n_raises++;
+		}
+	}
+	test_sync();
+
+	/* Each step is a single dispatch, on its own side */
+	if (capture) {
+		g_assert_cmpuint(events.n_capture_changed, ==, n_raises);
+		g_assert_cmpuint(events.n_values_changed, ==, 0);
+	} else {
+		g_assert_cmpuint(events.n_values_changed, ==, n_raises);
+		g_assert_cmpuint(events.n_capture_changed, ==, 0);
+	}
+
+	audio_free(audio);
+
+	return n_raises;
+}
+
+static void
+test_burst_accel(void)
+{
+	guint n_plain, n_accel;
+
+	n_plain = count_raises(TEST_PREFS "ScrollAccelInterval=0\n", FALSE);
+	n_accel = count_raises(TEST_PREFS, FALSE);
+
+	g_test_message("From 10 %% to 60 %%: %u steps, %u with acceleration",
+	               n_plain, n_accel);
+	g_assert_cmpuint(n_plain, <, 100);
+	g_assert_cmpuint(n_accel, <, n_plain);
+}
+
+/* The capture volume steps and accelerates like the playback volume */
+static void
+test_burst_capture_accel(void)
+{
+	guint n_playback, n_plain, n_accel;
+
+	n_playback = count_raises(TEST_PREFS, FALSE);
+	n_plain = count_raises(TEST_PREFS "ScrollAccelInterval=0\n", TRUE);
+	n_accel = count_raises(TEST_PREFS, TRUE);
+
+	g_test_message("Capture from 10 %% to 60 %%: %u steps, %u with acceleration",
+	               n_plain, n_accel);
+	g_assert_cmpuint(n_plain, <, 100);
+	g_assert_cmpuint(n_accel, <, n_plain);
+	g_assert_cmpuint(n_accel, ==, n_playback);
+}
+
+/* A burst on one side doesn't speed up the other side */
+static void
+test_burst_capture_apart(void)
+{
+	TestEvents events;
+	Audio *audio;
+	gdouble volume;
+	gint i;
+
+	/* Steps of 5 %, the sixth step of a burst would be 20 % */
+	audio = test_audio_new(TEST_PREFS_NO_WORKER "ScrollStep=5\n"
+	                       "ScrollAccelFactor=1\nScrollAccelMax=4\n", &events);
+	audio_set_volume(audio, AUDIO_USER_POPUP, 10, 0);
+	audio_set_capture_volume(audio, AUDIO_USER_POPUP, 10, 0);
+
+	for (i = 0; i < 5; i++)
+		audio_raise_volume(audio, AUDIO_USER_TRAY_ICON);
+
+	volume = audio_get_capture_volume(audio);
+	audio_raise_capture_volume(audio, AUDIO_USER_TRAY_ICON);
+	g_assert_cmpfloat(audio_get_capture_volume(audio), >, volume);
+	g_assert_cmpfloat(audio_get_capture_volume(audio), <, volume + 10);
+
+	/* And the other way round */
+	volume = audio_get_volume(audio);
+	audio_raise_volume(audio, AUDIO_USER_TRAY_ICON);
+	g_assert_cmpfloat(audio_get_volume(audio), >, volume);
+	g_assert_cmpfloat(audio_get_volume(audio), <, volume + 10);
+
+	audio_free(audio);
+}
+
+/*
+ * Getters are pure reads, even when we're not on the preferred card.
+ */
+
+static void
+check_no_listing(const gchar *prefs)
+{
+	AudioVolumes volumes;
+	TestEvents events;
+	Audio *audio;
+	guint n_list_cards;
+
+	audio = test_audio_new(prefs, &events);
+	n_list_cards = mock_get_n_list_cards();
+
+	audio_get_card(audio);
+	audio_get_channel(audio);
+	audio_has_mute(audio);
+	audio_is_muted(audio);
+	audio_get_volume(audio);
+	audio_get_balance(audio);
+	audio_get_volumes(audio, &volumes);
+	audio_has_capture(audio);
+	audio_capture_is_muted(audio);
+	audio_get_capture_volume(audio);
+
+	audio_toggle_mute(audio, AUDIO_USER_POPUP);
+	audio_toggle_mute(audio, AUDIO_USER_POPUP);
+	audio_set_volume(audio, AUDIO_USER_POPUP, 50, 0);
+	audio_raise_volume(audio, AUDIO_USER_POPUP);
+	audio_lower_volume(audio, AUDIO_USER_POPUP);
+	test_sync();
+
+	g_assert_cmpuint(mock_get_n_list_cards(), ==, n_list_cards);
+
+	audio_free(audio);
+}
+
+static void
+test_getters_no_listing(void)
+{
+	check_no_listing(TEST_PREFS);
+}
+
+static void
+test_getters_no_listing_fallback(void)
+{
+	/* The preferred card is missing, we're on another one */
+	check_no_listing(TEST_PREFS "AlsaCard=Missing Card\n");
+}
+
+static void
+test_getters_no_listing_fallback_no_worker(void)
+{
+	check_no_listing(TEST_PREFS_NO_WORKER "AlsaCard=Missing Card\n");
+}
+
+/*
+ * Bursts of writes: the worker only applies the latest value.
+ */
+
+static void
+test_burst_merged(void)
+{
+	TestEvents events;
+	Audio *audio;
+	guint n_writes, n_merged;
+	gint i;
+
+	audio = test_audio_new(TEST_PREFS, &events);
+	audio_set_volume(audio, AUDIO_USER_POPUP, 0, 0);
+	test_sync();
+	n_writes = mock_get_n_writes();
+
+	/* A slider drag, from 0 to 100 */
+	for (i = 1; i <= 200; i++)
+		audio_set_volume(audio, AUDIO_USER_POPUP, i / 2.0, 0);
+	test_sync();
+
+	n_merged = mock_get_n_writes() - n_writes;
+	g_test_message("Slider drag: 200 changes, %u writes", n_merged);
+	g_assert_cmpuint(n_merged, >=, 1);
+	g_assert_cmpuint(n_merged, <, 200);
+
+	/* The last value is always applied, down to the hardware */
+	g_assert_cmpfloat(ABS(mock_get_volume("Mock Card 0", "Master", TRUE) - 100),
+	                  <, 0.01);
+	g_assert_cmpfloat(ABS(audio_get_volume(audio) - 100), <, 0.01);
+
+	audio_free(audio);
+}
+
+/*
+ * Ramps: one write per tick at most, for as long as needed.
+ */
+
+/* Ramp the volume from 0 to 100 %, and tell how many writes it took */
+static guint
+check_ramp_writes(const gchar *prefs, guint interval)
+{
+	TestEvents events;
+	Audio *audio;
+	gint64 start, elapsed;
+	guint n_writes, n_total;
+
+	audio = test_audio_new(prefs, &events);
+	audio_set_volume(audio, AUDIO_USER_POPUP, 0, 0);
+	test_sync();
+	n_writes = mock_get_n_writes();
+	start = g_get_monotonic_time();
+
+	audio_ramp_volume(audio, AUDIO_USER_HOTKEYS, 100, TEST_RAMP_DURATION);
+	g_assert_true(audio_is_ramping(audio));
+
+	/* The scheduler stops by itself once the ramp is done */
+	while (audio_is_ramping(audio)) {
+		g_assert_cmpint(g_get_monotonic_time() - start, <, 5 * G_USEC_PER_SEC);
+		g_main_context_iteration(NULL, TRUE);
+	}
+
+	elapsed = (g_get_monotonic_time() - start) / 1000;
+	n_writes = mock_get_n_writes() - n_writes;
+	g_assert_cmpfloat(ABS(audio_get_volume(audio) - 100), <, 0.01);
+
+	/* One write per tick at most, and not more often than the card takes */
+	g_assert_cmpuint(n_writes, >=, 2);
+	g_assert_cmpuint(n_writes, <=, elapsed / MAX(interval, TEST_RAMP_TICK) + 2);
+
+	/* Nothing is written anymore */
+	n_total = mock_get_n_writes();
+	test_wait(5 * TEST_RAMP_TICK);
+	g_assert_cmpuint(mock_get_n_writes(), ==, n_total);
+
+	audio_free(audio);
+
+	return n_writes;
+}
+
+static void
+test_ramp_writes(void)
+{
+	guint n_tick, n_default, n_card;
+
+	n_tick = check_ramp_writes(TEST_PREFS_NO_WORKER "MinWriteInterval=0\n", 0);
+	n_default = check_ramp_writes(TEST_PREFS_NO_WORKER, 30);
+	n_card = check_ramp_writes(TEST_PREFS_NO_WORKER "MinWriteInterval=0\n"
+	                           "[(default)]\nMinWriteInterval=100\n", 100);
+
+	g_test_message("Ramp of %u ms: %u writes, %u with the default interval, "
+	               "%u with 100 ms for the card", TEST_RAMP_DURATION,
+	               n_tick, n_default, n_card);
+	g_assert_cmpuint(n_card, <, n_default);
+	g_assert_cmpuint(n_default, <, n_tick);
+}
+
+/* The ramp is cancelled, and the volume stays where it was put */
+static void
+check_ramp_takeover(Audio *audio)
+{
+	gdouble volume;
+	guint n_writes;
+
+	g_assert_false(audio_is_ramping(audio_get_card_instance(audio, "(default)")));
+	volume = audio_get_volume(audio);
+	n_writes = mock_get_n_writes();
+
+	test_wait(10 * TEST_RAMP_TICK);
+	g_assert_false(audio_is_ramping(audio));
+	g_assert_cmpuint(mock_get_n_writes(), ==, n_writes);
+	g_assert_cmpfloat(audio_get_volume(audio), ==, volume);
+}
+
+static void
+test_ramp_user_takeover(void)
+{
+	TestEvents events;
+	Audio *audio;
+
+	audio = test_audio_new(TEST_PREFS_NO_WORKER, &events);
+	audio_set_volume(audio, AUDIO_USER_POPUP, 0, 0);
+	audio_ramp_volume(audio, AUDIO_USER_HOTKEYS, 100, 10 * TEST_RAMP_DURATION);
+	test_wait(5 * TEST_RAMP_TICK);
+	g_assert_true(audio_is_ramping(audio_get_card_instance(audio, "(default)")));
+
+	audio_set_volume(audio, AUDIO_USER_POPUP, 20, 0);
+	g_assert_cmpfloat(ABS(audio_get_volume(audio) - 20), <, 2);
+	check_ramp_takeover(audio);
+
+	audio_free(audio);
+}
+
+static void
+test_ramp_external_takeover(void)
+{
+	TestEvents events;
+	Audio *audio;
+
+	audio = test_audio_new(TEST_PREFS_NO_WORKER, &events);
+	audio_set_volume(audio, AUDIO_USER_POPUP, 0, 0);
+	audio_ramp_volume(audio, AUDIO_USER_HOTKEYS, 100, 10 * TEST_RAMP_DURATION);
+	test_wait(5 * TEST_RAMP_TICK);
+	g_assert_true(audio_is_ramping(audio_get_card_instance(audio, "(default)")));
+
+	mock_external_change("Mock Card 0", "Master", 90, FALSE);
+	test_sync();
+	check_ramp_takeover(audio);
+
+	audio_free(audio);
+}
+
+/*
+ * Signal handlers: they only get what they asked for.
+ */
+
+static void
+test_signals_masks(void)
+{
+	TestEvents events, masked = { 0 };
+	Audio *audio;
+
+	audio = test_audio_new(TEST_PREFS_NO_WORKER, &events);
+	audio_signals_connect_full(audio, on_audio_changed, &masked,
+	                           AUDIO_SIGNAL_MASK(AUDIO_VALUES_CHANGED),
+	                           AUDIO_USER_MASK(AUDIO_USER_POPUP), NULL);
+
+	/* Right signal, right user */
+	audio_set_volume(audio, AUDIO_USER_POPUP, 30, 0);
+	g_assert_cmpuint(masked.n_events, ==, 1);
+	g_assert_cmpint(masked.user, ==, AUDIO_USER_POPUP);
+
+	/* Right signal, other users */
+	audio_set_volume(audio, AUDIO_USER_TRAY_ICON, 40, 0);
+	mock_external_change("Mock Card 0", "Master", 70, FALSE);
+	test_sync();
+	g_assert_cmpuint(masked.n_events, ==, 1);
+
+	/* Other signals, right user */
+	audio_toggle_capture_mute(audio, AUDIO_USER_POPUP);
+	audio_reload(audio);
+	test_sync();
+	g_assert_cmpuint(masked.n_events, ==, 1);
+
+	/* Meanwhile, the unmasked handler got everything */
+	g_assert_cmpuint(events.n_values_changed, ==, 3);
+	g_assert_cmpuint(events.n_events, >, 4);
+
+	audio_free(audio);
+}
+
+static gboolean
+test_visible(gpointer data)
+{
+	TestEvents *events = data;
+
+	return !events->hidden;
+}
+
+static void
+test_signals_visible(void)
+{
+	TestEvents events, hideable = { 0 };
+	Audio *audio;
+
+	audio = test_audio_new(TEST_PREFS_NO_WORKER, &events);
+	audio_signals_connect_full(audio, on_audio_changed, &hideable,
+	                           AUDIO_ALL_SIGNALS, AUDIO_ALL_USERS, test_visible);
+
+	audio_set_volume(audio, AUDIO_USER_POPUP, 30, 0);
+	g_assert_cmpuint(hideable.n_values_changed, ==, 1);
+
+	/* Hidden, the handler is skipped, the others are not */
+	hideable.hidden = TRUE;
+	audio_set_volume(audio, AUDIO_USER_POPUP, 40, 0);
+	audio_toggle_mute(audio, AUDIO_USER_POPUP);
+	g_assert_cmpuint(hideable.n_events, ==, 1);
+	g_assert_cmpuint(events.n_events, ==, 3);
+
+	/* Back on screen */
+	hideable.hidden = FALSE;
+	audio_set_volume(audio, AUDIO_USER_POPUP, 50, 0);
+	g_assert_cmpuint(hideable.n_values_changed, ==, 2);
+	g_assert_cmpfloat(hideable.volume, ==, events.volume);
+
+	audio_free(audio);
+}
+
+static void
+test_signals_stale_id(void)
+{
+	TestEvents events, first = { 0 }, second = { 0 };
+	Audio *audio;
+	guint id1, id2;
+
+	audio = test_audio_new(TEST_PREFS_NO_WORKER, &events);
+
+	/* The second handler reuses the slot of the first one */
+	id1 = audio_signals_connect(audio, on_audio_changed, &first);
+	audio_signals_disconnect(audio, id1);
+	id2 = audio_signals_connect(audio, on_audio_changed, &second);
+	g_assert_cmpuint(id2, !=, id1);
+
+	/* Disconnecting the first one again, or an id that never existed,
+	 * does nothing.
+	 */
+	audio_signals_disconnect(audio, id1);
+	audio_signals_disconnect(audio, id2 + 1);
+	audio_signals_disconnect(audio, 0);
+
+	audio_set_volume(audio, AUDIO_USER_POPUP, 30, 0);
+	g_assert_cmpuint(first.n_events, ==, 0);
+	g_assert_cmpuint(second.n_events, ==, 1);
+
+	/* The right id does disconnect */
+	audio_signals_disconnect(audio, id2);
+	audio_set_volume(audio, AUDIO_USER_POPUP, 40, 0);
+	g_assert_cmpuint(second.n_events, ==, 1);
+	g_assert_cmpuint(events.n_values_changed, ==, 2);
+
+	audio_free(audio);
+}
+
+/*
+ * Backends: the worker follows the backend in the preferences.
+ */
+
+static void
+test_backend_switch(void)
+{
+	TestEvents events;
+	Audio *audio;
+	guint n_writes;
+
+	audio = test_audio_new(TEST_PREFS, &events);
+
+	/* Not while the cards of the mock are in use */
+	g_assert_null(worker_get_backend(backend_get("alsa")));
+
+	/* The cards of the mock are let go, so that the worker can run alsa */
+	test_prefs_load("[PNMixer]\nAudioBackend=alsa\n");
+	audio_reload(audio);
+	test_sync();
+	g_assert_true(worker_get_inner() == backend_get("alsa"));
+
+	/* And back to the mock */
+	test_prefs_load(TEST_PREFS);
+	audio_reload(audio);
+	test_sync();
+	g_assert_true(worker_get_inner() == backend_get("mock"));
+	g_assert_cmpstr(audio_get_card(audio), ==, "(default)");
+
+	n_writes = mock_get_n_writes();
+	audio_set_volume(audio, AUDIO_USER_POPUP, 42, 0);
+	test_sync();
+	g_assert_cmpuint(mock_get_n_writes(), >, n_writes);
+
+	audio_free(audio);
+	g_assert_null(worker_get_inner());
+}
+
+/*
+ * Linked channels: they follow the main channel, whoever moves them.
+ */
+
+/* Every card instance links the same elem, so they must agree on it */
+#define TEST_PREFS_LINKED TEST_PREFS_NO_WORKER \
+	"[(default)]\nLinkedChannels=Headphone\n" \
+	"[Mock Card 0]\nLinkedChannels=Headphone\n"
+
+static gdouble
+test_linked_gap(void)
+{
+	return ABS(mock_get_volume("Mock Card 0", "Headphone", TRUE) -
+	           mock_get_volume("Mock Card 0", "Master", TRUE));
+}
+
+static void
+test_linked_restored(void)
+{
+	TestEvents events;
+	Audio *audio;
+	guint n_writes;
+
+	audio = test_audio_new(TEST_PREFS_LINKED, &events);
+	audio_set_volume(audio, AUDIO_USER_POPUP, 50, 0);
+	test_sync();
+	g_assert_cmpfloat(test_linked_gap(), <, 2);
+	memset(&events, 0, sizeof events);
+
+	/* Someone else moves the linked elem, it's put back */
+	n_writes = mock_get_n_writes();
+	mock_external_change("Mock Card 0", "Headphone", 10, TRUE);
+	test_sync();
+	g_assert_cmpfloat(test_linked_gap(), <, 2);
+	g_assert_false(audio_is_muted(audio));
+	g_assert_cmpuint(events.n_values_changed, ==, 0);
+	g_assert_cmpuint(mock_get_n_writes(), ==, n_writes + 1);
+
+	/* Nothing moved, no write */
+	mock_echo("Mock Card 0", "Headphone");
+	test_sync();
+	g_assert_cmpuint(mock_get_n_writes(), ==, n_writes + 1);
+
+	/* The instances don't fight over it */
+	test_wait(50);
+	g_assert_cmpuint(mock_get_n_writes(), ==, n_writes + 1);
+
+	audio_free(audio);
+}
+
+int
+main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+	g_setenv("PNMIXER_MOCK", TEST_MOCK, TRUE);
+
+	g_test_add_func("/audio/dispatch/own-writes", test_dispatch_own_writes);
+	g_test_add_func("/audio/dispatch/own-writes-no-worker",
+	                test_dispatch_own_writes_no_worker);
+	g_test_add_func("/audio/dispatch/external", test_dispatch_external);
+	g_test_add_func("/audio/dispatch/external-no-worker",
+	                test_dispatch_external_no_worker);
+	g_test_add_func("/audio/dispatch/disconnected", test_dispatch_disconnected);
+	g_test_add_func("/audio/dispatch/reload-deferred",
+	                test_dispatch_reload_deferred);
+	g_test_add_func("/audio/burst/merged", test_burst_merged);
+	g_test_add_func("/audio/burst/accel", test_burst_accel);
+	g_test_add_func("/audio/burst/capture-accel", test_burst_capture_accel);
+	g_test_add_func("/audio/burst/capture-apart", test_burst_capture_apart);
+	g_test_add_func("/audio/getters/no-listing", test_getters_no_listing);
+	g_test_add_func("/audio/getters/no-listing-fallback",
+	                test_getters_no_listing_fallback);
+	g_test_add_func("/audio/getters/no-listing-fallback-no-worker",
+	                test_getters_no_listing_fallback_no_worker);
+	g_test_add_func("/audio/ramp/writes", test_ramp_writes);
+	g_test_add_func("/audio/ramp/user-takeover", test_ramp_user_takeover);
+	g_test_add_func("/audio/ramp/external-takeover", test_ramp_external_takeover);
+	g_test_add_func("/audio/linked/restored", test_linked_restored);
+	g_test_add_func("/audio/signals/masks", test_signals_masks);
+	g_test_add_func("/audio/signals/visible", test_signals_visible);
+	g_test_add_func("/audio/signals/stale-id", test_signals_stale_id);
+	g_test_add_func("/audio/backend/switch", test_backend_switch);
+
+	return g_test_run();
+}
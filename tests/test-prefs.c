@@ -0,0 +1,155 @@
+/* test-prefs.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file test-prefs.c
+ * The getters of the preferences subsystem, for the test programs.
+ * The real thing pulls Gtk in, and reads the user config file. This one
+ * reads the preferences from a string, that each test sets up.
+ * @brief Preferences for the test programs.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+
+#include "test-prefs.h"
+
+static GKeyFile *keyFile;
+
+/**
+ * Replace the preferences with the content of a string,
+ * in the format of the config file.
+ *
+ * @param data the preferences, NULL to go back to the defaults.
+ */
+void
+test_prefs_load(const gchar *data)
+{
+	if (keyFile)
+		g_key_file_free(keyFile);
+	keyFile = g_key_file_new();
+
+	if (data && !g_key_file_load_from_data(keyFile, data, -1,
+	                                       G_KEY_FILE_NONE, NULL))
+		g_error("Invalid test preferences:\n%s", data);
+}
+
+/* Make sure there's a key file to read from */
+static GKeyFile *
+test_prefs_get(void)
+{
+	if (keyFile == NULL)
+		test_prefs_load(NULL);
+
+	return keyFile;
+}
+
+gboolean
+prefs_get_boolean(const gchar *key, gboolean def)
+{
+	gboolean ret;
+	GError *error = NULL;
+
+	ret = g_key_file_get_boolean(test_prefs_get(), "PNMixer", key, &error);
+	if (error) {
+		g_error_free(error);
+		return def;
+	}
+
+	return ret;
+}
+
+gint
+prefs_get_integer(const gchar *key, gint def)
+{
+	gint ret;
+	GError *error = NULL;
+
+	ret = g_key_file_get_integer(test_prefs_get(), "PNMixer", key, &error);
+	if (error) {
+		g_error_free(error);
+		return def;
+	}
+
+	return ret;
+}
+
+gdouble
+prefs_get_double(const gchar *key, gdouble def)
+{
+	gdouble ret;
+	GError *error = NULL;
+
+	ret = g_key_file_get_double(test_prefs_get(), "PNMixer", key, &error);
+	if (error) {
+		g_error_free(error);
+		return def;
+	}
+
+	return ret;
+}
+
+gchar *
+prefs_get_string(const gchar *key, const gchar *def)
+{
+	gchar *ret;
+
+	ret = g_key_file_get_string(test_prefs_get(), "PNMixer", key, NULL);
+	if (ret == NULL)
+		return g_strdup(def);
+
+	return ret;
+}
+
+gchar *
+prefs_get_channel(const gchar *card)
+{
+	if (!card)
+		return NULL;
+	return g_key_file_get_string(test_prefs_get(), card, "Channel", NULL);
+}
+
+gchar **
+prefs_get_linked_channels(const gchar *card)
+{
+	if (!card)
+		return NULL;
+	return g_key_file_get_string_list(test_prefs_get(), card, "LinkedChannels",
+	                                  NULL, NULL);
+}
+
+gchar *
+prefs_get_capture_channel(const gchar *card)
+{
+	if (!card)
+		return NULL;
+	return g_key_file_get_string(test_prefs_get(), card, "CaptureChannel", NULL);
+}
+
+gint
+prefs_get_card_integer(const gchar *card, const gchar *key, gint def)
+{
+	gint ret;
+	GError *error = NULL;
+
+	if (!card)
+		return prefs_get_integer(key, def);
+
+	ret = g_key_file_get_integer(test_prefs_get(), card, key, &error);
+	if (error) {
+		g_error_free(error);
+		return prefs_get_integer(key, def);
+	}
+
+	return ret;
+}
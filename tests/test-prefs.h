@@ -0,0 +1,26 @@
+/* test-prefs.h
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file test-prefs.h
+ * Header for test-prefs.c.
+ * @brief Header for test-prefs.c.
+ */
+
+#ifndef _TEST_PREFS_H_
+#define _TEST_PREFS_H_
+
+#include <glib.h>
+
+#include "prefs.h"
+
+void test_prefs_load(const gchar *data);
+
+#endif				// _TEST_PREFS_H_
@@ -0,0 +1,161 @@
+/* test-pulse.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file test-pulse.c
+ * Smoke test of the PulseAudio backend, against a real server. It only
+ * touches a null sink made for it, that must be created beforehand:
+ *
+ *     pactl load-module module-null-sink sink_name=pnmixer_null \
+ *             sink_properties=device.description=PNMixer-Null
+ *
+ * The test is skipped if there's no server, or no such sink.
+ * @brief Smoke test of the PulseAudio backend.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <glib.h>
+
+#include "backend.h"
+
+#define TEST_CARD "PNMixer-Null"
+#define TEST_TIMEOUT 2000000 /* us */
+
+static const Backend *pulse;
+
+/* Whether the sink of the test is there */
+static gboolean
+test_card_available(void)
+{
+	GSList *list;
+	gboolean found;
+
+	list = backend_list_cards(pulse);
+	found = g_slist_find_custom(list, TEST_CARD, (GCompareFunc) g_strcmp0) != NULL;
+	g_slist_free_full(list, g_free);
+
+	return found;
+}
+
+static BackendCard *
+test_card_new(void)
+{
+	BackendCard *card;
+
+	card = backend_card_new(pulse, TEST_CARD, NULL, BACKEND_STREAM_PLAYBACK, TRUE);
+	g_assert_nonnull(card);
+
+	return card;
+}
+
+/* What the server has, through a card handle of its own */
+static void
+test_card_check(gdouble volume, gboolean muted)
+{
+	BackendCard *card;
+
+	card = test_card_new();
+	g_assert_cmpfloat(fabs(backend_card_get_volume(card) - volume), <, 0.5);
+	g_assert_cmpint(backend_card_is_muted(card), ==, muted);
+	backend_card_free(card);
+}
+
+static void
+test_pulse_set(void)
+{
+	BackendTransaction trans = { 0 };
+	BackendCard *card;
+
+	card = test_card_new();
+	g_assert_cmpstr(backend_card_get_name(card), ==, TEST_CARD);
+	g_assert_true(backend_card_has_mute(card));
+
+	backend_card_set_volume(card, 40, 0);
+	g_assert_cmpfloat(fabs(backend_card_get_volume(card) - 40), <, 0.5);
+	test_card_check(40, FALSE);
+
+	backend_card_toggle_mute(card);
+	g_assert_true(backend_card_is_muted(card));
+	test_card_check(40, TRUE);
+
+	/* Volume and unmute in one go */
+	trans.ops[trans.n_ops].type = BACKEND_OP_SET_VOLUME;
+	trans.ops[trans.n_ops].value = 70;
+	trans.n_ops++;
+	trans.ops[trans.n_ops].type = BACKEND_OP_SET_MUTE;
+	trans.ops[trans.n_ops].muted = FALSE;
+	trans.n_ops++;
+	backend_card_apply(card, &trans);
+	test_card_check(70, FALSE);
+
+	backend_card_free(card);
+}
+
+static void
+on_card_event(enum backend_event event, G_GNUC_UNUSED guint changes, gpointer data)
+{
+	guint *n_events = data;
+
+	if (event == BACKEND_CARD_VALUES_CHANGED)
+		(*n_events)++;
+}
+
+static void
+test_pulse_events(void)
+{
+	BackendCard *card, *other;
+	guint n_events = 0;
+	gint64 end;
+
+	card = test_card_new();
+	backend_card_install_callback(card, on_card_event, &n_events);
+
+	/* Someone else changes the volume */
+	other = test_card_new();
+	backend_card_set_volume(other, 25, 0);
+
+	end = g_get_monotonic_time() + TEST_TIMEOUT;
+	while (n_events == 0 && g_get_monotonic_time() < end)
+		g_main_context_iteration(NULL, FALSE);
+
+	g_assert_cmpuint(n_events, >, 0);
+	g_assert_cmpfloat(fabs(backend_card_get_volume(card) - 25), <, 0.5);
+
+	backend_card_free(other);
+	backend_card_free(card);
+}
+
+static void
+test_pulse_skip(void)
+{
+	g_test_skip("No PulseAudio server, or no '" TEST_CARD "' sink");
+}
+
+int
+main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	pulse = backend_get("pulse");
+	g_assert_cmpstr(pulse->name, ==, "pulse");
+
+	if (test_card_available()) {
+		g_test_add_func("/pulse/set", test_pulse_set);
+		g_test_add_func("/pulse/events", test_pulse_events);
+	} else {
+		g_test_add_func("/pulse/set", test_pulse_skip);
+	}
+
+	return g_test_run();
+}
@@ -0,0 +1,235 @@
+/* test-throttle.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file test-throttle.c
+ * Tests for the throttle that paces the popup slider updates. The frame
+ * clock of the slider is simulated by a 16 ms timeout.
+ * @brief Tests for the throttle.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+
+#include "throttle.h"
+
+#define TEST_FRAME 16 /* ms */
+#define TEST_DRAG_DURATION 500 /* ms */
+
+/* What was applied, and what the frame clock was asked */
+struct test_state {
+	guint n_applied;
+	gdouble value;
+	guint n_frames_added;
+	guint n_frames_removed;
+};
+
+typedef struct test_state TestState;
+
+static void
+on_apply(gdouble value, gpointer data)
+{
+	TestState *state = data;
+
+	state->n_applied++;
+	state->value = value;
+}
+
+static guint
+test_frame_add(GSourceFunc func, gpointer func_data, gpointer data)
+{
+	TestState *state = data;
+
+	state->n_frames_added++;
+
+	return g_timeout_add(TEST_FRAME, func, func_data);
+}
+
+static void
+test_frame_remove(guint id, gpointer data)
+{
+	TestState *state = data;
+
+	state->n_frames_removed++;
+	g_source_remove(id);
+}
+
+static Throttle *
+test_throttle_new(guint interval, TestState *state)
+{
+	Throttle *throttle;
+
+	throttle = throttle_new(interval, on_apply, state);
+	throttle_set_frame_clock(throttle, test_frame_add, test_frame_remove, state);
+
+	return throttle;
+}
+
+static gboolean
+test_quit_cb(gpointer data)
+{
+	g_main_loop_quit(data);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Run the main loop for a while */
+static void
+test_wait(guint ms)
+{
+	GMainLoop *loop;
+
+	loop = g_main_loop_new(NULL, FALSE);
+	g_timeout_add(ms, test_quit_cb, loop);
+	g_main_loop_run(loop);
+	g_main_loop_unref(loop);
+}
+
+/* Many values within a frame make one write, with the last value */
+static void
+test_throttle_frame(void)
+{
+	TestState state = { 0 };
+	Throttle *throttle;
+	gint i;
+
+	throttle = test_throttle_new(0, &state);
+
+	for (i = 1; i <= 100; i++)
+		throttle_push(throttle, i);
+	g_assert_cmpuint(state.n_applied, ==, 0);
+	g_assert_cmpuint(state.n_frames_added, ==, 1);
+
+	test_wait(3 * TEST_FRAME);
+	g_assert_cmpuint(state.n_applied, ==, 1);
+	g_assert_cmpfloat(state.value, ==, 100);
+
+	/* Nothing pending, nothing asked */
+	test_wait(3 * TEST_FRAME);
+	g_assert_cmpuint(state.n_applied, ==, 1);
+	g_assert_cmpuint(state.n_frames_added, ==, 1);
+
+	throttle_free(throttle);
+	g_assert_cmpuint(state.n_applied, ==, 1);
+}
+
+/* Flushing applies right away, and cancels the frame callback */
+static void
+test_throttle_flush(void)
+{
+	TestState state = { 0 };
+	Throttle *throttle;
+
+	throttle = test_throttle_new(0, &state);
+
+	throttle_push(throttle, 10);
+	throttle_push(throttle, 20);
+	throttle_flush(throttle);
+	g_assert_cmpuint(state.n_applied, ==, 1);
+	g_assert_cmpfloat(state.value, ==, 20);
+	g_assert_cmpuint(state.n_frames_removed, ==, 1);
+
+	test_wait(3 * TEST_FRAME);
+	g_assert_cmpuint(state.n_applied, ==, 1);
+
+	/* Nothing to flush */
+	throttle_flush(throttle);
+	g_assert_cmpuint(state.n_applied, ==, 1);
+
+	/* Freeing is flushing */
+	throttle_push(throttle, 30);
+	throttle_free(throttle);
+	g_assert_cmpuint(state.n_applied, ==, 2);
+	g_assert_cmpfloat(state.value, ==, 30);
+	g_assert_cmpuint(state.n_frames_removed, ==, 2);
+}
+
+/* An interval wins over the frame clock */
+static void
+test_throttle_interval(void)
+{
+	TestState state = { 0 };
+	Throttle *throttle;
+
+	throttle = test_throttle_new(100, &state);
+
+	throttle_push(throttle, 10);
+	test_wait(3 * TEST_FRAME);
+	g_assert_cmpuint(state.n_applied, ==, 0);
+	g_assert_cmpuint(state.n_frames_added, ==, 0);
+
+	test_wait(100);
+	g_assert_cmpuint(state.n_applied, ==, 1);
+	g_assert_cmpfloat(state.value, ==, 10);
+
+	throttle_free(throttle);
+}
+
+/* A slider being dragged */
+struct test_drag {
+	Throttle *throttle;
+	guint n_values;
+};
+
+typedef struct test_drag TestDrag;
+
+static gboolean
+on_drag_step(gpointer data)
+{
+	TestDrag *drag = data;
+
+	drag->n_values++;
+	throttle_push(drag->throttle, drag->n_values / 10.0);
+
+	return G_SOURCE_CONTINUE;
+}
+
+/* A value every ms or so: how many writes per second, before and after */
+static void
+test_throttle_drag(void)
+{
+	TestState state = { 0 };
+	TestDrag drag = { 0 };
+	guint drag_id;
+	gdouble elapsed;
+
+	drag.throttle = test_throttle_new(0, &state);
+	g_test_timer_start();
+
+	drag_id = g_timeout_add(1, on_drag_step, &drag);
+	test_wait(TEST_DRAG_DURATION);
+	g_source_remove(drag_id);
+	throttle_free(drag.throttle);
+
+	elapsed = g_test_timer_elapsed();
+	g_test_message("Slider drag: %.0f writes/s without the throttle, %.0f with it",
+	               drag.n_values / elapsed, state.n_applied / elapsed);
+
+	g_assert_cmpuint(state.n_applied, >=, 2);
+	g_assert_cmpuint(state.n_applied, <=, elapsed * 1000 / TEST_FRAME + 2);
+	g_assert_cmpuint(state.n_applied, <, drag.n_values);
+	g_assert_cmpfloat(state.value, ==, drag.n_values / 10.0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/throttle/frame", test_throttle_frame);
+	g_test_add_func("/throttle/flush", test_throttle_flush);
+	g_test_add_func("/throttle/interval", test_throttle_interval);
+	g_test_add_func("/throttle/drag", test_throttle_drag);
+
+	return g_test_run();
+}